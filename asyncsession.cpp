@@ -0,0 +1,258 @@
+#include <cstring>
+
+#include "asyncsession.h"
+#include "framebuf.h"
+#include "output.h"
+#include "stats.h"
+
+// Timeout for establishing a TCP connection
+#define CONNECT_TIMEOUT_MS 5000
+
+AsyncSession::AsyncSession(EventLoop& loop, Session* session, SessionObserver* observer)
+    : loop_(loop), session_(session), observer_(observer), pool_(nullptr), fd_(-1),
+      connector_(loop, this), connecting_(false), connect_failed_(false), finished_(false),
+      responded_(false), interest_(0), last_progress_(0), timer_(this) {
+    memset(&server_addr_, 0, sizeof(server_addr_));
+}
+
+AsyncSession::~AsyncSession() {
+    if (!finished_ && connect_failed_) {
+        // startTCP()/startUDP() failed: the session never ran, but it did fail
+        statsStartFailed();
+    }
+    loop_.cancelTimer(&timer_);
+    if (fd_ >= 0) {
+        loop_.remove(fd_);
+        close(fd_);
+    }
+    delete session_;
+}
+
+bool AsyncSession::attach(int fd) {
+    fd_ = fd;
+    interest_ = EV_READ;
+    if (!loop_.add(fd_, interest_, this)) {
+        close(fd_);
+        fd_ = -1;
+        connect_failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool AsyncSession::startTCP(const std::string& host, int port) {
+    times_.begin();
+    statsCount(STAT_STARTED);
+    if (pool_ != nullptr) {
+        pool_key_ = ConnectionPool::key(host, port, session_->isText());
+        int idle = pool_->checkout(pool_key_, loop_.now());
+        if (idle >= 0) {
+            // Already connected and negotiated
+            if (!attach(idle)) {
+                return false;
+            }
+            session_->resume();
+            loop_.addTimer(&timer_, session_->timeoutMs());
+            update();
+            return true;
+        }
+        session_->requestPersistent();
+    }
+
+    std::vector<SocketAddress> addresses;
+    if (!resolveHostAll(host, port, addresses)) {
+        connect_failed_ = true;
+        return false;
+    }
+    times_.mark(PHASE_RESOLVE);
+    if (!connector_.start(addresses)) {
+        connect_failed_ = true;
+        return false;
+    }
+
+    // Bounds the whole connector, however many addresses it ends up trying
+    connecting_ = true;
+    loop_.addTimer(&timer_, CONNECT_TIMEOUT_MS);
+    return true;
+}
+
+bool AsyncSession::startUDP(const std::string& host, int port) {
+    times_.begin();
+    statsCount(STAT_STARTED);
+    int fd = createUDPSocket(host, port, server_addr_);
+    if (fd < 0) {
+        connect_failed_ = true;
+        return false;
+    }
+    times_.mark(PHASE_RESOLVE);
+
+    if (!attach(fd)) {
+        return false;
+    }
+    retransmit_.start(&rttEstimatorFor((const struct sockaddr*)&server_addr_.addr, server_addr_.len), loop_.now());
+    session_->start();
+    loop_.addTimer(&timer_, stepTimeoutMs());
+    update();
+    return true;
+}
+
+void AsyncSession::onEvent(uint32_t events) {
+    if (finished_) {
+        return;
+    }
+
+    if (events & EV_READ) {
+        onReadable();
+    }
+    if (!finished_ && (events & EV_WRITE)) {
+        update();
+    }
+}
+
+void AsyncSession::onConnected(int fd) {
+    connecting_ = false;
+    times_.mark(PHASE_CONNECT);
+    if (!attach(fd)) {
+        complete();
+        return;
+    }
+
+    session_->start();
+    loop_.addTimer(&timer_, session_->timeoutMs());
+    update();
+}
+
+void AsyncSession::onConnectFailed() {
+    connecting_ = false;
+    connect_failed_ = true;
+    complete();
+}
+
+void AsyncSession::onReadable() {
+    char buffer[4096];
+    FrameBuffer* rx = session_->receiveBuffer();
+    unsigned progress = session_->progress();
+
+    while (!session_->done()) {
+        ssize_t bytes_read;
+        if (rx != nullptr) {
+            // Stream sessions are read in bulk straight into their frame buffer
+            bytes_read = rx->readFrom(fd_);
+        } else if (session_->isDatagram()) {
+            bytes_read = recvfrom(fd_, buffer, sizeof(buffer), 0, nullptr, nullptr);
+        } else {
+            bytes_read = recv(fd_, buffer, sizeof(buffer), 0);
+        }
+
+        if (bytes_read > 0) {
+            responded_ = true;
+            if (rx != nullptr) {
+                session_->onBuffered();
+            } else {
+                session_->onReceive(buffer, (size_t)bytes_read);
+            }
+            continue;
+        }
+        if (bytes_read < 0 && socketWouldBlock()) {
+            break;
+        }
+        if (session_->isDatagram()) {
+            // ICMP errors (e.g. port unreachable) surface here; keep waiting for the timeout
+            if (bytes_read < 0) {
+                break;
+            }
+            continue;
+        }
+        session_->onClosed();
+    }
+
+    if (retransmit_.active() && (session_->progress() != progress || session_->done())) {
+        retransmit_.onReply(loop_.now());
+    }
+    update();
+}
+
+void AsyncSession::flush() {
+    while (session_->hasOutput()) {
+        const std::string& out = session_->output();
+        // UDP sockets are connected to the server as well
+        ssize_t sent = send(fd_, out.data(), out.size(), 0);
+
+        if (sent < 0) {
+            if (socketWouldBlock()) {
+                return;
+            }
+            session_->abort("Failed to send message to server");
+            return;
+        }
+        session_->consumeOutput(session_->isDatagram() ? out.size() : (size_t)sent);
+    }
+}
+
+void AsyncSession::update() {
+    flush();
+    times_.track(*session_);
+
+    if (session_->done()) {
+        complete();
+        return;
+    }
+
+    // Every protocol step gets a fresh timeout, like a per-recv SO_RCVTIMEO
+    if (session_->progress() != last_progress_) {
+        last_progress_ = session_->progress();
+        loop_.addTimer(&timer_, stepTimeoutMs());
+    }
+
+    uint32_t wanted = EV_READ | (session_->hasOutput() ? EV_WRITE : 0);
+    if (wanted != interest_) {
+        interest_ = wanted;
+        loop_.modify(fd_, interest_, this);
+    }
+}
+
+void AsyncSession::onTimer() {
+    if (finished_) {
+        return;
+    }
+    if (connecting_) {
+        connector_.cancel();
+        connect_failed_ = true;
+    } else if (retransmit_.active() && session_->retransmit()) {
+        retransmit_.onRetransmit();
+        loop_.addTimer(&timer_, stepTimeoutMs());
+        update();
+        return;
+    } else {
+        session_->onTimeout();
+    }
+    complete();
+}
+
+uint64_t AsyncSession::stepTimeoutMs() const {
+    if (retransmit_.active()) {
+        return retransmit_.timeoutMs(session_->retransmits());
+    }
+    return (uint64_t)session_->timeoutMs();
+}
+
+void AsyncSession::complete() {
+    finished_ = true;
+    loop_.cancelTimer(&timer_);
+    if (fd_ >= 0) {
+        loop_.remove(fd_);
+        if (pool_ != nullptr && session_->reusable() && !session_->hasOutput()) {
+            pool_->checkin(pool_key_, fd_, loop_.now());
+        } else {
+            close(fd_);
+        }
+        fd_ = -1;
+    }
+
+    recordTimings(*session_, times_);
+    recordStats(*session_, times_, connect_failed_);
+    writeSessionRecord(*session_, times_, connect_failed_);
+    if (observer_) {
+        observer_->onSessionDone(this);
+    }
+}
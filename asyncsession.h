@@ -0,0 +1,77 @@
+#ifndef ASYNCSESSION_H
+#define ASYNCSESSION_H
+
+#include <string>
+
+#include "client.h"
+#include "eventloop.h"
+#include "session.h"
+#include "connpool.h"
+#include "connector.h"
+#include "rtt.h"
+#include "timing.h"
+
+// Drives one Session over a non-blocking socket registered with an EventLoop.
+// Timeouts are taken from Session::timeoutMs() and re-armed on every protocol step;
+// UDP sessions instead retransmit on the RTO of the server's RttEstimator.
+// TCP connects try all addresses of the server through a TcpConnector.
+class AsyncSession : public SessionDriver, public EventHandler, public TimerHandler,
+                     private ConnectObserver {
+public:
+    // Takes ownership of session
+    AsyncSession(EventLoop& loop, Session* session, SessionObserver* observer = nullptr);
+    ~AsyncSession();
+
+    // Start a non-blocking connect / open a UDP socket. Returns false (and sets
+    // connectFailed()) if no socket could be set up; the observer is not called then.
+    bool startTCP(const std::string& host, int port);
+    bool startUDP(const std::string& host, int port);
+
+    // Take TCP connections from pool and return them there afterwards, if the
+    // server supports persistent connections. Call before startTCP().
+    void usePool(ConnectionPool* pool) { pool_ = pool; }
+
+    bool done() const override { return finished_; }
+    bool ok() const override { return finished_ && session_->status() == SESSION_OK; }
+    bool connectFailed() const override { return connect_failed_; }
+    bool isTCP() const override { return !session_->isDatagram(); }
+
+    // True once anything arrived from the server
+    bool responded() const { return responded_; }
+
+    void onEvent(uint32_t events) override;
+    void onTimer() override;
+
+private:
+    AsyncSession(const AsyncSession&);
+    AsyncSession& operator=(const AsyncSession&);
+
+    bool attach(int fd);
+    void onConnected(int fd) override;
+    void onConnectFailed() override;
+    void onReadable();
+    void flush();
+    void update();
+    void complete();
+    uint64_t stepTimeoutMs() const;
+
+    EventLoop& loop_;
+    Session* session_;
+    SessionObserver* observer_;
+    ConnectionPool* pool_;
+    std::string pool_key_;
+    int fd_;
+    SocketAddress server_addr_;         // UDP only
+    TcpConnector connector_;
+    bool connecting_;
+    bool connect_failed_;
+    bool finished_;
+    bool responded_;
+    uint32_t interest_;
+    unsigned last_progress_;
+    RetransmitTracker retransmit_;
+    PhaseTimes times_;
+    Timer timer_;
+};
+
+#endif // ASYNCSESSION_H
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "batch.h"
+#include "client.h"
+#include "asyncsession.h"
+#include "resolver.h"
+#include "output.h"
+
+// Bytes read from the job input at a time
+#define BATCH_READ_SIZE 16384
+
+class BatchRunner : public SessionObserver, public EventHandler {
+public:
+    BatchRunner(int fd, int concurrency)
+        : fd_(fd), concurrency_((size_t)concurrency), watching_(false), reading_(false), eof_(false),
+          all_ok_(true) {}
+
+    ~BatchRunner() {
+        for (size_t i = 0; i < pending_.size(); i++) {
+            delete pending_[i];
+        }
+    }
+
+    bool run() {
+        // A pipe or terminal is waited for on the loop; regular files can not
+        // be polled but never block either
+        int flags = fcntl(fd_, F_GETFL);
+        if (flags >= 0) {
+            fcntl(fd_, F_SETFL, flags | O_NONBLOCK);
+        }
+        watching_ = loop_.add(fd_, EV_READ, this);
+        reading_ = watching_;
+
+        for (;;) {
+            readInput();
+            startJobs();
+            if (eof_ && pending_.empty() && running_.empty()) {
+                break;
+            }
+            watchInput();
+            std::cout.flush();
+            flushOutput();
+            loop_.runOnce();
+        }
+
+        if (watching_) {
+            loop_.remove(fd_);
+        }
+        if (flags >= 0) {
+            fcntl(fd_, F_SETFL, flags);
+        }
+        return all_ok_;
+    }
+
+    // More input arrived; it is read after this loop iteration
+    void onEvent(uint32_t) override {}
+
+    void onSessionDone(SessionDriver* session) override {
+        std::map<SessionDriver*, Job*>::iterator it = running_.find(session);
+        Job* job = it->second;
+        running_.erase(it);
+        loop_.deleteLater(static_cast<AsyncSession*>(session));
+
+        // ANY mode: a failed UDP attempt falls back to TCP within the same job
+        if (job->info.transport == URL_ANY && !session->ok() && !session->isTCP()) {
+            if (!launch(job, true)) {
+                finish(job, "TCP", "CANT_CONNECT");
+            }
+            return;
+        }
+
+        const char* verdict = session->ok() ? "OK" : session->connectFailed() ? "CANT_CONNECT" : "ERROR";
+        finish(job, session->isTCP() ? "TCP" : "UDP", verdict);
+    }
+
+private:
+    struct Job {
+        std::string target;
+        URLInfo info;
+        bool valid;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Read while there is room for more pending jobs and the input has data
+    void readInput() {
+        char buf[BATCH_READ_SIZE];
+        while (!eof_ && pending_.size() < concurrency_) {
+            ssize_t n = read(fd_, buf, sizeof(buf));
+            if (n > 0) {
+                splitLines(buf, (size_t)n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            if (n < 0) {
+                printError("Failed to read jobs");
+            }
+            eof_ = true;
+            addJob(partial_.data(), partial_.data() + partial_.size());
+            partial_.clear();
+        }
+    }
+
+    void splitLines(const char* data, size_t len) {
+        const char* end = data + len;
+        while (data < end) {
+            const char* newline = static_cast<const char*>(memchr(data, '\n', (size_t)(end - data)));
+            if (newline == nullptr) {
+                partial_.append(data, end);
+                return;
+            }
+            if (partial_.empty()) {
+                addJob(data, newline);
+            } else {
+                partial_.append(data, newline);
+                addJob(partial_.data(), partial_.data() + partial_.size());
+                partial_.clear();
+            }
+            data = newline + 1;
+        }
+    }
+
+    void addJob(const char* begin, const char* end) {
+        while (begin < end && (*begin == ' ' || *begin == '\t')) {
+            begin++;
+        }
+        while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+            end--;
+        }
+        if (begin == end || *begin == '#') {
+            return;
+        }
+
+        Job* job = new Job();
+        job->target.assign(begin, end);
+        job->valid = parseURL(job->target, job->info);
+        if (job->valid) {
+            // Resolve in the background while earlier jobs run
+            ResolverCache::instance().prefetch(job->info.host);
+        }
+        pending_.push_back(job);
+    }
+
+    // Stop polling the input while the backlog is full, so the level
+    // triggered readiness does not spin the loop
+    void watchInput() {
+        bool want = !eof_ && pending_.size() < concurrency_;
+        if (watching_ && want != reading_) {
+            loop_.modify(fd_, want ? EV_READ : 0, this);
+            reading_ = want;
+        }
+    }
+
+    void startJobs() {
+        while (running_.size() < concurrency_) {
+            if (pending_.empty()) {
+                readInput();
+                if (pending_.empty()) {
+                    return;
+                }
+            }
+            Job* job = pending_.front();
+            pending_.pop_front();
+            job->start = std::chrono::steady_clock::now();
+
+            if (!job->valid) {
+                finish(job, "-", "INVALID_URL");
+            } else if (!launch(job, job->info.transport == URL_TCP) &&
+                       !(job->info.transport == URL_ANY && launch(job, true))) {
+                finish(job, job->info.transport == URL_UDP ? "UDP" : "TCP", "CANT_CONNECT");
+            }
+        }
+    }
+
+    bool launch(Job* job, bool tcp) {
+        AsyncSession* driver = new AsyncSession(loop_, createSession(tcp, job->info.text), this);
+        if (!(tcp ? driver->startTCP(job->info.host, job->info.port)
+                  : driver->startUDP(job->info.host, job->info.port))) {
+            delete driver;
+            return false;
+        }
+        running_[driver] = job;
+        return true;
+    }
+
+    void finish(Job* job, const char* transport, const char* verdict) {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job->start).count();
+        if (output_format == OUTPUT_JSONL) {
+            writeJobRecord(job->target, transport, verdict, ms);
+        } else {
+            std::cout << job->target << '\t' << transport << '\t' << verdict << '\t'
+                      << std::fixed << std::setprecision(3) << ms << '\n';
+        }
+        all_ok_ = all_ok_ && verdict[0] == 'O';
+        delete job;
+    }
+
+    EventLoop loop_;
+    int fd_;
+    size_t concurrency_;
+    bool watching_;             // fd is registered with the loop
+    bool reading_;              // ... with EV_READ interest
+    bool eof_;
+    std::string partial_;       // Start of a line whose newline has not arrived yet
+    std::deque<Job*> pending_;
+    std::map<SessionDriver*, Job*> running_;
+    bool all_ok_;
+};
+
+bool runBatch(int fd, int concurrency) {
+    bool was_quiet = quiet_mode;
+    quiet_mode = true;
+    BatchRunner runner(fd, concurrency);
+    bool ok = runner.run();
+    quiet_mode = was_quiet;
+    return ok;
+}
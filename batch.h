@@ -0,0 +1,22 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Batch mode (-f): run the PROTOCOL://host:port/api jobs read from fd, one
+// per line, keeping up to concurrency of them in flight on one event loop.
+// Blank lines and lines starting with '#' are skipped. The input is read as
+// slots free up, so fd may be a pipe that keeps delivering jobs.
+//
+// Every job produces one tab separated line on stdout as soon as it finishes:
+//   TARGET  TRANSPORT  VERDICT  LATENCY_MS
+// TRANSPORT is TCP or UDP (the one that finished the job; "-" if none was
+// tried), VERDICT is OK, ERROR, CANT_CONNECT or INVALID_URL and LATENCY_MS
+// runs from the start of the job to its verdict.
+//
+// With -o jsonl the line is a "job" record (output.h) instead, following the
+// "session" records of its attempts.
+//
+// ANY jobs try UDP and fall back to TCP if the UDP session fails, like the
+// load generator. Returns true if every job finished OK.
+bool runBatch(int fd, int concurrency);
+
+#endif // BATCH_H
@@ -0,0 +1,755 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <regex>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "calcLib.h"
+#include "protocol.h"
+#include "textproto.h"
+#include "binproto.h"
+#include "url.h"
+#include "output.h"
+
+// Microbenchmarks for the hot paths of client and server. Every case is
+// warmed up, then timed in several repetitions; the median cost per item is
+// reported with the spread of the repetitions. With -j the results are also
+// written as JSON, to compare runs across commits.
+
+// Warmup per case (caches, branch predictors, CPU clock), which also sizes
+// the repetitions
+#define BENCH_WARMUP_SECONDS 0.05
+
+// Wall time per repetition
+#define BENCH_REPETITION_SECONDS 0.05
+
+// Repetitions per case (-r)
+static int bench_repetitions = 7;
+
+// Assignments per calculate_batch() call
+#define BATCH_SIZE 4096
+
+// Keeps results observable so the optimizer can not drop the measured work
+static volatile int32_t bench_sink;
+
+// Nanoseconds per item over the repetitions of one case
+struct Measurement {
+    double median;
+    double mean;
+    double stddev;      // Sample standard deviation
+    double min;
+    int repetitions;
+};
+
+static Measurement summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    Measurement m;
+    m.repetitions = (int)n;
+    m.min = samples[0];
+    m.median = n % 2 == 1 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    m.mean = 0;
+    for (size_t i = 0; i < n; i++) {
+        m.mean += samples[i];
+    }
+    m.mean /= (double)n;
+    double squares = 0;
+    for (size_t i = 0; i < n; i++) {
+        squares += (samples[i] - m.mean) * (samples[i] - m.mean);
+    }
+    m.stddev = n > 1 ? std::sqrt(squares / (double)(n - 1)) : 0;
+    return m;
+}
+
+// Run body (which processes items_per_call items) for BENCH_WARMUP_SECONDS,
+// then bench_repetitions times for about BENCH_REPETITION_SECONDS each
+template <typename Body>
+static Measurement measure(Body body, size_t items_per_call) {
+    typedef std::chrono::steady_clock clock;
+    size_t calls = 0;
+    clock::time_point start = clock::now();
+    double elapsed = 0;
+    do {
+        for (int i = 0; i < 64; i++) {
+            body();
+        }
+        calls += 64;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < BENCH_WARMUP_SECONDS);
+    size_t calls_per_repetition = std::max((size_t)1, (size_t)((double)calls * BENCH_REPETITION_SECONDS / elapsed));
+
+    std::vector<double> samples;
+    for (int r = 0; r < bench_repetitions; r++) {
+        start = clock::now();
+        for (size_t i = 0; i < calls_per_repetition; i++) {
+            body();
+        }
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        samples.push_back(elapsed * 1e9 / (double)(calls_per_repetition * items_per_call));
+    }
+    return summarize(samples);
+}
+
+// Time stamp counter ticks per nanosecond (0 where there is none), measured
+// once against the steady clock. The TSC runs at the nominal clock rate, so
+// ns_per_item * tscPerNs() is the cost in (reference) cycles.
+static double tscPerNs() {
+#if defined(__x86_64__) || defined(__i386__)
+    static double ticks_per_ns = 0;
+    if (ticks_per_ns == 0) {
+        typedef std::chrono::steady_clock clock;
+        clock::time_point start = clock::now();
+        uint64_t tsc_start = __rdtsc();
+        while (clock::now() - start < std::chrono::milliseconds(50)) {
+        }
+        uint64_t ticks = __rdtsc() - tsc_start;
+        ticks_per_ns = (double)ticks / std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    }
+    return ticks_per_ns;
+#else
+    return 0;
+#endif
+}
+
+// Everything reported, for -j
+struct BenchResult {
+    std::string group;
+    std::string name;
+    Measurement ns_per_item;
+};
+
+static std::vector<BenchResult> bench_results;
+static std::string bench_group;
+
+// Start a group of cases measuring the same work
+static void section(const std::string& group, const std::string& detail) {
+    bench_group = group;
+    std::cout << group;
+    if (!detail.empty()) {
+        std::cout << " (" << detail << ")";
+    }
+    std::cout << std::endl;
+}
+
+// Median ns/item, its spread over the repetitions (coefficient of variation),
+// speedup over the group's baseline and the median in cycles
+static void report(const std::string& name, const Measurement& m, const Measurement& baseline) {
+    std::cout << "  " << std::left << std::setw(24) << name << std::right
+              << std::fixed << std::setprecision(3) << std::setw(9) << m.median << " ns/item"
+              << std::setprecision(1) << std::setw(6) << (m.median > 0 ? 100.0 * m.stddev / m.mean : 0.0) << "%"
+              << std::setprecision(2) << std::setw(9) << baseline.median / m.median << "x";
+    if (tscPerNs() > 0) {
+        std::cout << std::setprecision(1) << std::setw(9) << m.median * tscPerNs() << " cycles";
+    }
+    std::cout << std::endl;
+
+    BenchResult result = { bench_group, name, m };
+    bench_results.push_back(result);
+}
+
+static void writeJsonString(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\') {
+            out << '\\';
+        }
+        out << s[i];
+    }
+    out << '"';
+}
+
+// {"label":...,"repetitions":7,"cycles_per_ns":3.0,"results":[{"group":...,"name":...,
+//  "median_ns":...,"mean_ns":...,"stddev_ns":...,"min_ns":...,"repetitions":7},...]}
+static void writeJson(std::ostream& out, const std::string& label) {
+    out << "{\"label\":";
+    writeJsonString(out, label);
+    out << ",\"repetitions\":" << bench_repetitions
+        << std::setprecision(4) << ",\"cycles_per_ns\":" << tscPerNs() << ",\"results\":[";
+    for (size_t i = 0; i < bench_results.size(); i++) {
+        const BenchResult& r = bench_results[i];
+        out << (i > 0 ? ",\n" : "\n") << "{\"group\":";
+        writeJsonString(out, r.group);
+        out << ",\"name\":";
+        writeJsonString(out, r.name);
+        out << std::fixed << std::setprecision(3)
+            << ",\"median_ns\":" << r.ns_per_item.median << ",\"mean_ns\":" << r.ns_per_item.mean
+            << ",\"stddev_ns\":" << r.ns_per_item.stddev << ",\"min_ns\":" << r.ns_per_item.min
+            << ",\"repetitions\":" << r.ns_per_item.repetitions << "}";
+        out.unsetf(std::ios_base::floatfield);
+    }
+    out << "\n]}" << std::endl;
+}
+
+// Random assignments like the server hands out, with some zero divisors and
+// INT32_MIN / -1 mixed in. Many products overflow; calculate() wraps them like
+// the kernels do, so it is an exact reference for them.
+static void makeAssignments(std::vector<uint32_t>& ops, std::vector<int32_t>& v1, std::vector<int32_t>& v2) {
+    srand(42);
+    for (size_t i = 0; i < ops.size(); i++) {
+        ops[i] = ARITH_ADD + (uint32_t)(rand() % 4);
+        v1[i] = rand() % 200001 - 100000;
+        v2[i] = (rand() % 16 == 0) ? 0 : rand() % 200001 - 100000;
+        if (i % 251 == 0) {
+            ops[i] = ARITH_DIV;
+            v1[i] = INT32_MIN;
+            v2[i] = -1;
+        }
+    }
+}
+
+static bool benchCalculate() {
+    std::vector<uint32_t> ops(BATCH_SIZE);
+    std::vector<int32_t> v1(BATCH_SIZE);
+    std::vector<int32_t> v2(BATCH_SIZE);
+    std::vector<int32_t> expected(BATCH_SIZE);
+    std::vector<int32_t> out(BATCH_SIZE);
+    makeAssignments(ops, v1, v2);
+
+    section("calculate", std::to_string(BATCH_SIZE) + " assignments per call");
+
+    Measurement baseline = measure([&]() {
+        for (size_t i = 0; i < BATCH_SIZE; i++) {
+            out[i] = calculate(ops[i], v1[i], v2[i]);
+        }
+        bench_sink = out[BATCH_SIZE - 1];
+    }, BATCH_SIZE);
+    report("calculate() loop", baseline, baseline);
+    expected = out;
+
+    bool ok = true;
+    calc_kernel best = calculate_batch_best_kernel();
+    for (int k = CALC_KERNEL_SCALAR; k <= (int)best; k++) {
+        calc_kernel kernel = (calc_kernel)k;
+        std::fill(out.begin(), out.end(), 0);
+        calculate_batch_kernel(kernel, &ops[0], &v1[0], &v2[0], &out[0], BATCH_SIZE);
+        if (out != expected) {
+            std::cout << "  " << calculate_batch_kernel_name(kernel) << ": results differ from calculate()" << std::endl;
+            ok = false;
+            continue;
+        }
+
+        Measurement ns = measure([&]() {
+            calculate_batch_kernel(kernel, &ops[0], &v1[0], &v2[0], &out[0], BATCH_SIZE);
+            bench_sink = out[BATCH_SIZE - 1];
+        }, BATCH_SIZE);
+        report(std::string("calculate_batch ") + calculate_batch_kernel_name(kernel), ns, baseline);
+    }
+    return ok;
+}
+
+// Text assignment handling as the sessions did it before textproto: copy the
+// line, parse with istringstream, format the answer with std::to_string
+static bool solveTextWithStreams(const char* data, size_t len, std::string& tx) {
+    if (len > 0 && data[len - 1] == '\n') {
+        len--;
+    }
+    std::string assignment(data, len);
+    std::istringstream iss(assignment);
+    std::string operation;
+    int value1, value2;
+    if (!(iss >> operation >> value1 >> value2)) {
+        return false;
+    }
+    uint32_t op_code = string_to_operation(operation.c_str());
+    if (op_code == 0) {
+        return false;
+    }
+    tx += std::to_string(calculate(op_code, value1, value2)) + "\n";
+    return true;
+}
+
+static bool solveTextWithParser(const char* data, size_t len, std::string& tx) {
+    uint32_t op_code;
+    int32_t value1, value2;
+    if (!parseTextAssignment(data, data + len, op_code, value1, value2)) {
+        return false;
+    }
+    char answer[INT32_TEXT_MAX + 1];
+    size_t answer_len = formatInt32(calculate(op_code, value1, value2), answer);
+    answer[answer_len++] = '\n';
+    tx.append(answer, answer_len);
+    return true;
+}
+
+static bool benchTextParser() {
+    const size_t count = 1024;
+    std::vector<std::string> lines(count);
+    std::vector<uint32_t> ops(count);
+    std::vector<int32_t> v1(count);
+    std::vector<int32_t> v2(count);
+    makeAssignments(ops, v1, v2);
+    for (size_t i = 0; i < count; i++) {
+        lines[i] = std::string(operation_to_string(ops[i])) + " " + std::to_string(v1[i]) + " " +
+                   std::to_string(v2[i]) + "\n";
+    }
+
+    section("text assignment -> answer line", std::to_string(count) + " messages per call");
+
+    // Both must produce the same answers
+    std::string expected, actual;
+    for (size_t i = 0; i < count; i++) {
+        solveTextWithStreams(lines[i].data(), lines[i].size(), expected);
+        solveTextWithParser(lines[i].data(), lines[i].size(), actual);
+    }
+    if (expected != actual) {
+        std::cout << "  parser: answers differ from istringstream" << std::endl;
+        return false;
+    }
+
+    std::string tx;
+    tx.reserve(count * (INT32_TEXT_MAX + 1));
+    Measurement baseline = measure([&]() {
+        tx.clear();
+        for (size_t i = 0; i < count; i++) {
+            solveTextWithStreams(lines[i].data(), lines[i].size(), tx);
+        }
+        bench_sink = (int32_t)tx.size();
+    }, count);
+    report("istringstream", baseline, baseline);
+
+    Measurement ns = measure([&]() {
+        tx.clear();
+        for (size_t i = 0; i < count; i++) {
+            solveTextWithParser(lines[i].data(), lines[i].size(), tx);
+        }
+        bench_sink = (int32_t)tx.size();
+    }, count);
+    report("parseTextAssignment", ns, baseline);
+    return true;
+}
+
+// The operation name <-> ARITH_* mapping of calcLib, in the mixed case
+// servers may send
+static bool benchOperationNames() {
+    const size_t count = 1024;
+    std::vector<uint32_t> ops(count);
+    std::vector<int32_t> v1(count);
+    std::vector<int32_t> v2(count);
+    makeAssignments(ops, v1, v2);
+    std::vector<std::string> names(count);
+    for (size_t i = 0; i < count; i++) {
+        names[i] = operation_to_string(ops[i]);
+        if (i % 3 == 0) {
+            names[i][0] = (char)(names[i][0] - 'a' + 'A');
+        }
+        if (string_to_operation(names[i].c_str()) != ops[i]) {
+            std::cout << "  string_to_operation: " << names[i] << " not recognized" << std::endl;
+            return false;
+        }
+    }
+
+    section("operation names", std::to_string(count) + " names per call");
+
+    Measurement baseline = measure([&]() {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            sum += string_to_operation(names[i].c_str());
+        }
+        bench_sink = (int32_t)sum;
+    }, count);
+    report("string_to_operation", baseline, baseline);
+
+    Measurement ns = measure([&]() {
+        size_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            sum += (size_t)operation_to_string(ops[i])[0];
+        }
+        bench_sink = (int32_t)sum;
+    }, count);
+    report("operation_to_string", ns, baseline);
+    return true;
+}
+
+// The integer fields of TEXT messages on their own: what textproto replaced
+// (strtol on a NUL-terminated copy, std::to_string) against its parser and
+// formatter
+static bool benchIntegers() {
+    const size_t count = 1024;
+    std::vector<uint32_t> ops(count);
+    std::vector<int32_t> values(count);
+    std::vector<int32_t> v2(count);
+    makeAssignments(ops, values, v2);
+    values[0] = INT32_MIN;
+    values[1] = INT32_MAX;
+    std::vector<std::string> texts(count);
+    for (size_t i = 0; i < count; i++) {
+        texts[i] = std::to_string(values[i]);
+        const char* p = texts[i].data();
+        int32_t parsed = 0;
+        char formatted[INT32_TEXT_MAX];
+        if (!parseInt32(p, p + texts[i].size(), parsed) || parsed != values[i] ||
+            std::string(formatted, formatInt32(values[i], formatted)) != texts[i]) {
+            std::cout << "  textproto: " << texts[i] << " does not round-trip" << std::endl;
+            return false;
+        }
+    }
+
+    section("int32 parsing", std::to_string(count) + " values per call");
+    Measurement baseline = measure([&]() {
+        int32_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            std::string copy(texts[i].data(), texts[i].size());
+            sum += (int32_t)strtol(copy.c_str(), nullptr, 10);
+        }
+        bench_sink = sum;
+    }, count);
+    report("string + strtol", baseline, baseline);
+    Measurement ns = measure([&]() {
+        int32_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            const char* p = texts[i].data();
+            int32_t value = 0;
+            parseInt32(p, p + texts[i].size(), value);
+            sum += value;
+        }
+        bench_sink = sum;
+    }, count);
+    report("parseInt32", ns, baseline);
+
+    section("int32 formatting", std::to_string(count) + " values per call");
+    baseline = measure([&]() {
+        size_t len = 0;
+        for (size_t i = 0; i < count; i++) {
+            len += std::to_string(values[i]).size();
+        }
+        bench_sink = (int32_t)len;
+    }, count);
+    report("std::to_string", baseline, baseline);
+    ns = measure([&]() {
+        char buf[INT32_TEXT_MAX];
+        size_t len = 0;
+        for (size_t i = 0; i < count; i++) {
+            len += formatInt32(values[i], buf);
+        }
+        bench_sink = (int32_t)len + buf[0];
+    }, count);
+    report("formatInt32", ns, baseline);
+    return true;
+}
+
+// Byte order conversion as the sessions did it before binproto.h: the frame
+// copied into a struct and swapped field by field through out-of-line wrappers
+__attribute__((noinline)) static uint16_t wrappedNtoh16(uint16_t value) { return ntohs(value); }
+__attribute__((noinline)) static uint32_t wrappedNtoh32(uint32_t value) { return ntohl(value); }
+__attribute__((noinline)) static uint16_t wrappedHton16(uint16_t value) { return htons(value); }
+__attribute__((noinline)) static uint32_t wrappedHton32(uint32_t value) { return htonl(value); }
+
+static void swapDecode(const char* wire, calcProtocol& msg) {
+    memcpy(&msg, wire, sizeof(msg));
+    msg.type = wrappedNtoh16(msg.type);
+    msg.major_version = wrappedNtoh16(msg.major_version);
+    msg.minor_version = wrappedNtoh16(msg.minor_version);
+    msg.id = wrappedNtoh32(msg.id);
+    msg.arith = wrappedNtoh32(msg.arith);
+    msg.inValue1 = (int32_t)wrappedNtoh32((uint32_t)msg.inValue1);
+    msg.inValue2 = (int32_t)wrappedNtoh32((uint32_t)msg.inValue2);
+    msg.inResult = (int32_t)wrappedNtoh32((uint32_t)msg.inResult);
+}
+
+static void swapEncode(const calcProtocol& msg, char* wire) {
+    calcProtocol frame;
+    frame.type = wrappedHton16(msg.type);
+    frame.major_version = wrappedHton16(msg.major_version);
+    frame.minor_version = wrappedHton16(msg.minor_version);
+    frame.id = wrappedHton32(msg.id);
+    frame.arith = wrappedHton32(msg.arith);
+    frame.inValue1 = (int32_t)wrappedHton32((uint32_t)msg.inValue1);
+    frame.inValue2 = (int32_t)wrappedHton32((uint32_t)msg.inValue2);
+    frame.inResult = (int32_t)wrappedHton32((uint32_t)msg.inResult);
+    memcpy(wire, &frame, sizeof(frame));
+}
+
+static void swapDecode(const char* wire, calcMessage& msg) {
+    memcpy(&msg, wire, sizeof(msg));
+    msg.type = wrappedNtoh16(msg.type);
+    msg.message = wrappedNtoh16(msg.message);
+    msg.protocol = wrappedNtoh16(msg.protocol);
+    msg.major_version = wrappedNtoh16(msg.major_version);
+    msg.minor_version = wrappedNtoh16(msg.minor_version);
+}
+
+static void swapEncode(const calcMessage& msg, char* wire) {
+    calcMessage frame;
+    frame.type = wrappedHton16(msg.type);
+    frame.message = wrappedHton16(msg.message);
+    frame.protocol = wrappedHton16(msg.protocol);
+    frame.major_version = wrappedHton16(msg.major_version);
+    frame.minor_version = wrappedHton16(msg.minor_version);
+    memcpy(wire, &frame, sizeof(frame));
+}
+
+static void decodeFrame(const char* wire, calcProtocol& msg) { msg = decodeCalcProtocol(wire); }
+static void decodeFrame(const char* wire, calcMessage& msg) { msg = decodeCalcMessage(wire); }
+static void encodeFrame(const calcProtocol& msg, char* wire) { encodeCalcProtocol(msg, wire); }
+static void encodeFrame(const calcMessage& msg, char* wire) { encodeCalcMessage(msg, wire); }
+static void decodeFrames(const char* wire, calcProtocol* msgs, size_t n) { decodeCalcProtocols(wire, msgs, n); }
+static void decodeFrames(const char* wire, calcMessage* msgs, size_t n) { decodeCalcMessages(wire, msgs, n); }
+static void encodeFrames(const calcProtocol* msgs, size_t n, char* wire) { encodeCalcProtocols(msgs, n, wire); }
+static void encodeFrames(const calcMessage* msgs, size_t n, char* wire) { encodeCalcMessages(msgs, n, wire); }
+
+// Decode and encode count frames of type Frame held back to back in wire
+template <typename Frame>
+static bool benchFrames(const char* name, const std::vector<char>& wire, size_t count) {
+    std::vector<Frame> frames(count);
+    std::vector<char> out(wire.size());
+
+    section(name, std::to_string(sizeof(Frame)) + " bytes, " + std::to_string(count) + " frames per call");
+
+    // Every variant must reproduce the same frames
+    for (size_t i = 0; i < count; i++) {
+        swapDecode(&wire[i * sizeof(Frame)], frames[i]);
+    }
+    encodeFrames(&frames[0], count, &out[0]);
+    if (out != wire) {
+        std::cout << "  codec: frames differ from htons/htonl" << std::endl;
+        return false;
+    }
+
+    Measurement baseline = measure([&]() {
+        for (size_t i = 0; i < count; i++) {
+            swapDecode(&wire[i * sizeof(Frame)], frames[i]);
+        }
+        bench_sink = frames[count - 1].type;
+    }, count);
+    report("decode: memcpy + ntoh()", baseline, baseline);
+    Measurement ns = measure([&]() {
+        for (size_t i = 0; i < count; i++) {
+            decodeFrame(&wire[i * sizeof(Frame)], frames[i]);
+        }
+        bench_sink = frames[count - 1].type;
+    }, count);
+    report("decode: codec", ns, baseline);
+    ns = measure([&]() {
+        decodeFrames(&wire[0], &frames[0], count);
+        bench_sink = frames[count - 1].type;
+    }, count);
+    report("decode: codec batch", ns, baseline);
+
+    baseline = measure([&]() {
+        for (size_t i = 0; i < count; i++) {
+            swapEncode(frames[i], &out[i * sizeof(Frame)]);
+        }
+        bench_sink = out[out.size() - 1];
+    }, count);
+    report("encode: hton() + memcpy", baseline, baseline);
+    ns = measure([&]() {
+        for (size_t i = 0; i < count; i++) {
+            encodeFrame(frames[i], &out[i * sizeof(Frame)]);
+        }
+        bench_sink = out[out.size() - 1];
+    }, count);
+    report("encode: codec", ns, baseline);
+    ns = measure([&]() {
+        encodeFrames(&frames[0], count, &out[0]);
+        bench_sink = out[out.size() - 1];
+    }, count);
+    report("encode: codec batch", ns, baseline);
+    return out == wire;
+}
+
+static bool benchBinaryCodec() {
+    const size_t count = 1024;
+    std::vector<uint32_t> ops(count);
+    std::vector<int32_t> v1(count);
+    std::vector<int32_t> v2(count);
+    makeAssignments(ops, v1, v2);
+
+    // Answered assignments and verdicts as they arrive at the server and client
+    std::vector<char> assignments(count * sizeof(calcProtocol));
+    std::vector<char> verdicts(count * sizeof(calcMessage));
+    for (size_t i = 0; i < count; i++) {
+        calcProtocol a = { MSG_TYPE_CALC_PROTOCOL, MAJOR_VERSION, MINOR_VERSION, (uint32_t)i, ops[i],
+                           v1[i], v2[i], calculate(ops[i], v1[i], v2[i]) };
+        encodeCalcProtocol(a, &assignments[i * sizeof(calcProtocol)]);
+        encodeCalcMessage(makeCalcMessage(i % 8 == 0 ? 2 : 1, PROTOCOL_UDP), &verdicts[i * sizeof(calcMessage)]);
+    }
+
+    bool ok = benchFrames<calcProtocol>("calcProtocol", assignments, count);
+    ok = benchFrames<calcMessage>("calcMessage", verdicts, count) && ok;
+    return ok;
+}
+
+// URL parsing as the client did it before url.cpp: a std::regex built and
+// matched per call
+static bool parseURLWithRegex(const std::string& url, URLInfo& info) {
+    std::regex url_regex(R"(^(TCP|UDP|ANY|tcp|udp|any)://([^:/]+):(\d+)/(TEXT|BINARY|text|binary)$)", std::regex_constants::icase);
+    std::smatch matches;
+    if (!std::regex_match(url, matches, url_regex)) {
+        return false;
+    }
+    info.protocol = matches[1].str();
+    info.host = matches[2].str();
+    info.port = std::stoi(matches[3].str());
+    info.api = matches[4].str();
+    return true;
+}
+
+// One call of parse in a process that has not parsed a URL yet: what a
+// short-lived client pays at startup. Only happens once, so one sample.
+template <typename Parse>
+static Measurement firstCallNs(Parse parse, const std::string& url) {
+    typedef std::chrono::steady_clock clock;
+    URLInfo info;
+    clock::time_point start = clock::now();
+    bench_sink = parse(url, info) ? info.port : 0;
+    return summarize(std::vector<double>(1, std::chrono::duration<double, std::nano>(clock::now() - start).count()));
+}
+
+static bool benchURLParser() {
+    const char* urls[] = { "tcp://alice.nplab.bth.se:5000/text", "UDP://127.0.0.1:5000/BINARY",
+                           "any://bob.nplab.bth.se:5000/binary", "tcp://localhost:65535/Text" };
+    const size_t count = sizeof(urls) / sizeof(urls[0]);
+    std::vector<std::string> lines(urls, urls + count);
+
+    // Run first, while both parsers are still cold
+    section("URL parsing, first call in the process", "");
+    Measurement regex_first = firstCallNs(parseURLWithRegex, lines[0]);
+    Measurement parser_first = firstCallNs(parseURL, lines[1]);
+    report("std::regex", regex_first, regex_first);
+    report("parseURL", parser_first, regex_first);
+
+    section("URL parsing", std::to_string(count) + " URLs per call");
+
+    // Both must agree on the fields
+    for (size_t i = 0; i < count; i++) {
+        URLInfo expected, actual;
+        if (!parseURLWithRegex(lines[i], expected) || !parseURL(lines[i], actual) ||
+            expected.protocol != actual.protocol || expected.host != actual.host ||
+            expected.port != actual.port || expected.api != actual.api) {
+            std::cout << "  parseURL: " << lines[i] << " differs from std::regex" << std::endl;
+            return false;
+        }
+    }
+
+    URLInfo info;
+    Measurement baseline = measure([&]() {
+        for (size_t i = 0; i < count; i++) {
+            bench_sink = parseURLWithRegex(lines[i], info) ? info.port : 0;
+        }
+    }, count);
+    report("std::regex", baseline, baseline);
+
+    Measurement ns = measure([&]() {
+        for (size_t i = 0; i < count; i++) {
+            bench_sink = parseURL(lines[i], info) ? info.port : 0;
+        }
+    }, count);
+    report("parseURL", ns, baseline);
+    return true;
+}
+
+// One line per session through an iostream flushed with std::endl, as the
+// sessions print them, against records collected in the per-thread
+// OutputBuffer. Both go to /dev/null.
+static bool benchOutput() {
+    const size_t count = 1024;
+    std::vector<uint32_t> ops(count);
+    std::vector<int32_t> v1(count);
+    std::vector<int32_t> v2(count);
+    makeAssignments(ops, v1, v2);
+    std::vector<std::string> targets(count);
+    for (size_t i = 0; i < count; i++) {
+        targets[i] = "tcp://10.0.0." + std::to_string(i % 256) + ":5000/text";
+    }
+
+    section("session output to /dev/null", std::to_string(count) + " sessions per call");
+
+    std::ofstream null_stream("/dev/null");
+    int null_fd = open("/dev/null", O_WRONLY);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (!null_stream || null_fd < 0 || saved_stdout < 0) {
+        std::cout << "  /dev/null not available" << std::endl;
+        return false;
+    }
+
+    Measurement baseline = measure([&]() {
+        for (size_t i = 0; i < count; i++) {
+            null_stream << "ASSIGNMENT: " << operation_to_string(ops[i]) << " " << v1[i] << " " << v2[i] << std::endl;
+            null_stream << "OK (myresult=" << calculate(ops[i], v1[i], v2[i]) << ")" << std::endl;
+        }
+    }, count);
+
+    dup2(null_fd, STDOUT_FILENO);
+    Measurement ns = measure([&]() {
+        for (size_t i = 0; i < count; i++) {
+            writeJobRecord(targets[i], "TCP", "OK", (double)v1[i] / 1000.0);
+        }
+    }, count);
+    flushOutput();
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(null_fd);
+
+    report("iostream + std::endl", baseline, baseline);
+    report("OutputBuffer JSONL", ns, baseline);
+    return true;
+}
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-r REPETITIONS] [-l LABEL] [-j RESULTS.json|-]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* json_path = nullptr;
+    std::string label;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            long value = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || value < 1 || value > 1000) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            bench_repetitions = (int)value;
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            label = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // JSON on stdout: the table goes to stderr
+    std::streambuf* stdout_buf = std::cout.rdbuf();
+    bool json_stdout = json_path != nullptr && strcmp(json_path, "-") == 0;
+    if (json_stdout) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    bool ok = benchURLParser();
+    ok = benchCalculate() && ok;
+    ok = benchOperationNames() && ok;
+    ok = benchTextParser() && ok;
+    ok = benchIntegers() && ok;
+    ok = benchBinaryCodec() && ok;
+    ok = benchOutput() && ok;
+
+    if (json_stdout) {
+        std::cout.rdbuf(stdout_buf);
+        writeJson(std::cout, label);
+    } else if (json_path != nullptr) {
+        std::ofstream out(json_path);
+        writeJson(out, label);
+        if (!out) {
+            std::cerr << "ERROR: Failed to write " << json_path << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
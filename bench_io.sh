@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Compare the epoll and io_uring load generator backends against one server.
+# Requires a client built with io_uring support: make IO_URING=raw
+#
+# Usage: ./bench_io.sh URL [SESSIONS] [CONCURRENCY] [RUNS]
+
+URL=${1:?Usage: $0 URL [SESSIONS] [CONCURRENCY] [RUNS]}
+SESSIONS=${2:-20000}
+CONCURRENCY=${3:-64}
+RUNS=${4:-3}
+
+echo "Benchmarking $URL: $SESSIONS sessions, concurrency $CONCURRENCY, $RUNS runs per backend"
+
+for backend in epoll uring; do
+    for run in $(seq 1 "$RUNS"); do
+        rate=$(./client -n "$SESSIONS" -c "$CONCURRENCY" -b "$backend" "$URL" | sed -n 's/.* s, \(.*\) sessions\/sec/\1/p')
+        if [ -z "$rate" ]; then
+            echo "✗ $backend run $run failed"
+            exit 1
+        fi
+        echo "$backend run $run: $rate sessions/sec"
+    done
+done
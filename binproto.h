@@ -0,0 +1,173 @@
+#ifndef BINPROTO_H
+#define BINPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstring>
+#include <string>
+
+#include "protocol.h"
+
+// Header-only codec for the BINARY protocol frames. Frames are decoded from
+// and encoded into network buffers directly, so there is no alignment
+// requirement, no in-place swapping and no call per field: every load and
+// store compiles to a single bswap/movbe. The structs from protocol.h hold the
+// decoded values in host byte order.
+//
+// Decoding is constexpr, so frames can be checked at compile time.
+
+static_assert(sizeof(calcMessage) == 10, "calcMessage is 10 bytes on the wire");
+static_assert(sizeof(calcProtocol) == 26, "calcProtocol is 26 bytes on the wire");
+static_assert(sizeof(calcVerdict) == 8, "calcVerdict is 8 bytes on the wire");
+
+constexpr uint16_t loadBE16(const char* p) {
+    return (uint16_t)((uint8_t)p[0] << 8 | (uint8_t)p[1]);
+}
+
+constexpr uint32_t loadBE32(const char* p) {
+    return (uint32_t)(uint8_t)p[0] << 24 | (uint32_t)(uint8_t)p[1] << 16 |
+           (uint32_t)(uint8_t)p[2] << 8 | (uint32_t)(uint8_t)p[3];
+}
+
+// Stores go through one swapped word where the compiler can do it: byte by
+// byte stores of whole frames are not merged well (GCC 12 assembles them in
+// registers with dozens of shifts)
+inline void storeBE16(char* p, uint16_t value) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap16(value);
+    memcpy(p, &value, sizeof(value));
+#else
+    p[0] = (char)(value >> 8);
+    p[1] = (char)value;
+#endif
+}
+
+inline void storeBE32(char* p, uint32_t value) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap32(value);
+    memcpy(p, &value, sizeof(value));
+#else
+    p[0] = (char)(value >> 24);
+    p[1] = (char)(value >> 16);
+    p[2] = (char)(value >> 8);
+    p[3] = (char)value;
+#endif
+}
+
+// Message type of any frame (the first field of all of them)
+constexpr uint16_t frameType(const char* wire) {
+    return loadBE16(wire);
+}
+
+// ---------------------------------------------------------------------------
+// calcMessage
+
+// A calcMessage from this protocol version
+constexpr calcMessage makeCalcMessage(uint16_t message, uint16_t protocol) {
+    return calcMessage{ MSG_TYPE_CALC_MESSAGE, message, protocol, MAJOR_VERSION, MINOR_VERSION };
+}
+
+constexpr calcMessage decodeCalcMessage(const char* wire) {
+    return calcMessage{ loadBE16(wire), loadBE16(wire + 2), loadBE16(wire + 4),
+                        loadBE16(wire + 6), loadBE16(wire + 8) };
+}
+
+inline void encodeCalcMessage(const calcMessage& msg, char* wire) {
+    storeBE16(wire, msg.type);
+    storeBE16(wire + 2, msg.message);
+    storeBE16(wire + 4, msg.protocol);
+    storeBE16(wire + 6, msg.major_version);
+    storeBE16(wire + 8, msg.minor_version);
+}
+
+// ---------------------------------------------------------------------------
+// calcProtocol
+
+constexpr calcProtocol decodeCalcProtocol(const char* wire) {
+    return calcProtocol{ loadBE16(wire), loadBE16(wire + 2), loadBE16(wire + 4),
+                         loadBE32(wire + 6), loadBE32(wire + 10), (int32_t)loadBE32(wire + 14),
+                         (int32_t)loadBE32(wire + 18), (int32_t)loadBE32(wire + 22) };
+}
+
+inline void encodeCalcProtocol(const calcProtocol& msg, char* wire) {
+    storeBE16(wire, msg.type);
+    storeBE16(wire + 2, msg.major_version);
+    storeBE16(wire + 4, msg.minor_version);
+    storeBE32(wire + 6, msg.id);
+    storeBE32(wire + 10, msg.arith);
+    storeBE32(wire + 14, (uint32_t)msg.inValue1);
+    storeBE32(wire + 18, (uint32_t)msg.inValue2);
+    storeBE32(wire + 22, (uint32_t)msg.inResult);
+}
+
+// Single fields, without decoding the whole frame
+constexpr uint32_t calcProtocolId(const char* wire) {
+    return loadBE32(wire + 6);
+}
+
+constexpr int32_t calcProtocolResult(const char* wire) {
+    return (int32_t)loadBE32(wire + 22);
+}
+
+// ---------------------------------------------------------------------------
+// calcVerdict (PIPELINE extension)
+
+constexpr calcVerdict decodeCalcVerdict(const char* wire) {
+    return calcVerdict{ loadBE16(wire), loadBE16(wire + 2), loadBE32(wire + 4) };
+}
+
+inline void encodeCalcVerdict(const calcVerdict& msg, char* wire) {
+    storeBE16(wire, msg.type);
+    storeBE16(wire + 2, msg.message);
+    storeBE32(wire + 4, msg.id);
+}
+
+// ---------------------------------------------------------------------------
+// Batches of back-to-back frames, e.g. a whole receive buffer of assignments
+
+inline void decodeCalcMessages(const char* wire, calcMessage* msgs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        msgs[i] = decodeCalcMessage(wire + i * sizeof(calcMessage));
+    }
+}
+
+inline void encodeCalcMessages(const calcMessage* msgs, size_t count, char* wire) {
+    for (size_t i = 0; i < count; i++) {
+        encodeCalcMessage(msgs[i], wire + i * sizeof(calcMessage));
+    }
+}
+
+inline void decodeCalcProtocols(const char* wire, calcProtocol* msgs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        msgs[i] = decodeCalcProtocol(wire + i * sizeof(calcProtocol));
+    }
+}
+
+inline void encodeCalcProtocols(const calcProtocol* msgs, size_t count, char* wire) {
+    for (size_t i = 0; i < count; i++) {
+        encodeCalcProtocol(msgs[i], wire + i * sizeof(calcProtocol));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Appending to an output buffer
+
+inline void appendCalcMessage(std::string& out, const calcMessage& msg) {
+    size_t at = out.size();
+    out.resize(at + sizeof(calcMessage));
+    encodeCalcMessage(msg, &out[at]);
+}
+
+inline void appendCalcProtocol(std::string& out, const calcProtocol& msg) {
+    size_t at = out.size();
+    out.resize(at + sizeof(calcProtocol));
+    encodeCalcProtocol(msg, &out[at]);
+}
+
+inline void appendCalcVerdict(std::string& out, const calcVerdict& msg) {
+    size_t at = out.size();
+    out.resize(at + sizeof(calcVerdict));
+    encodeCalcVerdict(msg, &out[at]);
+}
+
+#endif // BINPROTO_H
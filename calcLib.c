@@ -8,18 +8,28 @@
     #include <strings.h>
 #endif
 
+// SIMD kernels for calculate_batch, selected at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define CALC_HAVE_X86_KERNELS
+    #include <immintrin.h>
+#endif
+
 int32_t calculate(uint32_t operation, int32_t value1, int32_t value2) {
     switch (operation) {
+        // Unsigned arithmetic wraps instead of overflowing, like calculate_batch()
         case ARITH_ADD:
-            return value1 + value2;
+            return (int32_t)((uint32_t)value1 + (uint32_t)value2);
         case ARITH_SUB:
-            return value1 - value2;
+            return (int32_t)((uint32_t)value1 - (uint32_t)value2);
         case ARITH_MUL:
-            return value1 * value2;
+            return (int32_t)((uint32_t)value1 * (uint32_t)value2);
         case ARITH_DIV:
             if (value2 == 0) {
                 return 0; // Handle division by zero
             }
+            if (value1 == INT32_MIN && value2 == -1) {
+                return INT32_MIN; // The one quotient that does not fit
+            }
             return value1 / value2; // Integer division (truncated)
         default:
             return 0;
@@ -53,3 +63,170 @@ const char* operation_to_string(uint32_t operation) {
             return "unknown";
     }
 }
+
+// ---------------------------------------------------------------------------
+// Batch calculation
+//
+// Every kernel computes all four operations for each lane and keeps the one
+// selected by ops[i], so there are no per-element branches. SIMD division goes
+// through double precision: for 32-bit operands the rounded quotient never
+// crosses an integer, so truncating it gives the exact C result. A zero divisor
+// is replaced by 1 and the lane masked to 0 afterwards.
+
+static void calculate_batch_scalar(const uint32_t* ops, const int32_t* v1, const int32_t* v2,
+                                   int32_t* out, size_t n) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        uint32_t a = (uint32_t)v1[i];
+        uint32_t b = (uint32_t)v2[i];
+        int32_t divisor = v2[i] != 0 ? v2[i] : 1;
+        int32_t quotient = (v1[i] == INT32_MIN && divisor == -1) ? INT32_MIN : v1[i] / divisor;
+        uint32_t op = ops[i];
+
+        // Unsigned arithmetic wraps instead of overflowing
+        uint32_t result = ((uint32_t)-(op == ARITH_ADD) & (a + b)) |
+                          ((uint32_t)-(op == ARITH_SUB) & (a - b)) |
+                          ((uint32_t)-(op == ARITH_MUL) & (a * b)) |
+                          ((uint32_t)-(op == ARITH_DIV && v2[i] != 0) & (uint32_t)quotient);
+        out[i] = (int32_t)result;
+    }
+}
+
+#ifdef CALC_HAVE_X86_KERNELS
+
+// SSE2 has no 32-bit multiply-low; multiply even and odd lanes separately
+__attribute__((target("sse2")))
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__attribute__((target("sse2")))
+static void calculate_batch_sse2(const uint32_t* ops, const int32_t* v1, const int32_t* v2,
+                                 int32_t* out, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i op_add = _mm_set1_epi32(ARITH_ADD);
+    const __m128i op_sub = _mm_set1_epi32(ARITH_SUB);
+    const __m128i op_mul = _mm_set1_epi32(ARITH_MUL);
+    const __m128i op_div = _mm_set1_epi32(ARITH_DIV);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i op = _mm_loadu_si128((const __m128i*)(ops + i));
+        __m128i a = _mm_loadu_si128((const __m128i*)(v1 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(v2 + i));
+
+        __m128i b_zero = _mm_cmpeq_epi32(b, zero);
+        __m128i divisor = _mm_or_si128(_mm_andnot_si128(b_zero, b), _mm_and_si128(b_zero, one));
+        __m128d q_lo = _mm_div_pd(_mm_cvtepi32_pd(a), _mm_cvtepi32_pd(divisor));
+        __m128d q_hi = _mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2))),
+                                  _mm_cvtepi32_pd(_mm_shuffle_epi32(divisor, _MM_SHUFFLE(1, 0, 3, 2))));
+        __m128i quotient = _mm_unpacklo_epi64(_mm_cvttpd_epi32(q_lo), _mm_cvttpd_epi32(q_hi));
+        quotient = _mm_andnot_si128(b_zero, quotient);
+
+        __m128i result = _mm_and_si128(_mm_cmpeq_epi32(op, op_add), _mm_add_epi32(a, b));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(op, op_sub), _mm_sub_epi32(a, b)));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(op, op_mul), mullo_epi32_sse2(a, b)));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(op, op_div), quotient));
+        _mm_storeu_si128((__m128i*)(out + i), result);
+    }
+
+    calculate_batch_scalar(ops + i, v1 + i, v2 + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void calculate_batch_avx2(const uint32_t* ops, const int32_t* v1, const int32_t* v2,
+                                 int32_t* out, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i op_add = _mm256_set1_epi32(ARITH_ADD);
+    const __m256i op_sub = _mm256_set1_epi32(ARITH_SUB);
+    const __m256i op_mul = _mm256_set1_epi32(ARITH_MUL);
+    const __m256i op_div = _mm256_set1_epi32(ARITH_DIV);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i op = _mm256_loadu_si256((const __m256i*)(ops + i));
+        __m256i a = _mm256_loadu_si256((const __m256i*)(v1 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(v2 + i));
+
+        __m256i b_zero = _mm256_cmpeq_epi32(b, zero);
+        __m256i divisor = _mm256_blendv_epi8(b, one, b_zero);
+        __m256d q_lo = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(a)),
+                                     _mm256_cvtepi32_pd(_mm256_castsi256_si128(divisor)));
+        __m256d q_hi = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(a, 1)),
+                                     _mm256_cvtepi32_pd(_mm256_extracti128_si256(divisor, 1)));
+        __m256i quotient = _mm256_set_m128i(_mm256_cvttpd_epi32(q_hi), _mm256_cvttpd_epi32(q_lo));
+        quotient = _mm256_andnot_si256(b_zero, quotient);
+
+        __m256i result = _mm256_and_si256(_mm256_cmpeq_epi32(op, op_add), _mm256_add_epi32(a, b));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_cmpeq_epi32(op, op_sub), _mm256_sub_epi32(a, b)));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_cmpeq_epi32(op, op_mul), _mm256_mullo_epi32(a, b)));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_cmpeq_epi32(op, op_div), quotient));
+        _mm256_storeu_si256((__m256i*)(out + i), result);
+    }
+
+    calculate_batch_scalar(ops + i, v1 + i, v2 + i, out + i, n - i);
+}
+
+#endif // CALC_HAVE_X86_KERNELS
+
+calc_kernel calculate_batch_best_kernel(void) {
+#ifdef CALC_HAVE_X86_KERNELS
+    if (__builtin_cpu_supports("avx2")) {
+        return CALC_KERNEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return CALC_KERNEL_SSE2;
+    }
+#endif
+    return CALC_KERNEL_SCALAR;
+}
+
+const char* calculate_batch_kernel_name(calc_kernel kernel) {
+    switch (kernel) {
+        case CALC_KERNEL_SSE2:
+            return "sse2";
+        case CALC_KERNEL_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+void calculate_batch_kernel(calc_kernel kernel, const uint32_t* ops, const int32_t* v1, const int32_t* v2,
+                            int32_t* out, size_t n) {
+    switch (kernel) {
+#ifdef CALC_HAVE_X86_KERNELS
+        case CALC_KERNEL_AVX2:
+            calculate_batch_avx2(ops, v1, v2, out, n);
+            return;
+        case CALC_KERNEL_SSE2:
+            calculate_batch_sse2(ops, v1, v2, out, n);
+            return;
+#endif
+        default:
+            calculate_batch_scalar(ops, v1, v2, out, n);
+            return;
+    }
+}
+
+void calculate_batch(const uint32_t* ops, const int32_t* v1, const int32_t* v2, int32_t* out, size_t n) {
+#ifdef CALC_HAVE_X86_KERNELS
+    // Resolved on first use. Server workers call this concurrently, so the
+    // cached choice is only touched through atomics (relaxed: every thread
+    // that resolves it stores the same value).
+    static int best = -1;
+    int kernel = __atomic_load_n(&best, __ATOMIC_RELAXED);
+    if (kernel < 0) {
+        kernel = (int)calculate_batch_best_kernel();
+        __atomic_store_n(&best, kernel, __ATOMIC_RELAXED);
+    }
+    calculate_batch_kernel((calc_kernel)kernel, ops, v1, v2, out, n);
+#else
+    calculate_batch_scalar(ops, v1, v2, out, n);
+#endif
+}
@@ -2,8 +2,14 @@
 #define CALCLIB_H
 
 #include <stdint.h>
+#include <stddef.h>
 
-// Function to perform arithmetic operations
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function to perform arithmetic operations. Overflow wraps around
+// (INT32_MIN / -1 gives INT32_MIN) and division by zero gives 0.
 int32_t calculate(uint32_t operation, int32_t value1, int32_t value2);
 
 // Function to convert operation string to operation code
@@ -12,4 +18,28 @@ uint32_t string_to_operation(const char* op_str);
 // Function to convert operation code to string
 const char* operation_to_string(uint32_t operation);
 
+// Calculate out[i] = calculate(ops[i], v1[i], v2[i]) for n assignments. Uses
+// the widest SIMD kernel the CPU supports; the results match calculate().
+void calculate_batch(const uint32_t* ops, const int32_t* v1, const int32_t* v2, int32_t* out, size_t n);
+
+// Kernels behind calculate_batch, exposed for benchmarks and tests
+typedef enum {
+    CALC_KERNEL_SCALAR,
+    CALC_KERNEL_SSE2,
+    CALC_KERNEL_AVX2
+} calc_kernel;
+
+// Widest kernel usable on this CPU
+calc_kernel calculate_batch_best_kernel(void);
+
+const char* calculate_batch_kernel_name(calc_kernel kernel);
+
+// Run a specific kernel; it must not be wider than calculate_batch_best_kernel()
+void calculate_batch_kernel(calc_kernel kernel, const uint32_t* ops, const int32_t* v1, const int32_t* v2,
+                            int32_t* out, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // CALCLIB_H
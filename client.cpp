@@ -0,0 +1,248 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+
+#include "client.h"
+#include "asyncsession.h"
+#include "resolver.h"
+#include "stats.h"
+
+// Set by the load generator so that thousands of sessions do not flood the terminal
+bool quiet_mode = false;
+
+// Run one session of the given transport on a private event loop
+static bool runOnLoop(const URLInfo& info, bool tcp, bool text, bool& connect_failed) {
+    EventLoop loop;
+    AsyncSession session(loop, createSession(tcp, text));
+
+    bool started = tcp ? session.startTCP(info.host, info.port) : session.startUDP(info.host, info.port);
+    while (started && !session.done()) {
+        loop.runOnce();
+    }
+
+    connect_failed = session.connectFailed();
+    return session.ok();
+}
+
+// ANY mode: UDP and TCP attempts on one event loop. The first to receive
+// anything from the server wins; the session then runs to completion on it.
+class AnyRace : public TimerHandler {
+public:
+    AnyRace(const URLInfo& info, bool text, int udp_head_start_ms, RaceReport& report)
+        : info_(info), text_(text), head_start_ms_(udp_head_start_ms), report_(report),
+          udp_(nullptr), tcp_(nullptr), winner_(nullptr), timer_(this),
+          begin_(std::chrono::steady_clock::now()) {
+        TransportAttempt idle = { ATTEMPT_NOT_STARTED, 0.0, 0.0 };
+        report_.udp = idle;
+        report_.tcp = idle;
+    }
+
+    ~AnyRace() {
+        loop_.cancelTimer(&timer_);
+        delete udp_;
+        delete tcp_;
+    }
+
+    bool run(std::string& used_protocol, bool& connect_failed) {
+        udp_ = start(false, report_.udp);
+        if (report_.udp.outcome == ATTEMPT_FAILED || head_start_ms_ == 0) {
+            startTCP();
+        } else {
+            loop_.addTimer(&timer_, (uint64_t)head_start_ms_);
+        }
+
+        while (winner_ == nullptr && racing()) {
+            loop_.runOnce();
+            settle(udp_, report_.udp);
+            settle(tcp_, report_.tcp);
+            // A failed UDP attempt forfeits the rest of its head start
+            if (report_.udp.outcome == ATTEMPT_FAILED && report_.tcp.outcome == ATTEMPT_NOT_STARTED) {
+                loop_.cancelTimer(&timer_);
+                startTCP();
+            }
+        }
+
+        if (winner_ == nullptr) {
+            used_protocol = "TCP";
+            connect_failed = tcp_ != nullptr && tcp_->connectFailed();
+            return false;
+        }
+
+        // Cancel the loser before it prints anything
+        loop_.cancelTimer(&timer_);
+        cancel(winner_ == udp_ ? tcp_ : udp_, winner_ == udp_ ? report_.tcp : report_.udp);
+
+        while (!winner_->done()) {
+            loop_.runOnce();
+        }
+        used_protocol = winner_ == udp_ ? "UDP" : "TCP";
+        connect_failed = false;
+        return winner_->ok();
+    }
+
+    void onTimer() override { startTCP(); }
+
+private:
+    double elapsedMs() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin_).count();
+    }
+
+    AsyncSession* start(bool tcp, TransportAttempt& attempt) {
+        AsyncSession* session = new AsyncSession(loop_, createSession(tcp, text_));
+        attempt.start_ms = elapsedMs();
+        attempt.outcome = ATTEMPT_RUNNING;
+        if (!(tcp ? session->startTCP(info_.host, info_.port) : session->startUDP(info_.host, info_.port))) {
+            attempt.outcome = ATTEMPT_FAILED;
+            attempt.end_ms = attempt.start_ms;
+        }
+        return session;
+    }
+
+    void startTCP() {
+        if (tcp_ == nullptr) {
+            tcp_ = start(true, report_.tcp);
+        }
+    }
+
+    bool racing() const {
+        return report_.udp.outcome == ATTEMPT_RUNNING || report_.tcp.outcome == ATTEMPT_RUNNING ||
+               report_.tcp.outcome == ATTEMPT_NOT_STARTED;
+    }
+
+    void settle(AsyncSession* session, TransportAttempt& attempt) {
+        if (attempt.outcome != ATTEMPT_RUNNING || winner_ != nullptr) {
+            return;
+        }
+        if (session->done() && !session->ok()) {
+            attempt.outcome = ATTEMPT_FAILED;
+            attempt.end_ms = elapsedMs();
+        } else if (session->responded()) {
+            attempt.outcome = ATTEMPT_WON;
+            attempt.end_ms = elapsedMs();
+            winner_ = session;
+        }
+    }
+
+    void cancel(AsyncSession*& session, TransportAttempt& attempt) {
+        if (attempt.outcome != ATTEMPT_RUNNING) {
+            return;
+        }
+        attempt.outcome = ATTEMPT_CANCELLED;
+        attempt.end_ms = elapsedMs();
+        delete session;
+        session = nullptr;
+    }
+
+    EventLoop loop_;
+    const URLInfo& info_;
+    bool text_;
+    int head_start_ms_;
+    RaceReport& report_;
+    AsyncSession* udp_;
+    AsyncSession* tcp_;
+    AsyncSession* winner_;
+    Timer timer_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+bool runSession(const URLInfo& info, std::string& used_protocol, bool& connect_failed,
+                int udp_head_start_ms, RaceReport* race) {
+    connect_failed = false;
+
+    if (info.transport == URL_ANY) {
+        RaceReport report;
+        AnyRace any(info, info.text, udp_head_start_ms, race != nullptr ? *race : report);
+        return any.run(used_protocol, connect_failed);
+    }
+
+    bool tcp = info.transport == URL_TCP;
+    used_protocol = tcp ? "TCP" : "UDP";
+    return runOnLoop(info, tcp, info.text, connect_failed);
+}
+
+bool setNonBlocking(int sockfd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sockfd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    return flags >= 0 && fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool socketWouldBlock() {
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+bool resolveHost(const std::string& host, int port, struct sockaddr_storage& addr, socklen_t& addr_len) {
+    if (!ResolverCache::instance().resolve(host, port, AF_UNSPEC, addr, addr_len)) {
+        printError("RESOLVE ISSUE");
+        return false;
+    }
+    return true;
+}
+
+bool resolveHostAll(const std::string& host, int port, std::vector<SocketAddress>& addresses) {
+    if (!ResolverCache::instance().resolveAll(host, port, addresses)) {
+        printError("RESOLVE ISSUE");
+        return false;
+    }
+    return true;
+}
+
+int connectTCP(const SocketAddress& address) {
+    int sockfd = socket(address.addr.ss_family, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        return -1;
+    }
+    
+    // Connection completes in the background; the event loop reports it as writability
+    if (!setNonBlocking(sockfd) ||
+        (connect(sockfd, (const struct sockaddr*)&address.addr, address.len) < 0 && !socketWouldBlock())) {
+        close(sockfd);
+        return -1;
+    }
+    
+    return sockfd;
+}
+
+int createUDPSocket(const std::string& host, int port, SocketAddress& server_addr) {
+    std::vector<SocketAddress> addresses;
+    if (!resolveHostAll(host, port, addresses)) {
+        return -1;
+    }
+
+    // Connecting a UDP socket sends nothing, but fails right away for an address
+    // family or network this host has no route to; it also makes the kernel
+    // drop datagrams from anyone but the server
+    for (size_t i = 0; i < addresses.size(); i++) {
+        int sockfd = socket(addresses[i].addr.ss_family, SOCK_DGRAM, 0);
+        if (sockfd < 0) {
+            continue;
+        }
+        if (!setNonBlocking(sockfd) ||
+            connect(sockfd, (const struct sockaddr*)&addresses[i].addr, addresses[i].len) < 0) {
+            close(sockfd);
+            continue;
+        }
+        server_addr = addresses[i];
+        return sockfd;
+    }
+    return -1;
+}
+
+void printError(const std::string& message) {
+    statsCountError(message);
+    if (quiet_mode) {
+        return;
+    }
+    std::cerr << "ERROR: " << message << std::endl;
+}
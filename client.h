@@ -0,0 +1,99 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+    #define close closesocket
+    typedef int socklen_t;
+    typedef int ssize_t;
+#else
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <unistd.h>
+    #include <sys/time.h>
+    #include <errno.h>
+    #include <fcntl.h>
+#endif
+
+#include "protocol.h"
+#include "url.h"
+
+// Debug macro - can be enabled with -DDEBUG during compilation
+#ifdef DEBUG
+    #define DEBUG_PRINT(x) std::cout << x << std::endl
+#else
+    #define DEBUG_PRINT(x)
+#endif
+
+// A resolved socket address and its length
+struct SocketAddress {
+    struct sockaddr_storage addr;
+    socklen_t len;
+};
+
+// When set, per-session ASSIGNMENT/OK/ERROR lines and error messages are suppressed
+extern bool quiet_mode;
+
+// Function prototypes
+bool setNonBlocking(int sockfd);
+bool socketWouldBlock();
+
+// Resolve host to its first address through the ResolverCache
+bool resolveHost(const std::string& host, int port, struct sockaddr_storage& addr, socklen_t& addr_len);
+
+// Resolve host (cached) to all of its addresses in the order they should be tried
+bool resolveHostAll(const std::string& host, int port, std::vector<SocketAddress>& addresses);
+
+// Start a non-blocking connect to one address. The returned socket becomes
+// writable once the connection attempt has finished; -1 if it failed right away.
+int connectTCP(const SocketAddress& address);
+
+// Resolve host (cached) and create a non-blocking UDP socket connected to the
+// first address that is routable, trying IPv6 and IPv4 addresses in turn
+int createUDPSocket(const std::string& host, int port, SocketAddress& server_addr);
+
+void printError(const std::string& message);
+
+// Head start UDP gets over TCP in ANY mode unless overridden (-a)
+#define ANY_UDP_HEAD_START_MS 250
+
+// How one transport fared in an ANY-mode race
+enum AttemptOutcome {
+    ATTEMPT_NOT_STARTED,
+    ATTEMPT_RUNNING,    // Only seen while the race is on
+    ATTEMPT_WON,        // First to hear from the server
+    ATTEMPT_FAILED,     // Gave up before the server answered
+    ATTEMPT_CANCELLED   // The other transport won first
+};
+
+struct TransportAttempt {
+    AttemptOutcome outcome;
+    double start_ms;    // Since the race began
+    double end_ms;      // When it won, failed or was cancelled
+};
+
+struct RaceReport {
+    TransportAttempt udp;
+    TransportAttempt tcp;
+};
+
+// Run one complete session (connect, negotiate, one assignment) for the given URL.
+// In ANY mode UDP and TCP race: UDP starts first, TCP after udp_head_start_ms
+// or as soon as UDP fails. The first transport to hear from the server carries
+// the session and the other attempt is cancelled; race (if given) records how
+// each fared. On success the transport that was used ("TCP" or "UDP") is stored
+// in used_protocol.
+// Returns false if the connection could not be set up or the server rejected the result;
+// connect_failed is set when no session could be started at all.
+bool runSession(const URLInfo& info, std::string& used_protocol, bool& connect_failed,
+                int udp_head_start_ms = ANY_UDP_HEAD_START_MS, RaceReport* race = nullptr);
+
+#endif // CLIENT_H
@@ -2,60 +2,78 @@
 #include <string>
 #include <cstring>
 #include <cstdlib>
-#include <regex>
-#include <algorithm>
-#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <fcntl.h>
 
-#ifdef _WIN32
-    #include <winsock2.h>
-    #include <ws2tcpip.h>
-    #pragma comment(lib, "ws2_32.lib")
-    #define close closesocket
-    typedef int socklen_t;
-    typedef int ssize_t;
-#else
-    #include <sys/socket.h>
-    #include <netinet/in.h>
-    #include <arpa/inet.h>
-    #include <netdb.h>
-    #include <unistd.h>
-    #include <sys/time.h>
-    #include <errno.h>
-#endif
+#include "client.h"
+#include "loadgen.h"
+#include "batch.h"
+#include "uring.h"
+#include "timing.h"
+#include "output.h"
+#include "stats.h"
+#include "metrics.h"
 
-#include "protocol.h"
-#include "calcLib.h"
-
-// Debug macro - can be enabled with -DDEBUG during compilation
 // UPDATED: 2025-09-09 14:27 - Latest version with robust TCP handling
-#ifdef DEBUG
-    #define DEBUG_PRINT(x) std::cout << x << std::endl
-#else
-    #define DEBUG_PRINT(x)
-#endif
 
-// Structure to hold parsed URL information
-struct URLInfo {
-    std::string protocol;  // TCP, UDP, or ANY
-    std::string host;
-    int port;
-    std::string api;       // text or binary
-};
+// Serves -M; stopped at exit before the counters it reads are unmapped
+static MetricsServer* metrics_server = nullptr;
+
+static void stopMetricsServer() {
+    delete metrics_server;
+    metrics_server = nullptr;
+}
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-a HEAD_START_MS] [-t] [-j TIMINGS.json] [-o text|jsonl|binary] [-s STATS_FILE] [-M [HOST:]PORT] [-n SESSIONS [-c CONCURRENCY] [-b epoll|uring|mmsg] [-m PER_SOCKET] [-k] [-p DEPTH] [-w WORKERS]] PROTOCOL://server:port/api" << std::endl;
+    std::cerr << "       " << prog << " [-t] [-j TIMINGS.json] [-o text|jsonl] [-s STATS_FILE] [-M [HOST:]PORT] [-c CONCURRENCY] -f JOBS|-" << std::endl;
+}
 
-// Function prototypes
-bool parseURL(const std::string& url, URLInfo& info);
-int connectTCP(const std::string& host, int port);
-int createUDPSocket(const std::string& host, int port, struct sockaddr_in& server_addr);
-bool handleTCPText(int sockfd, const std::string& host, int port);
-bool handleTCPBinary(int sockfd, const std::string& host, int port);
-bool handleUDPText(int sockfd, const struct sockaddr_in& server_addr, const std::string& host, int port);
-bool handleUDPBinary(int sockfd, const struct sockaddr_in& server_addr, const std::string& host, int port);
-void printError(const std::string& message);
-std::string toLowerCase(const std::string& str);
-uint16_t hton16(uint16_t value);
-uint32_t hton32(uint32_t value);
-uint16_t ntoh16(uint16_t value);
-uint32_t ntoh32(uint32_t value);
+// Parse an integer option value of at least min (strictly positive by default)
+static bool parseCount(const char* str, int& value, int min = 1) {
+    char* end = nullptr;
+    long parsed = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || parsed < min || parsed > 100000000) {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+// e.g. "TCP cancelled after 1.2 ms (started at 250.0 ms)"
+static void printAttempt(const char* name, const TransportAttempt& attempt) {
+    std::cout << name;
+    switch (attempt.outcome) {
+        case ATTEMPT_NOT_STARTED: std::cout << " not started"; return;
+        case ATTEMPT_WON:         std::cout << " won"; break;
+        case ATTEMPT_CANCELLED:   std::cout << " cancelled"; break;
+        default:                  std::cout << " failed"; break;
+    }
+    std::cout << std::fixed << std::setprecision(1) << " after " << attempt.end_ms - attempt.start_ms
+              << " ms (started at " << attempt.start_ms << " ms)";
+}
+
+// Print the phase latency table (-t) and/or write it as JSON (-j, "-" for stdout)
+static bool reportTimings(const TimingReport& timings, bool print, const char* json_path) {
+    if (print) {
+        timings.print(std::cout);
+    }
+    if (json_path == nullptr) {
+        return true;
+    }
+    if (strcmp(json_path, "-") == 0) {
+        timings.printJson(std::cout);
+        return true;
+    }
+    std::ofstream out(json_path);
+    timings.printJson(out);
+    if (!out) {
+        printError(std::string("Failed to write ") + json_path);
+        return false;
+    }
+    return true;
+}
 
 int main(int argc, char* argv[]) {
 #ifdef _WIN32
@@ -66,735 +84,201 @@ int main(int argc, char* argv[]) {
     }
 #endif
 
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " PROTOCOL://server:port/api" << std::endl;
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return EXIT_FAILURE;
+    const char* url = nullptr;
+    bool load_mode = false;
+    LoadOptions load_opts;
+    load_opts.sessions = 1;
+    load_opts.concurrency = 1;
+    load_opts.backend = IO_BACKEND_EPOLL;
+    load_opts.udp_sessions_per_socket = 32;
+    load_opts.persistent = false;
+    load_opts.pipeline_depth = 0;
+    load_opts.workers = 0;
+    int udp_head_start_ms = ANY_UDP_HEAD_START_MS;
+    bool print_timings = false;
+    const char* timings_path = nullptr;
+    const char* jobs_path = nullptr;
+    const char* stats_path = nullptr;
+    const char* metrics_address = nullptr;
+    bool load_only = false;     // An option batch mode does not take
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-m") == 0 ||
+             strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "-w") == 0) && i + 1 < argc) {
+            int& target = (argv[i][1] == 'n') ? load_opts.sessions
+                        : (argv[i][1] == 'c') ? load_opts.concurrency
+                        : (argv[i][1] == 'p') ? load_opts.pipeline_depth
+                        : (argv[i][1] == 'w') ? load_opts.workers : load_opts.udp_sessions_per_socket;
+            if (!parseCount(argv[i + 1], target)) {
+                printError(std::string("Invalid value for ") + argv[i]);
+                return EXIT_FAILURE;
+            }
+            load_mode = true;
+            load_only = load_only || argv[i][1] != 'c';
+            i++;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            if (!parseCount(argv[i + 1], udp_head_start_ms, 0)) {
+                printError("Invalid value for -a");
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "uring") == 0) {
+                if (!uringCompiledIn()) {
+                    printError("io_uring support not compiled in (build with IO_URING=raw or IO_URING=liburing)");
+                    return EXIT_FAILURE;
+                }
+                load_opts.backend = IO_BACKEND_URING;
+            } else if (strcmp(argv[i + 1], "mmsg") == 0) {
+                load_opts.backend = IO_BACKEND_MMSG;
+            } else if (strcmp(argv[i + 1], "epoll") != 0) {
+                printError(std::string("Unknown backend ") + argv[i + 1]);
+                return EXIT_FAILURE;
+            }
+            load_only = true;
+            i++;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            load_opts.persistent = true;
+            load_only = true;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            print_timings = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            timings_path = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            jobs_path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+            metrics_address = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            if (strcmp(argv[i + 1], "jsonl") == 0) {
+                output_format = OUTPUT_JSONL;
+            } else if (strcmp(argv[i + 1], "binary") == 0) {
+                output_format = OUTPUT_BINARY;
+            } else if (strcmp(argv[i + 1], "text") != 0) {
+                printError(std::string("Unknown output format ") + argv[i + 1]);
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (url == nullptr && argv[i][0] != '-') {
+            url = argv[i];
+        } else {
+            url = nullptr;
+            break;
+        }
     }
 
-    URLInfo url_info;
-    if (!parseURL(argv[1], url_info)) {
-        printError("Invalid URL format");
+    if ((load_opts.persistent || load_opts.pipeline_depth > 0) && load_opts.backend == IO_BACKEND_URING) {
+        printError("-k and -p are not supported with -b uring");
         return EXIT_FAILURE;
     }
 
-    bool success = false;
-    std::string successful_protocol;
+    // Structured output owns stdout: the records go there, while the
+    // human-readable lines are suppressed or, for summaries, sent to stderr
+    if (output_format != OUTPUT_TEXT) {
+        quiet_mode = true;
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
 
-    // Handle different protocol combinations
-    if (toLowerCase(url_info.protocol) == "tcp") {
-        std::cout << "Host " << url_info.host << ", and port " << url_info.port << "." << std::endl;
-        int sockfd = connectTCP(url_info.host, url_info.port);
-        if (sockfd < 0) {
-            printError("CANT CONNECT TO " + url_info.host);
-#ifdef _WIN32
-            WSACleanup();
-#endif
+    // Live counters for clientstat and/or the metrics endpoint; the file is
+    // marked finished however main returns
+    if (stats_path != nullptr || metrics_address != nullptr) {
+        if (stats_path != nullptr ? !openStatsFile(stats_path) : !openStatsMemory()) {
+            printError(std::string("Failed to set up ") + (stats_path != nullptr ? stats_path : "the counters"));
             return EXIT_FAILURE;
         }
-
-        DEBUG_PRINT("Connected to  " << url_info.host << ":" << url_info.port);
-
-        if (toLowerCase(url_info.api) == "text") {
-            success = handleTCPText(sockfd, url_info.host, url_info.port);
-        } else if (toLowerCase(url_info.api) == "binary") {
-            success = handleTCPBinary(sockfd, url_info.host, url_info.port);
-        }
-
-        close(sockfd);
-        successful_protocol = "TCP";
-    } 
-    else if (toLowerCase(url_info.protocol) == "udp") {
-        std::cout << "Host " << url_info.host << ", and port " << url_info.port << "." << std::endl;
-        struct sockaddr_in server_addr;
-        int sockfd = createUDPSocket(url_info.host, url_info.port, server_addr);
-        if (sockfd < 0) {
-            printError("CANT CONNECT TO " + url_info.host);
-#ifdef _WIN32
-            WSACleanup();
-#endif
+        atexit(closeStatsFile);
+    }
+    if (metrics_address != nullptr) {
+        metrics_server = new MetricsServer();
+        std::string error;
+        if (!metrics_server->start(metrics_address, error)) {
+            printError(error);
             return EXIT_FAILURE;
         }
+        // Handlers run in reverse order: the server stops before closeStatsFile
+        atexit(stopMetricsServer);
+    }
 
-        if (toLowerCase(url_info.api) == "text") {
-            success = handleUDPText(sockfd, server_addr, url_info.host, url_info.port);
-        } else if (toLowerCase(url_info.api) == "binary") {
-            success = handleUDPBinary(sockfd, server_addr, url_info.host, url_info.port);
-        }
-
-        close(sockfd);
-        successful_protocol = "UDP";
+    TimingReport timings;
+    if (print_timings || timings_path != nullptr) {
+        session_timings = &timings;
     }
-    else if (toLowerCase(url_info.protocol) == "any") {
-        std::cout << "Host " << url_info.host << ", and port " << url_info.port << "." << std::endl;
-        // Try UDP first
-        struct sockaddr_in server_addr;
-        int udp_sockfd = createUDPSocket(url_info.host, url_info.port, server_addr);
-        if (udp_sockfd >= 0) {
-            if (toLowerCase(url_info.api) == "text") {
-                success = handleUDPText(udp_sockfd, server_addr, url_info.host, url_info.port);
-            } else if (toLowerCase(url_info.api) == "binary") {
-                success = handleUDPBinary(udp_sockfd, server_addr, url_info.host, url_info.port);
-            }
-            close(udp_sockfd);
-            
-            if (success) {
-                successful_protocol = "UDP";
-            }
-        }
 
-        // If UDP failed, try TCP
-        if (!success) {
-            int tcp_sockfd = connectTCP(url_info.host, url_info.port);
-            if (tcp_sockfd >= 0) {
-                if (toLowerCase(url_info.api) == "text") {
-                    success = handleTCPText(tcp_sockfd, url_info.host, url_info.port);
-                } else if (toLowerCase(url_info.api) == "binary") {
-                    success = handleTCPBinary(tcp_sockfd, url_info.host, url_info.port);
-                }
-                close(tcp_sockfd);
-                
-                if (success) {
-                    successful_protocol = "TCP";
-                }
-            }
+    if (jobs_path != nullptr) {
+        if (url != nullptr || load_only || output_format == OUTPUT_BINARY) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
         }
-
-        if (!success) {
-            printError("CANT CONNECT TO " + url_info.host);
+        int fd = strcmp(jobs_path, "-") == 0 ? STDIN_FILENO : open(jobs_path, O_RDONLY);
+        if (fd < 0) {
+            printError(std::string("Failed to open ") + jobs_path);
             return EXIT_FAILURE;
         }
-        
-        // Report which protocol was successfully used for ANY mode
-        std::cout << "Successfully connected using " << successful_protocol << std::endl;
+        bool all_ok = runBatch(fd, load_opts.concurrency);
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+        session_timings = nullptr;
+        all_ok = reportTimings(timings, print_timings, timings_path) && all_ok;
+        return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
+    if (url == nullptr) {
+        printUsage(argv[0]);
 #ifdef _WIN32
-    WSACleanup();
+        WSACleanup();
 #endif
-    return success ? EXIT_SUCCESS : EXIT_FAILURE;
-}
-
-bool parseURL(const std::string& url, URLInfo& info) {
-    // Regular expression to parse PROTOCOL://host:port/api
-    std::regex url_regex(R"(^(TCP|UDP|ANY|tcp|udp|any)://([^:/]+):(\d+)/(TEXT|BINARY|text|binary)$)", std::regex_constants::icase);
-    std::smatch matches;
-    
-    if (std::regex_match(url, matches, url_regex)) {
-        info.protocol = matches[1].str();
-        info.host = matches[2].str();
-        info.port = std::stoi(matches[3].str());
-        info.api = matches[4].str();
-        return true;
+        return EXIT_FAILURE;
     }
-    
-    return false;
-}
 
-int connectTCP(const std::string& host, int port) {
-    struct addrinfo hints, *res;
-    int sockfd;
-    
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC; // Allow IPv4 or IPv6
-    hints.ai_socktype = SOCK_STREAM;
-    
-    int status = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
-    if (status != 0) {
-        printError("RESOLVE ISSUE");
-        return -1;
-    }
-    
-    sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (sockfd < 0) {
-        freeaddrinfo(res);
-        return -1;
+    URLInfo url_info;
+    if (!parseURL(url, url_info)) {
+        printError("Invalid URL format");
+        return EXIT_FAILURE;
     }
-    
-    // Set socket timeout for more reliable operation
+
+    std::cout << "Host " << url_info.host << ", and port " << url_info.port << "." << std::endl;
+
+    if (load_mode) {
+        bool all_ok = runLoadGenerator(url_info, load_opts);
+        session_timings = nullptr;
+        all_ok = reportTimings(timings, print_timings, timings_path) && all_ok;
 #ifdef _WIN32
-    DWORD timeout = 5000; // 5 seconds
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
-    setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, (char*)&timeout, sizeof(timeout));
-#else
-    struct timeval timeout;
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        WSACleanup();
 #endif
-    
-    if (connect(sockfd, res->ai_addr, res->ai_addrlen) < 0) {
-        close(sockfd);
-        freeaddrinfo(res);
-        return -1;
+        return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-    
-    freeaddrinfo(res);
-    return sockfd;
-}
-
-int createUDPSocket(const std::string& host, int port, struct sockaddr_in& server_addr) {
-    struct addrinfo hints, *res;
-    int sockfd;
-    
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET; // IPv4 for UDP
-    hints.ai_socktype = SOCK_DGRAM;
-    
-    int status = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
-    if (status != 0) {
-        printError("RESOLVE ISSUE");
-        return -1;
-    }
-    
-    sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (sockfd < 0) {
-        freeaddrinfo(res);
-        return -1;
-    }
-    
-    memcpy(&server_addr, res->ai_addr, sizeof(server_addr));
-    freeaddrinfo(res);
-    return sockfd;
-}
 
-bool handleTCPText(int sockfd, const std::string& host, int port) {
-    char buffer[1024];
-    
-    // Robust approach: handle both protocol negotiation and direct assignment
-    ssize_t bytes_read = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_read <= 0) {
-        printError("Failed to receive message from server");
-        return false;
-    }
-    
-    buffer[bytes_read] = '\0';
-    std::string message(buffer);
-    
-    // Check if this is protocol negotiation (contains "TEXT TCP")
-    if (message.find("TEXT TCP") != std::string::npos) {
-        // Handle protocol negotiation
-        std::string protocol_response = message;
-        
-        // Continue reading until we get complete protocol list (ends with empty line)
-        while (protocol_response.find("\n\n") == std::string::npos) {
-            bytes_read = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-            if (bytes_read <= 0) break;
-            buffer[bytes_read] = '\0';
-            protocol_response += buffer;
-        }
-        
-        // Check if server supports TEXT TCP 1.1 (or any version)
-        bool supports_text_tcp = (protocol_response.find("TEXT TCP") != std::string::npos);
-        if (!supports_text_tcp) {
-            printError("MISSMATCH PROTOCOL");
-            return false;
-        }
-        
-        // Send protocol acceptance (try 1.1 first, fallback to what server offers)
-        std::string accept_msg;
-        if (protocol_response.find("TEXT TCP 1.1") != std::string::npos) {
-            accept_msg = "TEXT TCP 1.1 OK\n";
-        } else if (protocol_response.find("TEXT TCP 1.0") != std::string::npos) {
-            accept_msg = "TEXT TCP 1.0 OK\n";
-        } else {
-            // Just accept the first TEXT TCP version found
-            accept_msg = "TEXT TCP 1.1 OK\n"; // Default attempt
-        }
-        
-        if (send(sockfd, accept_msg.c_str(), accept_msg.length(), 0) < 0) {
-            printError("Failed to send protocol acceptance");
-            return false;
-        }
-        
-        // Now read the assignment
-        bytes_read = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-        if (bytes_read <= 0) {
-            printError("Failed to receive assignment");
-            return false;
-        }
-        
-        buffer[bytes_read] = '\0';
-        message = buffer;
-    }
-    
-    // At this point, message should contain the assignment
-    std::string assignment = message;
-    
-    // Remove trailing newline if present
-    if (!assignment.empty() && assignment.back() == '\n') {
-        assignment.pop_back();
-    }
-    
-    std::cout << "ASSIGNMENT: " << assignment << std::endl;
-    
-    // Parse assignment (format: "operation value1 value2")
-    std::istringstream iss(assignment);
-    std::string operation;
-    int value1, value2;
-    
-    if (!(iss >> operation >> value1 >> value2)) {
-        printError("Invalid assignment format");
-        return false;
-    }
-    
-    // Calculate result
-    uint32_t op_code = string_to_operation(operation.c_str());
-    if (op_code == 0) {
-        printError("Unknown operation: " + operation);
-        return false;
-    }
-    int32_t result = calculate(op_code, value1, value2);
-    
-    // Send result
-    std::string result_str = std::to_string(result) + "\n";
-    if (send(sockfd, result_str.c_str(), result_str.length(), 0) < 0) {
-        printError("Failed to send result");
-        return false;
-    }
-    
-    // Read server response
-    bytes_read = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_read <= 0) {
-        printError("Failed to receive server response");
-        return false;
-    }
-    
-    buffer[bytes_read] = '\0';
-    std::string response(buffer);
-    
-    // Remove trailing newline
-    if (!response.empty() && response.back() == '\n') {
-        response.pop_back();
-    }
-    
-    if (response == "OK") {
-        std::cout << "OK (myresult=" << result << ")" << std::endl;
-        return true;
-    } else {
-        std::cout << "ERROR (myresult=" << result << ")" << std::endl;
-        return false;
-    }
-}
+    std::string successful_protocol;
+    bool connect_failed = false;
+    RaceReport race;
+    bool success = runSession(url_info, successful_protocol, connect_failed, udp_head_start_ms, &race);
+    session_timings = nullptr;
+    success = reportTimings(timings, print_timings, timings_path) && success;
 
-bool handleTCPBinary(int sockfd, const std::string& host, int port) {
-    char buffer[1024];
-    std::string protocol_response;
-    
-    // Read protocol negotiation from server
-    ssize_t bytes_read;
-    while ((bytes_read = recv(sockfd, buffer, sizeof(buffer) - 1, 0)) > 0) {
-        buffer[bytes_read] = '\0';
-        protocol_response += buffer;
-        
-        // Check if we've received the complete protocol list (ends with empty line)
-        if (protocol_response.find("\n\n") != std::string::npos) {
-            break;
-        }
-    }
-    
-    if (bytes_read <= 0) {
-        printError("Failed to receive protocol information");
-        return false;
-    }
-    
-    // Check if server supports BINARY TCP 1.1
-    if (protocol_response.find("BINARY TCP 1.1\n") == std::string::npos) {
-        printError("MISSMATCH PROTOCOL");
-        return false;
-    }
-    
-    // Send protocol acceptance
-    std::string accept_msg = "BINARY TCP 1.1 OK\n";
-    if (send(sockfd, accept_msg.c_str(), accept_msg.length(), 0) < 0) {
-        printError("Failed to send protocol acceptance");
-        return false;
-    }
-    
-    // Read calcProtocol message
-    calcProtocol calc_msg;
-    bytes_read = recv(sockfd, &calc_msg, sizeof(calc_msg), 0);
-    if (bytes_read != sizeof(calc_msg)) {
-        printError("WRONG SIZE OR INCORRECT PROTOCOL");
-        return false;
-    }
-    
-    // Convert from network byte order
-    calc_msg.type = ntoh16(calc_msg.type);
-    calc_msg.major_version = ntoh16(calc_msg.major_version);
-    calc_msg.minor_version = ntoh16(calc_msg.minor_version);
-    calc_msg.id = ntoh32(calc_msg.id);
-    calc_msg.arith = ntoh32(calc_msg.arith);
-    calc_msg.inValue1 = ntoh32(calc_msg.inValue1);
-    calc_msg.inValue2 = ntoh32(calc_msg.inValue2);
-    
-    // Check message type and version
-    if (calc_msg.type != MSG_TYPE_CALC_PROTOCOL || 
-        calc_msg.major_version != MAJOR_VERSION || 
-        calc_msg.minor_version != MINOR_VERSION) {
-        printError("WRONG SIZE OR INCORRECT PROTOCOL");
-        return false;
-    }
-    
-    // Display assignment
-    std::cout << "ASSIGNMENT: " << operation_to_string(calc_msg.arith) 
-              << " " << calc_msg.inValue1 << " " << calc_msg.inValue2 << std::endl;
-    
-    // Calculate result
-    int32_t result = calculate(calc_msg.arith, calc_msg.inValue1, calc_msg.inValue2);
-    DEBUG_PRINT("Calculated the result to " << result);
-    
-    // Fill in result and convert to network byte order
-    calc_msg.inResult = hton32(result);
-    calc_msg.type = hton16(calc_msg.type);
-    calc_msg.major_version = hton16(calc_msg.major_version);
-    calc_msg.minor_version = hton16(calc_msg.minor_version);
-    calc_msg.id = hton32(calc_msg.id);
-    calc_msg.arith = hton32(calc_msg.arith);
-    calc_msg.inValue1 = hton32(calc_msg.inValue1);
-    calc_msg.inValue2 = hton32(calc_msg.inValue2);
-    
-    // Send response
-    if (send(sockfd, &calc_msg, sizeof(calc_msg), 0) < 0) {
-        printError("Failed to send result");
-        return false;
-    }
-    
-    // Read server response
-    calcMessage response;
-    bytes_read = recv(sockfd, &response, sizeof(response), 0);
-    if (bytes_read != sizeof(response)) {
-        printError("WRONG SIZE OR INCORRECT PROTOCOL");
-        return false;
-    }
-    
-    // Convert from network byte order
-    response.type = ntoh16(response.type);
-    response.message = ntoh16(response.message);
-    response.protocol = ntoh16(response.protocol);
-    response.major_version = ntoh16(response.major_version);
-    response.minor_version = ntoh16(response.minor_version);
-    
-    if (response.type == MSG_TYPE_CALC_MESSAGE) {
-        if (response.message == 1) { // OK
-            std::cout << "OK (myresult=" << result << ")" << std::endl;
-            return true;
-        } else if (response.message == 2) { // NOT OK
-            printError("Server sent NOT OK message");
-            return false;
+    if (url_info.transport == URL_ANY) {
+        printAttempt("UDP", race.udp);
+        std::cout << ", ";
+        printAttempt("TCP", race.tcp);
+        std::cout << std::endl;
+        if (!success) {
+            printError("CANT CONNECT TO " + url_info.host);
+            return EXIT_FAILURE;
         }
-    }
-    
-    printError("Invalid server response");
-    return false;
-}
 
-bool handleUDPText(int sockfd, const struct sockaddr_in& server_addr, const std::string& host, int port) {
-    // Send initial message
-    std::string init_msg = "TEXT UDP 1.1\n";
-    if (sendto(sockfd, init_msg.c_str(), init_msg.length(), 0, 
-               (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        printError("Failed to send initial message");
-        return false;
-    }
-    
-    // Set timeout for UDP communication
-#ifdef _WIN32
-    DWORD timeout = 2000; // 2 seconds in milliseconds
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout)) < 0) {
-#else
-    struct timeval timeout;
-    timeout.tv_sec = 2;
-    timeout.tv_usec = 0;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-#endif
-        printError("Failed to set socket timeout");
-        return false;
-    }
-    
-    // Receive assignment
-    char buffer[1024];
-    socklen_t addr_len = sizeof(server_addr);
-    ssize_t bytes_read = recvfrom(sockfd, buffer, sizeof(buffer) - 1, 0,
-                                  nullptr, nullptr);
-    
-    if (bytes_read < 0) {
-#ifdef _WIN32
-        int error = WSAGetLastError();
-        if (error == WSAETIMEDOUT) {
-            printError("MESSAGE LOST (TIMEOUT)");
-        } else {
-            printError("Failed to receive assignment");
-        }
-#else
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            printError("MESSAGE LOST (TIMEOUT)");
-        } else {
-            printError("Failed to receive assignment");
-        }
-#endif
-        return false;
-    }
-    
-    buffer[bytes_read] = '\0';
-    std::string assignment(buffer);
-    
-    // Remove trailing newline
-    if (!assignment.empty() && assignment.back() == '\n') {
-        assignment.pop_back();
-    }
-    
-    std::cout << "ASSIGNMENT: " << assignment << std::endl;
-    
-    // Parse assignment
-    std::istringstream iss(assignment);
-    std::string operation;
-    int value1, value2;
-    
-    if (!(iss >> operation >> value1 >> value2)) {
-        printError("Invalid assignment format");
-        return false;
-    }
-    
-    // Calculate result
-    uint32_t op_code = string_to_operation(operation.c_str());
-    int32_t result = calculate(op_code, value1, value2);
-    
-    DEBUG_PRINT("Calculated the result to " << result);
-    
-    // Send result
-    std::string result_str = std::to_string(result) + "\n";
-    if (sendto(sockfd, result_str.c_str(), result_str.length(), 0,
-               (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        printError("Failed to send result");
-        return false;
-    }
-    
-    // Receive server response
-    bytes_read = recvfrom(sockfd, buffer, sizeof(buffer) - 1, 0,
-                          nullptr, nullptr);
-    
-    if (bytes_read < 0) {
+        // Report which protocol was successfully used for ANY mode
+        std::cout << "Successfully connected using " << successful_protocol << std::endl;
+    } else if (connect_failed) {
+        printError("CANT CONNECT TO " + url_info.host);
 #ifdef _WIN32
-        int error = WSAGetLastError();
-        if (error == WSAETIMEDOUT) {
-            printError("MESSAGE LOST (TIMEOUT)");
-        } else {
-            printError("Failed to receive server response");
-        }
-#else
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            printError("MESSAGE LOST (TIMEOUT)");
-        } else {
-            printError("Failed to receive server response");
-        }
+        WSACleanup();
 #endif
-        return false;
-    }
-    
-    buffer[bytes_read] = '\0';
-    std::string response(buffer);
-    
-    // Remove trailing newline
-    if (!response.empty() && response.back() == '\n') {
-        response.pop_back();
-    }
-    
-    if (response == "OK") {
-        std::cout << "OK (myresult=" << result << ")" << std::endl;
-        return true;
-    } else {
-        std::cout << "ERROR (myresult=" << result << ")" << std::endl;
-        return false;
+        return EXIT_FAILURE;
     }
-}
 
-bool handleUDPBinary(int sockfd, const struct sockaddr_in& server_addr, const std::string& host, int port) {
-    // Create initial calcMessage
-    calcMessage init_msg;
-    init_msg.type = hton16(MSG_TYPE_CALC_MESSAGE);
-    init_msg.message = hton16(0);
-    init_msg.protocol = hton16(PROTOCOL_UDP);
-    init_msg.major_version = hton16(MAJOR_VERSION);
-    init_msg.minor_version = hton16(MINOR_VERSION);
-    
-    // Send initial message
-    if (sendto(sockfd, &init_msg, sizeof(init_msg), 0,
-               (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        printError("Failed to send initial message");
-        return false;
-    }
-    
-    // Set timeout for UDP communication
 #ifdef _WIN32
-    DWORD timeout = 2000; // 2 seconds in milliseconds
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout)) < 0) {
-#else
-    struct timeval timeout;
-    timeout.tv_sec = 2;
-    timeout.tv_usec = 0;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-#endif
-        printError("Failed to set socket timeout");
-        return false;
-    }
-    
-    // Receive server response
-    char buffer[1024];
-    ssize_t bytes_read = recvfrom(sockfd, buffer, sizeof(buffer), 0,
-                                  nullptr, nullptr);
-    
-    if (bytes_read < 0) {
-#ifdef _WIN32
-        int error = WSAGetLastError();
-        if (error == WSAETIMEDOUT) {
-            printError("MESSAGE LOST (TIMEOUT)");
-        } else {
-            printError("Failed to receive server response");
-        }
-#else
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            printError("MESSAGE LOST (TIMEOUT)");
-        } else {
-            printError("Failed to receive server response");
-        }
-#endif
-        return false;
-    }
-    
-    // Check if it's a calcMessage (NOT OK response)
-    if (bytes_read == sizeof(calcMessage)) {
-        calcMessage* msg = (calcMessage*)buffer;
-        msg->type = ntoh16(msg->type);
-        msg->message = ntoh16(msg->message);
-        
-        if (msg->type == MSG_TYPE_CALC_MESSAGE && msg->message == 2) {
-            printError("Server sent NOT OK message");
-            return false;
-        }
-    }
-    
-    // Check if it's a calcProtocol message
-    if (bytes_read != sizeof(calcProtocol)) {
-        printError("WRONG SIZE OR INCORRECT PROTOCOL");
-        return false;
-    }
-    
-    calcProtocol* calc_msg = (calcProtocol*)buffer;
-    
-    // Convert from network byte order
-    calc_msg->type = ntoh16(calc_msg->type);
-    calc_msg->major_version = ntoh16(calc_msg->major_version);
-    calc_msg->minor_version = ntoh16(calc_msg->minor_version);
-    calc_msg->id = ntoh32(calc_msg->id);
-    calc_msg->arith = ntoh32(calc_msg->arith);
-    calc_msg->inValue1 = ntoh32(calc_msg->inValue1);
-    calc_msg->inValue2 = ntoh32(calc_msg->inValue2);
-    
-    // Check message type and version
-    if (calc_msg->type != MSG_TYPE_CALC_PROTOCOL ||
-        calc_msg->major_version != MAJOR_VERSION ||
-        calc_msg->minor_version != MINOR_VERSION) {
-        printError("WRONG SIZE OR INCORRECT PROTOCOL");
-        return false;
-    }
-    
-    // Display assignment
-    std::cout << "ASSIGNMENT: " << operation_to_string(calc_msg->arith)
-              << " " << calc_msg->inValue1 << " " << calc_msg->inValue2 << std::endl;
-    
-    // Calculate result
-    int32_t result = calculate(calc_msg->arith, calc_msg->inValue1, calc_msg->inValue2);
-    DEBUG_PRINT("Calculated the result to " << result);
-    
-    // Fill in result and convert to network byte order
-    calc_msg->inResult = hton32(result);
-    calc_msg->type = hton16(calc_msg->type);
-    calc_msg->major_version = hton16(calc_msg->major_version);
-    calc_msg->minor_version = hton16(calc_msg->minor_version);
-    calc_msg->id = hton32(calc_msg->id);
-    calc_msg->arith = hton32(calc_msg->arith);
-    calc_msg->inValue1 = hton32(calc_msg->inValue1);
-    calc_msg->inValue2 = hton32(calc_msg->inValue2);
-    
-    // Send response
-    if (sendto(sockfd, calc_msg, sizeof(*calc_msg), 0,
-               (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        printError("Failed to send result");
-        return false;
-    }
-    
-    // Receive final server response
-    bytes_read = recvfrom(sockfd, buffer, sizeof(buffer), 0,
-                          nullptr, nullptr);
-    
-    if (bytes_read < 0) {
-#ifdef _WIN32
-        int error = WSAGetLastError();
-        if (error == WSAETIMEDOUT) {
-            printError("MESSAGE LOST (TIMEOUT)");
-        } else {
-            printError("Failed to receive final response");
-        }
-#else
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            printError("MESSAGE LOST (TIMEOUT)");
-        } else {
-            printError("Failed to receive final response");
-        }
+    WSACleanup();
 #endif
-        return false;
-    }
-    
-    if (bytes_read != sizeof(calcMessage)) {
-        printError("WRONG SIZE OR INCORRECT PROTOCOL");
-        return false;
-    }
-    
-    calcMessage* response = (calcMessage*)buffer;
-    response->type = ntoh16(response->type);
-    response->message = ntoh16(response->message);
-    
-    if (response->type == MSG_TYPE_CALC_MESSAGE) {
-        if (response->message == 1) { // OK
-            std::cout << "OK (myresult=" << result << ")" << std::endl;
-            return true;
-        } else if (response->message == 2) { // NOT OK
-            printError("Server sent NOT OK message");
-            return false;
-        }
-    }
-    
-    printError("Invalid server response");
-    return false;
-}
-
-void printError(const std::string& message) {
-    std::cerr << "ERROR: " << message << std::endl;
-}
-
-std::string toLowerCase(const std::string& str) {
-    std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(), ::tolower);
-    return result;
-}
-
-// Network byte order conversion functions
-uint16_t hton16(uint16_t value) {
-    return htons(value);
-}
-
-uint32_t hton32(uint32_t value) {
-    return htonl(value);
-}
-
-uint16_t ntoh16(uint16_t value) {
-    return ntohs(value);
-}
-
-uint32_t ntoh32(uint32_t value) {
-    return ntohl(value);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,159 @@
+// Live view of a running client's counters (./client -s STATS_FILE ...).
+// Only maps the file read-only and sums it, so watching never slows the run.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+#include "stats.h"
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-i SECONDS] [-1] STATS_FILE" << std::endl;
+}
+
+static uint64_t countOf(const std::vector<uint64_t>& counts) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        total += counts[i];
+    }
+    return total;
+}
+
+// Smallest bucket bound that percent% of the counted values are at or below
+static uint64_t percentileOf(const std::vector<uint64_t>& counts, double percent) {
+    uint64_t total = countOf(counts);
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percent / 100.0 * (double)total + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return LatencyHistogram::highestValueIn(i);
+        }
+    }
+    return LatencyHistogram::highestValueIn(counts.size() - 1);
+}
+
+static const char* const COUNTER_NAMES[STAT_COUNT] = {
+    "started", "ok", "error", "timeout", "connect_failed", "mismatch_protocol", "wrong_size"
+};
+
+// Totals since the client started, one "name: value" per line
+static void printSnapshot(const StatsSnapshot& s) {
+    std::cout << "pid: " << s.pid << (s.finished ? " (finished)" : " (running)") << std::endl;
+    for (int c = 0; c < STAT_COUNT; c++) {
+        std::cout << COUNTER_NAMES[c] << ": " << s.counters[c] << std::endl;
+    }
+    const char* names[2] = { "udp", "tcp" };
+    for (int t = 1; t >= 0; t--) {
+        std::cout << names[t] << "_latency_us: count " << countOf(s.latency[t])
+                  << " p50 " << percentileOf(s.latency[t], 50)
+                  << " p90 " << percentileOf(s.latency[t], 90)
+                  << " p99 " << percentileOf(s.latency[t], 99) << std::endl;
+    }
+}
+
+// One line per interval: totals, rates over the interval and the latency
+// percentiles of the sessions that finished within it
+static void printHeader() {
+    std::cout << std::setw(8) << "time" << std::setw(10) << "started" << std::setw(10) << "ok"
+              << std::setw(8) << "error" << std::setw(8) << "timeout" << std::setw(8) << "connect"
+              << std::setw(9) << "mismatch" << std::setw(8) << "size" << std::setw(10) << "ok/s"
+              << std::setw(8) << "err/s" << std::setw(16) << "tcp p50/p99 us" << std::setw(16) << "udp p50/p99 us"
+              << std::endl;
+}
+
+static void printInterval(const StatsSnapshot& now, const StatsSnapshot& before, double seconds, double elapsed) {
+    const uint64_t* c = now.counters;
+    std::cout << std::fixed << std::setprecision(1) << std::setw(8) << elapsed
+              << std::setw(10) << c[STAT_STARTED] << std::setw(10) << c[STAT_OK]
+              << std::setw(8) << c[STAT_ERROR] << std::setw(8) << c[STAT_TIMEOUT]
+              << std::setw(8) << c[STAT_CONNECT_FAILED] << std::setw(9) << c[STAT_MISMATCH]
+              << std::setw(8) << c[STAT_WRONG_SIZE]
+              << std::setw(10) << (c[STAT_OK] - before.counters[STAT_OK]) / seconds
+              << std::setw(8) << (c[STAT_ERROR] - before.counters[STAT_ERROR]) / seconds;
+    for (int t = 1; t >= 0; t--) {
+        std::vector<uint64_t> delta(now.latency[t].size());
+        for (size_t b = 0; b < delta.size(); b++) {
+            delta[b] = now.latency[t][b] - before.latency[t][b];
+        }
+        std::string cell = std::to_string(percentileOf(delta, 50)) + "/" + std::to_string(percentileOf(delta, 99));
+        std::cout << std::setw(16) << cell;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    double interval = 1.0;
+    bool once = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            interval = strtod(argv[++i], &end);
+            if (*end != '\0' || !(interval > 0)) {
+                std::cerr << "ERROR: Invalid value for -i" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-1") == 0) {
+            once = true;
+        } else if (path == nullptr && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (path == nullptr) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    StatsReader reader;
+    std::string error;
+    if (!reader.open(path, error)) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // The client may still be setting the file up
+    StatsSnapshot before;
+    auto period = std::chrono::duration<double>(interval);
+    StatsReadResult result;
+    while ((result = reader.read(before)) == STATS_READ_NOT_READY) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (result == STATS_READ_MISMATCH) {
+        std::cerr << "ERROR: " << path << " is not a stats file of this version" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (once) {
+        printSnapshot(before);
+        return EXIT_SUCCESS;
+    }
+
+    printHeader();
+    auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    StatsSnapshot now;
+    // Until the client is done, and at least once
+    do {
+        std::this_thread::sleep_for(period);
+        reader.read(now);
+        auto t = std::chrono::steady_clock::now();
+        printInterval(now, before, std::chrono::duration<double>(t - last).count(),
+                      std::chrono::duration<double>(t - start).count());
+        before = now;
+        last = t;
+    } while (!before.finished);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+#include <cerrno>
+
+#include "coio.h"
+
+CoSocket::CoSocket(EventLoop& loop, int fd)
+    : loop_(loop), fd_(fd), interest_(0), registered_(false), kind_(OP_RECV), buf_(nullptr),
+      len_(0), sent_(0), from_(nullptr), from_len_(nullptr), timeout_ms_(0), result_(-1),
+      timed_out_(false), timer_(this) {
+}
+
+CoSocket::~CoSocket() {
+    loop_.cancelTimer(&timer_);
+    if (registered_) {
+        loop_.remove(fd_);
+    }
+    close(fd_);
+}
+
+CoSocket::Op CoSocket::prepare(Kind kind, void* buf, size_t len, uint64_t timeout_ms) {
+    kind_ = kind;
+    buf_ = static_cast<char*>(buf);
+    len_ = len;
+    sent_ = 0;
+    timeout_ms_ = timeout_ms;
+    timed_out_ = false;
+    return Op(*this);
+}
+
+CoSocket::Op CoSocket::recv(void* buf, size_t len, uint64_t timeout_ms) {
+    return prepare(OP_RECV, buf, len, timeout_ms);
+}
+
+CoSocket::Op CoSocket::recvfrom(void* buf, size_t len, struct sockaddr* from, socklen_t* from_len,
+                                uint64_t timeout_ms) {
+    from_ = from;
+    from_len_ = from_len;
+    return prepare(OP_RECVFROM, buf, len, timeout_ms);
+}
+
+CoSocket::Op CoSocket::send(const void* buf, size_t len, uint64_t timeout_ms) {
+    return prepare(OP_SEND, const_cast<void*>(buf), len, timeout_ms);
+}
+
+// Run the pending operation as far as it goes; false if it has to wait
+bool CoSocket::attempt() {
+    ssize_t n;
+    switch (kind_) {
+        case OP_RECV:
+            n = ::recv(fd_, buf_, len_, 0);
+            break;
+        case OP_RECVFROM:
+            n = ::recvfrom(fd_, buf_, len_, 0, from_, from_len_);
+            if (n < 0 && errno == ECONNREFUSED) {
+                return false;
+            }
+            break;
+        default:
+            while (sent_ < len_) {
+                n = ::send(fd_, buf_ + sent_, len_ - sent_, 0);
+                if (n < 0) {
+                    if (socketWouldBlock()) {
+                        return false;
+                    }
+                    result_ = -1;
+                    return true;
+                }
+                sent_ += (size_t)n;
+            }
+            result_ = (ssize_t)len_;
+            return true;
+    }
+
+    if (n < 0 && socketWouldBlock()) {
+        return false;
+    }
+    result_ = n;
+    return true;
+}
+
+void CoSocket::wait(std::coroutine_handle<> awaiting) {
+    waiting_ = awaiting;
+    uint32_t wanted = kind_ == OP_SEND ? EV_WRITE : EV_READ;
+    if (!registered_) {
+        registered_ = loop_.add(fd_, wanted, this);
+        interest_ = wanted;
+    } else if (interest_ != wanted) {
+        loop_.modify(fd_, wanted, this);
+        interest_ = wanted;
+    }
+    if (!registered_) {
+        result_ = -1;
+        wake();
+        return;
+    }
+    loop_.addTimer(&timer_, timeout_ms_);
+}
+
+void CoSocket::onEvent(uint32_t events) {
+    (void)events;
+    if (!waiting_) {
+        // Ready while nobody waits (e.g. between two awaits): stop polling until the next one
+        loop_.modify(fd_, 0, this);
+        interest_ = 0;
+        return;
+    }
+    if (attempt()) {
+        wake();
+    }
+}
+
+void CoSocket::onTimer() {
+    if (!waiting_) {
+        return;
+    }
+    timed_out_ = true;
+    result_ = -1;
+    wake();
+}
+
+// Resume the waiting coroutine; it may destroy this socket before returning
+void CoSocket::wake() {
+    loop_.cancelTimer(&timer_);
+    std::coroutine_handle<> awaiting = waiting_;
+    waiting_ = nullptr;
+    awaiting.resume();
+}
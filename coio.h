@@ -0,0 +1,140 @@
+#ifndef COIO_H
+#define COIO_H
+
+// C++20 only: part of the coroutine client (make coclient)
+
+#include <coroutine>
+#include <vector>
+
+#include "client.h"
+#include "eventloop.h"
+#include "connector.h"
+
+// A non-blocking socket for coroutines to co_await on. Every operation is
+// tried right away; only if it would block does the coroutine suspend until
+// the EventLoop reports the socket ready or timeout_ms expires. One operation
+// at a time, which is all a sequential session needs.
+class CoSocket : public EventHandler, public TimerHandler {
+public:
+    class Op {
+    public:
+        explicit Op(CoSocket& socket) : socket_(socket) {}
+        bool await_ready() { return socket_.attempt(); }
+        void await_suspend(std::coroutine_handle<> awaiting) { socket_.wait(awaiting); }
+        ssize_t await_resume() const { return socket_.result_; }
+
+    private:
+        CoSocket& socket_;
+    };
+
+    // Takes ownership of fd
+    CoSocket(EventLoop& loop, int fd);
+    ~CoSocket();
+
+    // >0 bytes received, 0 the peer closed the connection, -1 error or timeout
+    Op recv(void* buf, size_t len, uint64_t timeout_ms);
+
+    // One datagram (from may be nullptr). ICMP errors reported for earlier
+    // datagrams are skipped: like lost replies, they end in the timeout.
+    Op recvfrom(void* buf, size_t len, struct sockaddr* from, socklen_t* from_len, uint64_t timeout_ms);
+
+    // All len bytes (TCP) or one datagram (UDP): len, or -1 on error or timeout
+    Op send(const void* buf, size_t len, uint64_t timeout_ms);
+
+    // The last operation failed because its timeout expired
+    bool timedOut() const { return timed_out_; }
+
+    void onEvent(uint32_t events) override;
+    void onTimer() override;
+
+private:
+    CoSocket(const CoSocket&);
+    CoSocket& operator=(const CoSocket&);
+
+    enum Kind { OP_RECV, OP_RECVFROM, OP_SEND };
+
+    Op prepare(Kind kind, void* buf, size_t len, uint64_t timeout_ms);
+    bool attempt();
+    void wait(std::coroutine_handle<> awaiting);
+    void wake();
+
+    EventLoop& loop_;
+    int fd_;
+    uint32_t interest_;
+    bool registered_;
+    Kind kind_;
+    char* buf_;
+    size_t len_;
+    size_t sent_;
+    struct sockaddr* from_;
+    socklen_t* from_len_;
+    uint64_t timeout_ms_;
+    ssize_t result_;
+    bool timed_out_;
+    std::coroutine_handle<> waiting_;
+    Timer timer_;
+};
+
+// co_await CoSleep(loop, ms)
+class CoSleep : public TimerHandler {
+public:
+    CoSleep(EventLoop& loop, uint64_t ms) : loop_(loop), ms_(ms), timer_(this) {}
+    ~CoSleep() { loop_.cancelTimer(&timer_); }
+
+    bool await_ready() const { return ms_ == 0; }
+    void await_suspend(std::coroutine_handle<> awaiting) {
+        waiting_ = awaiting;
+        loop_.addTimer(&timer_, ms_);
+    }
+    void await_resume() const {}
+
+    void onTimer() override { waiting_.resume(); }
+
+private:
+    EventLoop& loop_;
+    uint64_t ms_;
+    std::coroutine_handle<> waiting_;
+    Timer timer_;
+};
+
+// co_await CoConnect(loop, addresses, timeout_ms): a connected non-blocking
+// TCP socket, or -1. The addresses are raced by a TcpConnector.
+class CoConnect : public ConnectObserver, public TimerHandler {
+public:
+    CoConnect(EventLoop& loop, const std::vector<SocketAddress>& addresses, uint64_t timeout_ms)
+        : loop_(loop), addresses_(addresses), timeout_ms_(timeout_ms), connector_(loop, this),
+          fd_(-1), timer_(this) {}
+    ~CoConnect() { loop_.cancelTimer(&timer_); }
+
+    bool await_ready() { return !connector_.start(addresses_); }
+    void await_suspend(std::coroutine_handle<> awaiting) {
+        waiting_ = awaiting;
+        loop_.addTimer(&timer_, timeout_ms_);
+    }
+    int await_resume() const { return fd_; }
+
+    void onConnected(int fd) override {
+        fd_ = fd;
+        loop_.cancelTimer(&timer_);
+        waiting_.resume();
+    }
+    void onConnectFailed() override {
+        loop_.cancelTimer(&timer_);
+        waiting_.resume();
+    }
+    void onTimer() override {
+        connector_.cancel();
+        waiting_.resume();
+    }
+
+private:
+    EventLoop& loop_;
+    const std::vector<SocketAddress>& addresses_;
+    uint64_t timeout_ms_;
+    TcpConnector connector_;
+    int fd_;
+    std::coroutine_handle<> waiting_;
+    Timer timer_;
+};
+
+#endif // COIO_H
@@ -0,0 +1,145 @@
+// Coroutine client: the same sessions as ./client, each written as one
+// straight-line C++20 coroutine on a single EventLoop (make coclient)
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+
+#include "client.h"
+#include "coro.h"
+#include "cosession.h"
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-n SESSIONS [-c CONCURRENCY]] PROTOCOL://server:port/api" << std::endl;
+}
+
+// Parse a strictly positive integer option value
+static bool parseCount(const char* str, int& value) {
+    char* end = nullptr;
+    long parsed = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || parsed < 1 || parsed > 100000000) {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+struct LaneTotals {
+    int remaining;          // Sessions not started yet
+    int ok;
+    int errors;
+    int connect_failures;
+};
+
+// One of the concurrent session slots of a load run: sessions back to back
+// until none are left
+static Task<int> lane(EventLoop& loop, const URLInfo& info, LaneTotals& totals) {
+    int sessions = 0;
+    while (totals.remaining > 0) {
+        totals.remaining--;
+        bool connect_failed = false;
+        if (co_await coSession(loop, info, connect_failed)) {
+            totals.ok++;
+        } else {
+            totals.errors++;
+            totals.connect_failures += connect_failed ? 1 : 0;
+        }
+        sessions++;
+    }
+    co_return sessions;
+}
+
+// Run sessions coroutine sessions, concurrency at a time, and print a summary
+static bool runLoad(EventLoop& loop, const URLInfo& info, int sessions, int concurrency) {
+    if (concurrency > sessions) {
+        concurrency = sessions;
+    }
+    LaneTotals totals = { sessions, 0, 0, 0 };
+
+    // Per-session output would dominate the run time, only the summary is printed
+    quiet_mode = true;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Task<int> > lanes;
+    for (int i = 0; i < concurrency; i++) {
+        lanes.push_back(lane(loop, info, totals));
+        lanes.back().start();
+    }
+    for (size_t i = 0; i < lanes.size(); i++) {
+        while (!lanes[i].done()) {
+            loop.runOnce();
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    quiet_mode = false;
+
+    const CoroutineFrames& frames = coroutineFrames();
+    std::cout << "Sessions: " << sessions << " (concurrency " << concurrency << ", coroutines)" << std::endl;
+    std::cout << "OK: " << totals.ok << ", ERROR: " << totals.errors
+              << " (" << totals.connect_failures << " connect failures)" << std::endl;
+    std::cout << std::fixed << std::setprecision(3)
+              << "Elapsed: " << elapsed << " s, "
+              << std::setprecision(1) << (elapsed > 0 ? sessions / elapsed : 0.0)
+              << " sessions/sec" << std::endl;
+    std::cout << "Coroutine frames: peak " << frames.peak_bytes << " bytes ("
+              << frames.peak_bytes / concurrency << " per session in flight)" << std::endl;
+    return totals.errors == 0;
+}
+
+int main(int argc, char* argv[]) {
+    int sessions = 0;
+    int concurrency = 1;
+    std::string url;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "-n" || arg == "-c") && i + 1 < argc) {
+            if (!parseCount(argv[++i], arg == "-n" ? sessions : concurrency)) {
+                printError("Invalid value for " + arg);
+                return EXIT_FAILURE;
+            }
+        } else if (url.empty() && arg[0] != '-') {
+            url = arg;
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (url.empty()) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    URLInfo url_info;
+    if (!parseURL(url, url_info)) {
+        printError("Invalid URL format");
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Host " << url_info.host << ", and port " << url_info.port << "." << std::endl;
+
+    EventLoop loop;
+    if (!loop.valid()) {
+        printError("Failed to set up the event loop");
+        return EXIT_FAILURE;
+    }
+
+    if (sessions > 0) {
+        return runLoad(loop, url_info, sessions, concurrency) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    bool connect_failed = false;
+    Task<bool> session = coSession(loop, url_info, connect_failed);
+    session.start();
+    while (!session.done()) {
+        loop.runOnce();
+    }
+    if (connect_failed) {
+        printError("CANT CONNECT TO " + url_info.host);
+        return EXIT_FAILURE;
+    }
+    return session.result() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
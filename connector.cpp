@@ -0,0 +1,101 @@
+#include <algorithm>
+
+#include "connector.h"
+
+// Delay before the next address is tried while earlier attempts are still
+// pending (RFC 8305, section 5 recommends 250 ms)
+#define CONNECTION_ATTEMPT_DELAY_MS 250
+
+TcpConnector::TcpConnector(EventLoop& loop, ConnectObserver* observer)
+    : loop_(loop), observer_(observer), next_(0), timer_(this) {
+}
+
+TcpConnector::~TcpConnector() {
+    cancel();
+}
+
+bool TcpConnector::start(const std::vector<SocketAddress>& addresses) {
+    cancel();
+    addresses_ = addresses;
+    next_ = 0;
+    return startNext();
+}
+
+void TcpConnector::cancel() {
+    loop_.cancelTimer(&timer_);
+    while (!attempts_.empty()) {
+        drop(attempts_.back(), true);
+    }
+}
+
+bool TcpConnector::startNext() {
+    while (next_ < addresses_.size()) {
+        int fd = connectTCP(addresses_[next_++]);
+        if (fd < 0) {
+            continue;
+        }
+
+        Attempt* attempt = new Attempt();
+        attempt->connector = this;
+        attempt->fd = fd;
+        if (!loop_.add(fd, EV_WRITE, attempt)) {
+            close(fd);
+            delete attempt;
+            continue;
+        }
+        attempts_.push_back(attempt);
+
+        if (next_ < addresses_.size()) {
+            loop_.addTimer(&timer_, CONNECTION_ATTEMPT_DELAY_MS);
+        } else {
+            loop_.cancelTimer(&timer_);
+        }
+        return true;
+    }
+    return false;
+}
+
+void TcpConnector::onTimer() {
+    // Earlier attempts are still pending, so running out of addresses is not a failure yet
+    startNext();
+}
+
+void TcpConnector::Attempt::onEvent(uint32_t events) {
+    (void)events;  // Completion, successful or not, shows as writability or an error
+    if (connector != nullptr) {
+        connector->onAttemptDone(this);
+    }
+}
+
+void TcpConnector::onAttemptDone(Attempt* attempt) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(attempt->fd, SOL_SOCKET, SO_ERROR, (char*)&error, &len) == 0 && error == 0) {
+        int fd = attempt->fd;
+        drop(attempt, false);
+        cancel();
+        observer_->onConnected(fd);
+        return;
+    }
+
+    // Try the next address right away instead of waiting out the delay
+    drop(attempt, true);
+    if (startNext() || !attempts_.empty()) {
+        return;
+    }
+    loop_.cancelTimer(&timer_);
+    observer_->onConnectFailed();
+}
+
+void TcpConnector::drop(Attempt* attempt, bool close_fd) {
+    loop_.remove(attempt->fd);
+    if (close_fd) {
+        close(attempt->fd);
+    }
+    attempts_.erase(std::find(attempts_.begin(), attempts_.end(), attempt));
+
+    // Events for it may already have been collected in this loop iteration
+    attempt->connector = nullptr;
+    attempt->fd = -1;
+    loop_.deleteLater(attempt);
+}
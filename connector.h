@@ -0,0 +1,65 @@
+#ifndef CONNECTOR_H
+#define CONNECTOR_H
+
+#include <vector>
+
+#include "client.h"
+#include "eventloop.h"
+
+// Receives the outcome of a TcpConnector
+class ConnectObserver {
+public:
+    virtual ~ConnectObserver() {}
+    // fd is connected and no longer registered with the loop; the observer owns it
+    virtual void onConnected(int fd) = 0;
+    virtual void onConnectFailed() = 0;
+};
+
+// Connects to the first reachable address of a list ("Happy Eyeballs",
+// RFC 8305). Attempts are started in list order, a new one every
+// CONNECTION_ATTEMPT_DELAY_MS or as soon as the previous one failed, and run in
+// parallel. The first attempt that completes wins and the others are closed, so
+// a dead address costs at most one delay instead of a full connect timeout.
+// The connector has no timeout of its own; the owner cancels it.
+class TcpConnector : public TimerHandler {
+public:
+    TcpConnector(EventLoop& loop, ConnectObserver* observer);
+    ~TcpConnector();
+
+    // Returns false if no attempt could be started; the observer is not called then
+    bool start(const std::vector<SocketAddress>& addresses);
+
+    // Abandon all attempts without notifying the observer
+    void cancel();
+
+    bool active() const { return !attempts_.empty(); }
+
+    // Attempts started so far
+    size_t attempted() const { return next_; }
+
+    void onTimer() override;
+
+private:
+    struct Attempt : public EventHandler {
+        TcpConnector* connector;    // nullptr once the attempt is over
+        int fd;
+
+        void onEvent(uint32_t events) override;
+    };
+
+    TcpConnector(const TcpConnector&);
+    TcpConnector& operator=(const TcpConnector&);
+
+    bool startNext();
+    void onAttemptDone(Attempt* attempt);
+    void drop(Attempt* attempt, bool close_fd);
+
+    EventLoop& loop_;
+    ConnectObserver* observer_;
+    std::vector<SocketAddress> addresses_;
+    size_t next_;
+    std::vector<Attempt*> attempts_;
+    Timer timer_;
+};
+
+#endif // CONNECTOR_H
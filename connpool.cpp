@@ -0,0 +1,59 @@
+#include "connpool.h"
+#include "client.h"
+
+ConnectionPool::ConnectionPool(uint64_t max_idle_ms)
+    : max_idle_ms_(max_idle_ms), reused_(0), misses_(0) {
+}
+
+ConnectionPool::~ConnectionPool() {
+    for (std::map<std::string, std::deque<Idle> >::iterator it = idle_.begin(); it != idle_.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); i++) {
+            close(it->second[i].fd);
+        }
+    }
+}
+
+std::string ConnectionPool::key(const std::string& host, int port, bool text) {
+    return host + ":" + std::to_string(port) + (text ? "/text" : "/binary");
+}
+
+// An idle connection must have nothing to read: EOF, an error or stray bytes
+// all mean it can not carry another session
+static bool stillIdle(int fd) {
+#ifdef _WIN32
+    u_long pending = 0;
+    return ioctlsocket(fd, FIONREAD, &pending) == 0 && pending == 0;
+#else
+    char byte;
+    ssize_t n = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && socketWouldBlock();
+#endif
+}
+
+int ConnectionPool::checkout(const std::string& key, uint64_t now_ms) {
+    std::map<std::string, std::deque<Idle> >::iterator it = idle_.find(key);
+    if (it != idle_.end()) {
+        std::deque<Idle>& idle = it->second;
+
+        // Most recently used first: the least likely to have been closed by the server
+        while (!idle.empty()) {
+            Idle candidate = idle.back();
+            idle.pop_back();
+            if (now_ms - candidate.since <= max_idle_ms_ && stillIdle(candidate.fd)) {
+                reused_++;
+                return candidate.fd;
+            }
+            close(candidate.fd);
+        }
+    }
+
+    misses_++;
+    return -1;
+}
+
+void ConnectionPool::checkin(const std::string& key, int fd, uint64_t now_ms) {
+    Idle entry;
+    entry.fd = fd;
+    entry.since = now_ms;
+    idle_[key].push_back(entry);
+}
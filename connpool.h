@@ -0,0 +1,47 @@
+#ifndef CONNPOOL_H
+#define CONNPOOL_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <stdint.h>
+
+// Idle persistent TCP connections, keyed by server and API ("host:port/text").
+// A connection is checked in after a session finished its exchange on it and
+// checked out by the next session to the same server, which then skips the
+// DNS lookup, handshake and negotiation. Connections the server closed while
+// idle, or that were idle for too long, are discarded on checkout.
+class ConnectionPool {
+public:
+    // max_idle_ms should stay below the server's idle timeout
+    explicit ConnectionPool(uint64_t max_idle_ms = 5000);
+    ~ConnectionPool();
+
+    static std::string key(const std::string& host, int port, bool text);
+
+    // An idle connection for key, or -1 if there is none
+    int checkout(const std::string& key, uint64_t now_ms);
+
+    // Hand over a connection that is idle and still negotiated
+    void checkin(const std::string& key, int fd, uint64_t now_ms);
+
+    // Connections handed out again, and connections the caller had to open
+    unsigned long reused() const { return reused_; }
+    unsigned long misses() const { return misses_; }
+
+private:
+    ConnectionPool(const ConnectionPool&);
+    ConnectionPool& operator=(const ConnectionPool&);
+
+    struct Idle {
+        int fd;
+        uint64_t since;
+    };
+
+    uint64_t max_idle_ms_;
+    std::map<std::string, std::deque<Idle> > idle_;
+    unsigned long reused_;
+    unsigned long misses_;
+};
+
+#endif // CONNPOOL_H
@@ -0,0 +1,112 @@
+#ifndef CORO_H
+#define CORO_H
+
+// C++20 only: part of the coroutine client (make coclient)
+
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <utility>
+#include <stddef.h>
+
+// Coroutine frames alive right now, the bytes they hold and the most ever held
+struct CoroutineFrames {
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t live;
+};
+
+inline CoroutineFrames& coroutineFrames() {
+    static CoroutineFrames frames = { 0, 0, 0 };
+    return frames;
+}
+
+// Lazily started coroutine producing a T (default constructible). Awaiting a
+// Task starts it; when it finishes, the awaiting coroutine is resumed by
+// symmetric transfer, so chains of nested Tasks never grow the native stack.
+// A session therefore costs one heap frame per active coroutine instead of a
+// thread stack. The top level coroutine is started with start() and polled
+// with done().
+template <typename T>
+class Task {
+public:
+    struct promise_type {
+        T value;
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                std::coroutine_handle<> next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T v) { value = std::move(v); }
+        void unhandled_exception() { std::terminate(); }
+
+        // Frames are counted so the load summary can show what a session costs
+        static void* operator new(size_t size) {
+            CoroutineFrames& frames = coroutineFrames();
+            size_t* p = static_cast<size_t*>(::operator new(size + sizeof(max_align_t)));
+            *p = size;
+            frames.live_bytes += size;
+            frames.live++;
+            if (frames.live_bytes > frames.peak_bytes) {
+                frames.peak_bytes = frames.live_bytes;
+            }
+            return reinterpret_cast<char*>(p) + sizeof(max_align_t);
+        }
+        static void operator delete(void* frame) {
+            size_t* p = reinterpret_cast<size_t*>(static_cast<char*>(frame) - sizeof(max_align_t));
+            CoroutineFrames& frames = coroutineFrames();
+            frames.live_bytes -= *p;
+            frames.live--;
+            ::operator delete(p);
+        }
+    };
+
+    Task() : handle_(nullptr) {}
+    explicit Task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { destroy(); }
+
+    // Awaiting from another coroutine
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return std::move(handle_.promise().value); }
+
+    // Driving a top level coroutine: run to its first suspension point
+    void start() { handle_.resume(); }
+    bool done() const { return !handle_ || handle_.done(); }
+    const T& result() const { return handle_.promise().value; }
+
+private:
+    void destroy() {
+        if (handle_) {
+            handle_.destroy();
+            handle_ = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+#endif // CORO_H
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cosession.h"
+#include "coio.h"
+#include "session.h"
+#include "rtt.h"
+#include "calcLib.h"
+#include "textproto.h"
+#include "binproto.h"
+
+// Timeout for establishing a TCP connection
+#define CONNECT_TIMEOUT_MS 5000
+
+// How long a TCP session waits for each message or send (Session::timeoutMs())
+#define TCP_STEP_TIMEOUT_MS 5000
+
+// Results of co_await are stored before they are compared: g++ 12 lays out the
+// frame of a coroutine with "if (co_await op < 0)" wrongly and never runs it.
+
+// Does [data, data + len) contain needle?
+static bool contains(const char* data, size_t len, const char* needle) {
+    size_t needle_len = strlen(needle);
+    return std::search(data, data + len, needle, needle + needle_len) != data + len;
+}
+
+// ---------------------------------------------------------------------------
+// TCP: lines and frames out of a FrameBuffer, refilled as needed
+
+// Next line (including its '\n'); on a timeout or close prints wait_error
+static Task<bool> recvLine(CoSocket& sock, FrameBuffer& rx, const char*& line, size_t& len,
+                           const char* wait_error) {
+    while (!rx.nextLine(line, len)) {
+        size_t space;
+        char* dst = rx.prepare(space);
+        if (space == 0) {
+            printError("Message too long");
+            co_return false;
+        }
+        ssize_t n = co_await sock.recv(dst, space, TCP_STEP_TIMEOUT_MS);
+        if (n <= 0) {
+            printError(wait_error);
+            co_return false;
+        }
+        rx.commit((size_t)n);
+    }
+    co_return true;
+}
+
+// Next len byte frame; on a timeout or close prints wait_error
+static Task<bool> recvFrame(CoSocket& sock, FrameBuffer& rx, size_t len, const char*& frame,
+                            const char* wait_error) {
+    while (!rx.nextFrame(len, frame)) {
+        size_t space;
+        char* dst = rx.prepare(space);
+        if (space == 0) {
+            printError("Message too long");
+            co_return false;
+        }
+        ssize_t n = co_await sock.recv(dst, space, TCP_STEP_TIMEOUT_MS);
+        if (n <= 0) {
+            printError(wait_error);
+            co_return false;
+        }
+        rx.commit((size_t)n);
+    }
+    co_return true;
+}
+
+static Task<bool> sendAll(CoSocket& sock, const std::string& data) {
+    ssize_t sent = co_await sock.send(data.data(), data.size(), TCP_STEP_TIMEOUT_MS);
+    if (sent < 0) {
+        printError("Failed to send message to server");
+        co_return false;
+    }
+    co_return true;
+}
+
+// ---------------------------------------------------------------------------
+// TCP + TEXT
+
+static Task<bool> tcpText(CoSocket& sock) {
+    FrameBuffer rx;
+    const char* line;
+    size_t len;
+    if (!co_await recvLine(sock, rx, line, len, "Failed to receive message from server")) {
+        co_return false;
+    }
+
+    // Servers may skip negotiation and send the assignment directly
+    if (contains(line, len, " TCP ")) {
+        bool offers_text = false, offers_11 = false, offers_10 = false;
+        // The protocol list ends with an empty line
+        while ((len = lineLength(line, line + len)) > 0) {
+            offers_text = offers_text || contains(line, len, "TEXT TCP");
+            offers_11 = offers_11 || contains(line, len, "TEXT TCP 1.1");
+            offers_10 = offers_10 || contains(line, len, "TEXT TCP 1.0");
+            if (!co_await recvLine(sock, rx, line, len, "Failed to receive message from server")) {
+                co_return false;
+            }
+        }
+        if (!offers_text) {
+            printError("MISSMATCH PROTOCOL");
+            co_return false;
+        }
+
+        // Send protocol acceptance (try 1.1 first, fallback to what server offers)
+        std::string accept = offers_11 || !offers_10 ? "TEXT TCP 1.1 OK\n" : "TEXT TCP 1.0 OK\n";
+        if (!co_await sendAll(sock, accept)) {
+            co_return false;
+        }
+        if (!co_await recvLine(sock, rx, line, len, "Failed to receive assignment")) {
+            co_return false;
+        }
+    }
+
+    SolvedAssignment solved;
+    std::string answer;
+    if (!solveTextAssignment(line, len, solved, answer)) {
+        co_return false;
+    }
+    if (!co_await sendAll(sock, answer)) {
+        co_return false;
+    }
+    if (!co_await recvLine(sock, rx, line, len, "Failed to receive server response")) {
+        co_return false;
+    }
+    co_return checkTextVerdict(line, len, solved.result);
+}
+
+// ---------------------------------------------------------------------------
+// TCP + BINARY
+
+static Task<bool> tcpBinary(CoSocket& sock) {
+    static const char BINARY_11[] = "BINARY TCP 1.1";
+    FrameBuffer rx;
+    const char* line;
+    size_t len;
+
+    // Protocol list, one per line, ending with an empty line
+    bool offers_binary = false;
+    for (;;) {
+        if (!co_await recvLine(sock, rx, line, len, "Failed to receive protocol information")) {
+            co_return false;
+        }
+        len = lineLength(line, line + len);
+        if (len == 0) {
+            break;
+        }
+        size_t n = sizeof(BINARY_11) - 1;
+        offers_binary = offers_binary || (len >= n && memcmp(line + len - n, BINARY_11, n) == 0);
+    }
+    if (!offers_binary) {
+        printError("MISSMATCH PROTOCOL");
+        co_return false;
+    }
+
+    std::string accept = "BINARY TCP 1.1 OK\n";
+    if (!co_await sendAll(sock, accept)) {
+        co_return false;
+    }
+
+    const char* frame;
+    if (!co_await recvFrame(sock, rx, sizeof(calcProtocol), frame, "WRONG SIZE OR INCORRECT PROTOCOL")) {
+        co_return false;
+    }
+    SolvedAssignment solved;
+    std::string answer;
+    if (!solveBinaryAssignment(frame, solved, answer)) {
+        co_return false;
+    }
+    if (!co_await sendAll(sock, answer)) {
+        co_return false;
+    }
+    if (!co_await recvFrame(sock, rx, sizeof(calcMessage), frame, "WRONG SIZE OR INCORRECT PROTOCOL")) {
+        co_return false;
+    }
+    co_return checkBinaryVerdict(frame, solved.result);
+}
+
+// ---------------------------------------------------------------------------
+// UDP: request/reply exchanges with retransmission
+
+// Stale replies to a retransmitted earlier request, skipped while waiting
+typedef bool (*StaleReply)(const char* data, size_t len);
+
+static bool isAssignmentFrame(const char* data, size_t len) {
+    (void)data;
+    return len == sizeof(calcProtocol);
+}
+
+// Send request and wait for its reply, sending it again after every
+// retransmission timeout (RFC 6298) up to UDP_MAX_RETRANSMITS times.
+// Completes with the reply length in reply, or -1 (error printed).
+static Task<ssize_t> exchange(CoSocket& sock, EventLoop& loop, RttEstimator& rtt,
+                              const std::string& request, char* reply, size_t size, StaleReply stale) {
+    RetransmitTracker retransmit;
+    retransmit.start(&rtt, loop.now());
+    for (unsigned retransmits = 0;; retransmits++) {
+        ssize_t sent = co_await sock.send(request.data(), request.size(), TCP_STEP_TIMEOUT_MS);
+        if (sent < 0) {
+            printError("Failed to send message to server");
+            co_return -1;
+        }
+
+        uint64_t deadline = loop.now() + retransmit.timeoutMs(retransmits);
+        for (uint64_t now = loop.now(); now < deadline; now = loop.now()) {
+            ssize_t n = co_await sock.recvfrom(reply, size, nullptr, nullptr, deadline - now);
+            if (n < 0) {
+                if (!sock.timedOut()) {
+                    printError("Failed to receive message from server");
+                    co_return -1;
+                }
+                break;
+            }
+            if (stale == nullptr || !stale(reply, (size_t)n)) {
+                retransmit.onReply(loop.now());
+                co_return n;
+            }
+        }
+
+        if (retransmits == UDP_MAX_RETRANSMITS) {
+            printError("MESSAGE LOST (TIMEOUT)");
+            co_return -1;
+        }
+        retransmit.onRetransmit();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// UDP + TEXT
+
+static Task<bool> udpText(CoSocket& sock, EventLoop& loop, RttEstimator& rtt) {
+    std::string request = "TEXT UDP 1.1\n";
+    char reply[1500];
+    ssize_t n = co_await exchange(sock, loop, rtt, request, reply, sizeof(reply), nullptr);
+    SolvedAssignment solved;
+    std::string answer;
+    if (n < 0 || !solveTextAssignment(reply, (size_t)n, solved, answer)) {
+        co_return false;
+    }
+
+    // Our request was retransmitted and the server answered twice
+    n = co_await exchange(sock, loop, rtt, answer, reply, sizeof(reply), isDuplicateAssignment);
+    if (n < 0) {
+        co_return false;
+    }
+    co_return checkTextVerdict(reply, (size_t)n, solved.result);
+}
+
+// ---------------------------------------------------------------------------
+// UDP + BINARY
+
+static Task<bool> udpBinary(CoSocket& sock, EventLoop& loop, RttEstimator& rtt) {
+    std::string request;
+    appendCalcMessage(request, makeCalcMessage(0, PROTOCOL_UDP));
+    char reply[1500];
+    ssize_t n = co_await exchange(sock, loop, rtt, request, reply, sizeof(reply), nullptr);
+    if (n < 0) {
+        co_return false;
+    }
+
+    // Check if it's a calcMessage (NOT OK response)
+    if (n == sizeof(calcMessage)) {
+        calcMessage msg = decodeCalcMessage(reply);
+        if (msg.type == MSG_TYPE_CALC_MESSAGE && msg.message == 2) {
+            printError("Server sent NOT OK message");
+            co_return false;
+        }
+    }
+    SolvedAssignment solved;
+    std::string answer;
+    if (n != sizeof(calcProtocol)) {
+        printError("WRONG SIZE OR INCORRECT PROTOCOL");
+        co_return false;
+    }
+    if (!solveBinaryAssignment(reply, solved, answer)) {
+        co_return false;
+    }
+
+    // A retransmitted request may bring the assignment (or a second one) again
+    n = co_await exchange(sock, loop, rtt, answer, reply, sizeof(reply), isAssignmentFrame);
+    if (n < 0) {
+        co_return false;
+    }
+    if (n != sizeof(calcMessage)) {
+        printError("WRONG SIZE OR INCORRECT PROTOCOL");
+        co_return false;
+    }
+    co_return checkBinaryVerdict(reply, solved.result);
+}
+
+// ---------------------------------------------------------------------------
+
+static Task<bool> tcpSession(EventLoop& loop, const URLInfo& info, bool text, bool& connect_failed) {
+    std::vector<SocketAddress> addresses;
+    if (!resolveHostAll(info.host, info.port, addresses)) {
+        connect_failed = true;
+        co_return false;
+    }
+    int fd = co_await CoConnect(loop, addresses, CONNECT_TIMEOUT_MS);
+    if (fd < 0) {
+        connect_failed = true;
+        co_return false;
+    }
+    CoSocket sock(loop, fd);
+    if (text) {
+        co_return co_await tcpText(sock);
+    }
+    co_return co_await tcpBinary(sock);
+}
+
+static Task<bool> udpSession(EventLoop& loop, const URLInfo& info, bool text, bool& connect_failed) {
+    SocketAddress server;
+    int fd = createUDPSocket(info.host, info.port, server);
+    if (fd < 0) {
+        connect_failed = true;
+        co_return false;
+    }
+    CoSocket sock(loop, fd);
+    RttEstimator& rtt = rttEstimatorFor((const struct sockaddr*)&server.addr, server.len);
+    if (text) {
+        co_return co_await udpText(sock, loop, rtt);
+    }
+    co_return co_await udpBinary(sock, loop, rtt);
+}
+
+Task<bool> coSession(EventLoop& loop, const URLInfo& info, bool& connect_failed) {
+    connect_failed = false;
+
+    if (info.transport == URL_TCP) {
+        co_return co_await tcpSession(loop, info, info.text, connect_failed);
+    }
+    bool ok = co_await udpSession(loop, info, info.text, connect_failed);
+    if (ok || info.transport != URL_ANY) {
+        co_return ok;
+    }
+    // Whether the fallback could connect is what counts
+    connect_failed = false;
+    co_return co_await tcpSession(loop, info, info.text, connect_failed);
+}
@@ -0,0 +1,17 @@
+#ifndef COSESSION_H
+#define COSESSION_H
+
+// C++20 only: part of the coroutine client (make coclient)
+
+#include "client.h"
+#include "coro.h"
+#include "eventloop.h"
+
+// One complete session for the given URL as a single coroutine on loop: the
+// same protocol steps as the Session state machines, written top to bottom.
+// ANY tries UDP first and falls back to TCP if UDP gets no answer.
+// Completes with true if the server accepted the result; connect_failed is
+// set when no session could be started at all.
+Task<bool> coSession(EventLoop& loop, const URLInfo& info, bool& connect_failed);
+
+#endif // COSESSION_H
@@ -0,0 +1,296 @@
+#include <chrono>
+
+#include "eventloop.h"
+
+#ifdef __linux__
+    #include <sys/epoll.h>
+    #include <unistd.h>
+    #include <errno.h>
+#elif defined(_WIN32)
+    #include <winsock2.h>
+    #define poll WSAPoll
+#else
+    #include <poll.h>
+#endif
+
+// Maximum number of readiness events collected per wait
+#define MAX_EVENTS 256
+
+// ---------------------------------------------------------------------------
+// TimerWheel
+
+static void unlinkTimer(Timer* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+}
+
+static void linkTimer(Timer* head, Timer* timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+TimerWheel::TimerWheel(size_t slots) : slots_(slots), current_(0), count_(0) {
+    for (size_t i = 0; i < slots_.size(); i++) {
+        slots_[i].prev = &slots_[i];
+        slots_[i].next = &slots_[i];
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    // Leave any still-armed timers in a consistent (disarmed) state
+    for (size_t i = 0; i < slots_.size(); i++) {
+        while (slots_[i].next != &slots_[i]) {
+            unlinkTimer(slots_[i].next);
+        }
+    }
+}
+
+void TimerWheel::schedule(Timer* timer, uint64_t deadline) {
+    cancel(timer);
+    timer->deadline = deadline;
+
+    // Anything already due is picked up by the next advance()
+    uint64_t tick = deadline > current_ ? deadline : current_ + 1;
+    linkTimer(&slots_[tick % slots_.size()], timer);
+    count_++;
+}
+
+void TimerWheel::cancel(Timer* timer) {
+    if (timer->armed()) {
+        unlinkTimer(timer);
+        count_--;
+    }
+}
+
+void TimerWheel::advance(uint64_t now) {
+    if (now <= current_) {
+        return;
+    }
+
+    // Collect expired timers first so handlers may freely arm or cancel timers
+    Timer due;
+    due.prev = &due;
+    due.next = &due;
+
+    uint64_t ticks = now - current_;
+    if (ticks > slots_.size()) {
+        ticks = slots_.size();
+    }
+    for (uint64_t i = 1; i <= ticks; i++) {
+        Timer* head = &slots_[(current_ + i) % slots_.size()];
+        Timer* timer = head->next;
+        while (timer != head) {
+            Timer* next = timer->next;
+            if (timer->deadline <= now) {
+                unlinkTimer(timer);
+                linkTimer(&due, timer);
+            }
+            timer = next;
+        }
+    }
+    current_ = now;
+
+    while (due.next != &due) {
+        Timer* timer = due.next;
+        unlinkTimer(timer);
+        count_--;
+        timer->handler->onTimer();
+    }
+}
+
+int TimerWheel::nextTimeout(uint64_t now) const {
+    if (count_ == 0) {
+        return -1;
+    }
+
+    // The earliest timer can not fire before the next non-empty slot comes up
+    for (uint64_t tick = current_ + 1; tick <= current_ + slots_.size(); tick++) {
+        const Timer* head = &slots_[tick % slots_.size()];
+        if (head->next != head) {
+            return tick > now ? (int)(tick - now) : 0;
+        }
+    }
+    return (int)slots_.size();
+}
+
+// ---------------------------------------------------------------------------
+// EventLoop
+
+EventLoop::EventLoop() : now_(0), stopped_(false) {
+#ifdef __linux__
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+#endif
+    updateClock();
+    timers_.advance(now_);
+}
+
+EventLoop::~EventLoop() {
+    reap();
+#ifdef __linux__
+    if (epfd_ >= 0) {
+        close(epfd_);
+    }
+#endif
+}
+
+bool EventLoop::valid() const {
+#ifdef __linux__
+    return epfd_ >= 0;
+#else
+    return true;
+#endif
+}
+
+#ifdef __linux__
+static uint32_t toEpoll(uint32_t events) {
+    uint32_t result = 0;
+    if (events & EV_READ) result |= EPOLLIN;
+    if (events & EV_WRITE) result |= EPOLLOUT;
+    return result;
+}
+
+bool EventLoop::add(int fd, uint32_t events, EventHandler* handler) {
+    struct epoll_event ev;
+    ev.events = toEpoll(events);
+    ev.data.ptr = handler;
+    return epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool EventLoop::modify(int fd, uint32_t events, EventHandler* handler) {
+    struct epoll_event ev;
+    ev.events = toEpoll(events);
+    ev.data.ptr = handler;
+    return epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::remove(int fd) {
+    struct epoll_event ev;
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, &ev);
+}
+#else
+bool EventLoop::add(int fd, uint32_t events, EventHandler* handler) {
+    fds_.push_back(fd);
+    interest_.push_back(events);
+    handlers_.push_back(handler);
+    return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events, EventHandler* handler) {
+    for (size_t i = 0; i < fds_.size(); i++) {
+        if (fds_[i] == fd) {
+            interest_[i] = events;
+            handlers_[i] = handler;
+            return true;
+        }
+    }
+    return false;
+}
+
+void EventLoop::remove(int fd) {
+    for (size_t i = 0; i < fds_.size(); i++) {
+        if (fds_[i] == fd) {
+            fds_[i] = fds_.back();
+            interest_[i] = interest_.back();
+            handlers_[i] = handlers_.back();
+            fds_.pop_back();
+            interest_.pop_back();
+            handlers_.pop_back();
+            return;
+        }
+    }
+}
+#endif
+
+void EventLoop::addTimer(Timer* timer, uint64_t delay_ms) {
+    timers_.schedule(timer, now_ + delay_ms);
+}
+
+void EventLoop::removePrepareHandler(PrepareHandler* handler) {
+    for (size_t i = 0; i < prepare_.size(); i++) {
+        if (prepare_[i] == handler) {
+            prepare_.erase(prepare_.begin() + i);
+            return;
+        }
+    }
+}
+
+void EventLoop::deleteLater(EventHandler* handler) {
+    graveyard_.push_back(handler);
+}
+
+void EventLoop::updateClock() {
+    now_ = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void EventLoop::reap() {
+    // Destructors may queue more handlers, so swap the list out first
+    while (!graveyard_.empty()) {
+        std::vector<EventHandler*> dead;
+        dead.swap(graveyard_);
+        for (size_t i = 0; i < dead.size(); i++) {
+            delete dead[i];
+        }
+    }
+}
+
+void EventLoop::runOnce(int max_wait_ms) {
+    for (size_t i = 0; i < prepare_.size(); i++) {
+        prepare_[i]->onPrepare();
+    }
+
+    updateClock();
+    int timeout = timers_.nextTimeout(now_);
+    if (max_wait_ms >= 0 && (timeout < 0 || timeout > max_wait_ms)) {
+        timeout = max_wait_ms;
+    }
+
+#ifdef __linux__
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(epfd_, events, MAX_EVENTS, timeout);
+    updateClock();
+    for (int i = 0; i < n; i++) {
+        uint32_t flags = 0;
+        if (events[i].events & EPOLLIN) flags |= EV_READ;
+        if (events[i].events & EPOLLOUT) flags |= EV_WRITE;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= EV_ERROR | EV_READ;
+        static_cast<EventHandler*>(events[i].data.ptr)->onEvent(flags);
+    }
+#else
+    std::vector<struct pollfd> pfds(fds_.size());
+    std::vector<EventHandler*> handlers(handlers_);
+    for (size_t i = 0; i < fds_.size(); i++) {
+        pfds[i].fd = fds_[i];
+        pfds[i].events = 0;
+        if (interest_[i] & EV_READ) pfds[i].events |= POLLIN;
+        if (interest_[i] & EV_WRITE) pfds[i].events |= POLLOUT;
+        pfds[i].revents = 0;
+    }
+    int n = poll(pfds.empty() ? nullptr : &pfds[0], pfds.size(), timeout);
+    updateClock();
+    for (size_t i = 0; n > 0 && i < pfds.size(); i++) {
+        if (pfds[i].revents == 0) {
+            continue;
+        }
+        uint32_t flags = 0;
+        if (pfds[i].revents & POLLIN) flags |= EV_READ;
+        if (pfds[i].revents & POLLOUT) flags |= EV_WRITE;
+        if (pfds[i].revents & (POLLERR | POLLHUP)) flags |= EV_ERROR | EV_READ;
+        handlers[i]->onEvent(flags);
+    }
+#endif
+
+    timers_.advance(now_);
+    reap();
+}
+
+void EventLoop::run() {
+    stopped_ = false;
+    while (!stopped_) {
+        runOnce();
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Readiness flags passed to EventHandler::onEvent
+#define EV_READ  0x1
+#define EV_WRITE 0x2
+#define EV_ERROR 0x4
+
+// Receives readiness notifications for one registered socket
+class EventHandler {
+public:
+    virtual ~EventHandler() {}
+    virtual void onEvent(uint32_t events) = 0;
+};
+
+// Receives expiry notifications for a Timer
+class TimerHandler {
+public:
+    virtual ~TimerHandler() {}
+    virtual void onTimer() = 0;
+};
+
+// Called at the start of every loop iteration, before waiting for events.
+// Used to flush output that handlers batched up during the previous round.
+class PrepareHandler {
+public:
+    virtual ~PrepareHandler() {}
+    virtual void onPrepare() = 0;
+};
+
+// Timer entry embedded in the object that owns it. While armed it is linked
+// into one slot of the TimerWheel, so arming and cancelling never allocate.
+struct Timer {
+    Timer* prev;
+    Timer* next;
+    uint64_t deadline;      // Absolute expiry time in loop milliseconds
+    TimerHandler* handler;
+
+    explicit Timer(TimerHandler* h = nullptr) : prev(nullptr), next(nullptr), deadline(0), handler(h) {}
+    bool armed() const { return prev != nullptr; }
+};
+
+// Hashed timer wheel with one millisecond ticks. Timers further away than one
+// revolution stay in their slot and are skipped until their deadline is reached.
+class TimerWheel {
+public:
+    explicit TimerWheel(size_t slots = 1024);
+    ~TimerWheel();
+
+    void schedule(Timer* timer, uint64_t deadline);
+    void cancel(Timer* timer);
+
+    // Fire every timer whose deadline is <= now
+    void advance(uint64_t now);
+
+    // Milliseconds until the next slot holding a timer comes up, -1 if no timers are armed
+    int nextTimeout(uint64_t now) const;
+
+    size_t size() const { return count_; }
+
+private:
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+
+    std::vector<Timer> slots_;  // Sentinel list heads
+    uint64_t current_;          // Last tick that has been processed
+    size_t count_;
+};
+
+// Single-threaded readiness loop: epoll on Linux, poll() elsewhere. Handlers
+// are registered per socket and timers are driven by the TimerWheel instead of
+// socket timeout options.
+class EventLoop {
+public:
+    EventLoop();
+    ~EventLoop();
+
+    bool valid() const;
+
+    bool add(int fd, uint32_t events, EventHandler* handler);
+    bool modify(int fd, uint32_t events, EventHandler* handler);
+    void remove(int fd);
+
+    void addTimer(Timer* timer, uint64_t delay_ms);
+    void cancelTimer(Timer* timer) { timers_.cancel(timer); }
+
+    void addPrepareHandler(PrepareHandler* handler) { prepare_.push_back(handler); }
+    void removePrepareHandler(PrepareHandler* handler);
+
+    // Destroy a handler once the current dispatch round is over, so events that
+    // were already collected for it in this round are still delivered safely
+    void deleteLater(EventHandler* handler);
+
+    // Cached monotonic time in milliseconds, refreshed every loop iteration
+    uint64_t now() const { return now_; }
+
+    // Wait at most max_wait_ms (-1 = until the next timer) and dispatch events and timers
+    void runOnce(int max_wait_ms = -1);
+
+    // Run until stop() is called
+    void run();
+    void stop() { stopped_ = true; }
+
+private:
+    EventLoop(const EventLoop&);
+    EventLoop& operator=(const EventLoop&);
+
+    void updateClock();
+    void reap();
+
+#ifdef __linux__
+    int epfd_;
+#else
+    std::vector<int> fds_;
+    std::vector<uint32_t> interest_;
+    std::vector<EventHandler*> handlers_;
+#endif
+    TimerWheel timers_;
+    std::vector<PrepareHandler*> prepare_;
+    std::vector<EventHandler*> graveyard_;
+    uint64_t now_;
+    bool stopped_;
+};
+
+#endif // EVENTLOOP_H
@@ -0,0 +1,90 @@
+#include <cstring>
+
+#include "framebuf.h"
+#include "client.h"
+
+FrameBuffer::FrameBuffer(size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1), begin_(0), end_(0), scanned_(0) {
+}
+
+char* FrameBuffer::prepare(size_t& space) {
+    if (buf_.empty()) {
+        buf_.resize(capacity_);
+    }
+
+    if (begin_ == end_) {
+        begin_ = end_ = 0;
+    } else if (begin_ > 0 && capacity_ - end_ < capacity_ / 4) {
+        // Running out of tail room: slide the partial message to the front
+        memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+
+    space = capacity_ - end_;
+    return buf_.data() + end_;
+}
+
+bool FrameBuffer::append(const char* data, size_t len) {
+    while (len > 0) {
+        size_t space;
+        char* dst = prepare(space);
+        if (space == 0) {
+            return false;
+        }
+        size_t n = len < space ? len : space;
+        memcpy(dst, data, n);
+        commit(n);
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+long FrameBuffer::readFrom(int fd) {
+    size_t space;
+    char* dst = prepare(space);
+    if (space == 0) {
+#ifdef ENOBUFS
+        errno = ENOBUFS;
+#endif
+        return -1;
+    }
+
+    long n = (long)recv(fd, dst, space, 0);
+    if (n > 0) {
+        commit((size_t)n);
+    }
+    return n;
+}
+
+bool FrameBuffer::nextLine(const char*& line, size_t& len) {
+    if (empty()) {
+        return false;
+    }
+    const char* start = data();
+    const char* eol = (const char*)memchr(start + scanned_, '\n', size() - scanned_);
+    if (eol == nullptr) {
+        scanned_ = size();
+        return false;
+    }
+
+    line = start;
+    len = (size_t)(eol - start) + 1;
+    consume(len);
+    return true;
+}
+
+bool FrameBuffer::nextFrame(size_t len, const char*& frame) {
+    if (size() < len || len == 0) {
+        return false;
+    }
+    frame = data();
+    consume(len);
+    return true;
+}
+
+void FrameBuffer::consume(size_t len) {
+    begin_ += len;
+    scanned_ = scanned_ > len ? scanned_ - len : 0;
+}
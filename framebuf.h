@@ -0,0 +1,53 @@
+#ifndef FRAMEBUF_H
+#define FRAMEBUF_H
+
+#include <stddef.h>
+#include <vector>
+
+// Receive buffer for one stream connection. Bytes are read in bulk and handed
+// out as complete newline-terminated lines or fixed-size frames; whatever is
+// left over stays buffered for the next message. Consumed space is reclaimed
+// by sliding the remainder to the front, so every line and frame is contiguous
+// and can be parsed in place.
+//
+// Pointers returned by nextLine()/nextFrame()/data() stay valid until the next
+// prepare(), append() or readFrom().
+class FrameBuffer {
+public:
+    explicit FrameBuffer(size_t capacity = 4096);
+
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+    const char* data() const { return buf_.data() + begin_; }
+
+    // No room left for more data: the pending message is longer than the capacity
+    bool full() const { return begin_ == 0 && end_ == capacity_; }
+
+    // Free space to receive into (0 if full); commit() what was written
+    char* prepare(size_t& space);
+    void commit(size_t len) { end_ += len; }
+
+    // Copy bytes in; false if they do not fit
+    bool append(const char* data, size_t len);
+
+    // One recv() into the free space: >0 bytes read, 0 on EOF, <0 on error
+    // (including EAGAIN). Fails with ENOBUFS if the buffer is full.
+    long readFrom(int fd);
+
+    // Remove and return the next line including its '\n'
+    bool nextLine(const char*& line, size_t& len);
+
+    // Remove and return the next len bytes
+    bool nextFrame(size_t len, const char*& frame);
+
+    void consume(size_t len);
+
+private:
+    std::vector<char> buf_;     // Allocated on first use
+    size_t capacity_;
+    size_t begin_;              // First unconsumed byte
+    size_t end_;                // One past the last received byte
+    size_t scanned_;            // Bytes from begin_ already known to hold no '\n'
+};
+
+#endif // FRAMEBUF_H
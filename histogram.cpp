@@ -0,0 +1,84 @@
+#include <cmath>
+
+#include "histogram.h"
+
+LatencyHistogram::LatencyHistogram() : count_(0), min_(UINT64_MAX), max_(0), sum_(0.0) {
+}
+
+// Bucket b >= 2 * SUB covers [sub << shift, (sub + 1) << shift) with
+// shift = b / SUB - 1 and sub = b - SUB * shift, sub in [SUB, 2 * SUB)
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    unsigned top_bit = 63 - (unsigned)__builtin_clzll(value);
+    unsigned shift = top_bit - HISTOGRAM_SUB_BUCKET_BITS;
+    return (size_t)HISTOGRAM_SUB_BUCKETS * shift + (size_t)(value >> shift);
+}
+
+uint64_t LatencyHistogram::highestValueIn(size_t bucket) {
+    if (bucket < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned shift = (unsigned)(bucket / HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t sub = bucket - (uint64_t)HISTOGRAM_SUB_BUCKETS * shift;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    size_t bucket = bucketOf(value);
+    if (bucket >= counts_.size()) {
+        counts_.resize(bucket + 1, 0);
+    }
+    counts_[bucket]++;
+    count_++;
+    sum_ += (double)value;
+    if (value < min_) {
+        min_ = value;
+    }
+    if (value > max_) {
+        max_ = value;
+    }
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other.counts_.size() > counts_.size()) {
+        counts_.resize(other.counts_.size(), 0);
+    }
+    for (size_t i = 0; i < other.counts_.size(); i++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    if (other.min_ < min_) {
+        min_ = other.min_;
+    }
+    if (other.max_ > max_) {
+        max_ = other.max_;
+    }
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+    if (count_ == 0) {
+        return 0;
+    }
+
+    // Rank of the value wanted, 1-based
+    uint64_t rank = (uint64_t)std::ceil(percent / 100.0 * (double)count_);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > count_) {
+        rank = count_;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            // The bucket bound may lie past what was actually recorded
+            uint64_t value = highestValueIn(i);
+            return value < max_ ? (value > min_ ? value : min_) : max_;
+        }
+    }
+    return max_;
+}
@@ -0,0 +1,43 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <vector>
+#include <stdint.h>
+
+// Log-linear histogram of non-negative values, in the style of HdrHistogram.
+// Values below 2 * HISTOGRAM_SUB_BUCKETS are counted exactly; above that every
+// power of two is split into HISTOGRAM_SUB_BUCKETS equal buckets, so reported
+// percentiles are within 1 / HISTOGRAM_SUB_BUCKETS (< 0.8%) of the true value.
+// Recording is O(1) and never allocates once the largest bucket seen so far
+// exists.
+#define HISTOGRAM_SUB_BUCKET_BITS 7
+#define HISTOGRAM_SUB_BUCKETS (1u << HISTOGRAM_SUB_BUCKET_BITS)
+
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ > 0 ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ > 0 ? sum_ / count_ : 0.0; }
+
+    // Smallest recorded value (at bucket resolution) that percent% of all
+    // recorded values are less than or equal to; 0 if nothing was recorded
+    uint64_t percentile(double percent) const;
+
+    static size_t bucketOf(uint64_t value);
+    static uint64_t highestValueIn(size_t bucket);
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t min_;
+    uint64_t max_;
+    double sum_;
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,510 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+    #include <sys/resource.h>
+#endif
+#ifdef __linux__
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+#include "loadgen.h"
+#include "asyncsession.h"
+#include "uring.h"
+#include "udpmux.h"
+#include "pipeline.h"
+#include "resolver.h"
+#include "timing.h"
+#include "output.h"
+#include "stats.h"
+
+// I/O backend the load generator drives its sessions with
+class LoadBackend {
+public:
+    virtual ~LoadBackend() {}
+    virtual bool valid() const { return true; }
+    // Returns nullptr if the session could not be started
+    virtual SessionDriver* launch(Session* session, const std::string& host, int port,
+                                  SessionObserver* observer) = 0;
+    virtual void release(SessionDriver* session) = 0;
+    virtual void runOnce() = 0;
+
+    // Persistent connection pool, if the backend keeps one
+    virtual const ConnectionPool* pool() const { return nullptr; }
+};
+
+class EpollBackend : public LoadBackend {
+public:
+    explicit EpollBackend(bool persistent) : pool_(persistent ? new ConnectionPool() : nullptr) {}
+
+    ~EpollBackend() {
+        delete pool_;
+    }
+
+    bool valid() const override { return loop_.valid(); }
+
+    SessionDriver* launch(Session* session, const std::string& host, int port,
+                          SessionObserver* observer) override {
+        bool tcp = !session->isDatagram();
+        AsyncSession* driver = new AsyncSession(loop_, session, observer);
+        driver->usePool(pool_);
+        if (!(tcp ? driver->startTCP(host, port) : driver->startUDP(host, port))) {
+            delete driver;
+            return nullptr;
+        }
+        return driver;
+    }
+
+    void release(SessionDriver* session) override {
+        loop_.deleteLater(static_cast<AsyncSession*>(session));
+    }
+
+    void runOnce() override { loop_.runOnce(); }
+
+    const ConnectionPool* pool() const override { return pool_; }
+
+protected:
+    EventLoop loop_;
+    ConnectionPool* pool_;
+};
+
+// UDP sessions share sockets through a UdpMux (sendmmsg/recvmmsg); TCP
+// sessions, e.g. ANY-mode fallbacks, are driven like in EpollBackend
+class MmsgBackend : public EpollBackend {
+public:
+    MmsgBackend(unsigned sessions_per_socket, bool persistent)
+        : EpollBackend(persistent), per_socket_(sessions_per_socket), mux_(nullptr), resolve_failed_(false) {}
+
+    ~MmsgBackend() {
+        delete mux_;
+    }
+
+    SessionDriver* launch(Session* session, const std::string& host, int port,
+                          SessionObserver* observer) override {
+        if (!session->isDatagram()) {
+            return EpollBackend::launch(session, host, port, observer);
+        }
+
+        // All sessions go to the same server, so resolve it once
+        if (mux_ == nullptr && !resolve_failed_) {
+            struct sockaddr_storage addr;
+            socklen_t addr_len;
+            if (resolveHost(host, port, addr, addr_len)) {
+                mux_ = new UdpMux(loop_, addr, addr_len, per_socket_);
+            } else {
+                resolve_failed_ = true;
+            }
+        }
+        if (mux_ == nullptr) {
+            delete session;
+            return nullptr;
+        }
+        return mux_->start(session, observer);
+    }
+
+    void release(SessionDriver* session) override {
+        if (session->isTCP()) {
+            EpollBackend::release(session);
+        } else {
+            mux_->release(static_cast<MuxSession*>(session));
+        }
+    }
+
+private:
+    unsigned per_socket_;
+    UdpMux* mux_;
+    bool resolve_failed_;
+};
+
+#ifdef HAVE_IO_URING
+class UringBackend : public LoadBackend {
+public:
+    explicit UringBackend(unsigned slots) : loop_(slots) {}
+
+    bool valid() const override { return loop_.valid(); }
+
+    SessionDriver* launch(Session* session, const std::string& host, int port,
+                          SessionObserver* observer) override {
+        return loop_.start(session, host, port, observer);
+    }
+
+    void release(SessionDriver* session) override {
+        loop_.release(static_cast<UringSession*>(session));
+    }
+
+    void runOnce() override { loop_.runOnce(); }
+
+private:
+    UringLoop loop_;
+};
+#endif
+
+static LoadBackend* createBackend(const LoadOptions& opts) {
+#ifdef HAVE_IO_URING
+    if (opts.backend == IO_BACKEND_URING) {
+        // ANY mode can briefly hold a draining UDP attempt and its TCP fallback
+        return new UringBackend((unsigned)opts.concurrency * 2);
+    }
+#endif
+    if (opts.backend == IO_BACKEND_MMSG) {
+        return new MmsgBackend((unsigned)opts.udp_sessions_per_socket, opts.persistent);
+    }
+    return new EpollBackend(opts.persistent);
+}
+
+// Keeps opts.concurrency sessions in flight on one event loop, starting a new
+// session whenever one finishes
+class LoadGenerator : public SessionObserver {
+public:
+    LoadGenerator(LoadBackend& backend, const URLInfo& info, const LoadOptions& opts)
+        : backend_(backend), info_(info), opts_(opts), started_(0), finished_(0), ok_(0), errors_(0), connect_failures_(0),
+          pipelined_(0), depth_weighted_(0), max_depth_(0) {
+        any_ = info.transport == URL_ANY;
+        tcp_ = info.transport == URL_TCP;
+        text_ = info.text;
+
+        // Pipelining is TCP only; spread the sessions evenly over the connections
+        if (opts_.pipeline_depth > 0) {
+            any_ = false;
+            tcp_ = true;
+        }
+        per_connection_ = (opts_.sessions + opts_.concurrency - 1) / opts_.concurrency;
+    }
+
+    void run() {
+        int initial = opts_.concurrency < opts_.sessions ? opts_.concurrency : opts_.sessions;
+        for (int i = 0; i < initial; i++) {
+            startNext();
+        }
+        while (finished_ < opts_.sessions) {
+            backend_.runOnce();
+        }
+    }
+
+    void onSessionDone(SessionDriver* session) override {
+        std::map<SessionDriver*, Pipelined>::iterator pipelined = pipelines_.find(session);
+        if (pipelined != pipelines_.end()) {
+            recordPipeline(pipelined->second, session->connectFailed());
+            pipelines_.erase(pipelined);
+            backend_.release(session);
+            startNext();
+            return;
+        }
+
+        // ANY mode: a failed UDP attempt falls back to TCP within the same session
+        if (any_ && !session->ok() && !session->isTCP()) {
+            backend_.release(session);
+            if (!launch(true)) {
+                record(false, true);
+                startNext();
+            }
+            return;
+        }
+
+        record(session->ok(), session->connectFailed());
+        backend_.release(session);
+        startNext();
+    }
+
+    int ok() const { return ok_; }
+    int errors() const { return errors_; }
+    int connectFailures() const { return connect_failures_; }
+
+    // Pipelined mode: verdicts received, and outstanding requests per verdict on average and at most
+    unsigned long pipelined() const { return pipelined_; }
+    double meanDepth() const { return pipelined_ > 0 ? depth_weighted_ / pipelined_ : 0.0; }
+    unsigned maxDepth() const { return max_depth_; }
+
+private:
+    // A pipelined connection and the number of sessions it was given
+    struct Pipelined {
+        PipelineSession* session;
+        int assignments;
+    };
+
+    void startNext() {
+        if (opts_.pipeline_depth > 0) {
+            startPipeline();
+            return;
+        }
+
+        // Sessions that fail synchronously are recorded right away; keep going
+        while (started_ < opts_.sessions) {
+            started_++;
+            if (launch(tcp_)) {
+                return;
+            }
+            if (any_ && launch(true)) {
+                return;
+            }
+            record(false, true);
+        }
+    }
+
+    bool launch(bool tcp) {
+        return backend_.launch(createSession(tcp, text_), info_.host, info_.port, this) != nullptr;
+    }
+
+    void startPipeline() {
+        while (started_ < opts_.sessions) {
+            Pipelined p;
+            p.assignments = std::min(per_connection_, opts_.sessions - started_);
+            p.session = new PipelineSession(text_, (unsigned)p.assignments, (unsigned)opts_.pipeline_depth);
+            started_ += p.assignments;
+
+            SessionDriver* driver = backend_.launch(p.session, info_.host, info_.port, this);
+            if (driver != nullptr) {
+                pipelines_[driver] = p;
+                return;
+            }
+            // The backend deleted the session
+            p.session = nullptr;
+            recordPipeline(p, true);
+        }
+    }
+
+    // Every assignment without an OK verdict counts as a failed session
+    void recordPipeline(const Pipelined& p, bool connect_failed) {
+        int ok = p.session != nullptr ? (int)p.session->succeeded() : 0;
+        for (int i = 0; i < p.assignments; i++) {
+            record(i < ok, connect_failed);
+        }
+        if (p.session != nullptr) {
+            pipelined_ += p.session->completed();
+            depth_weighted_ += p.session->meanDepth() * p.session->completed();
+            max_depth_ = std::max(max_depth_, p.session->maxDepth());
+        }
+    }
+
+    void record(bool ok, bool connect_failed) {
+        finished_++;
+        if (ok) {
+            ok_++;
+        } else {
+            errors_++;
+            if (connect_failed) {
+                connect_failures_++;
+            }
+        }
+    }
+
+    LoadBackend& backend_;
+    const URLInfo& info_;
+    const LoadOptions& opts_;
+    bool any_;
+    bool tcp_;
+    bool text_;
+    int started_;
+    int finished_;
+    int ok_;
+    int errors_;
+    int connect_failures_;
+    int per_connection_;
+    std::map<SessionDriver*, Pipelined> pipelines_;
+    unsigned long pipelined_;
+    double depth_weighted_;
+    unsigned max_depth_;
+};
+
+static const char* backendName(IOBackend backend) {
+    switch (backend) {
+        case IO_BACKEND_URING: return "io_uring";
+        case IO_BACKEND_MMSG:  return "epoll+mmsg";
+        default:               return "epoll";
+    }
+}
+
+// Every in-flight session holds a socket, so allow as many as the hard limit permits
+static void raiseFileLimit() {
+#ifndef _WIN32
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+// CPUs this process may run on, in ascending order; empty if unknown
+static std::vector<int> usableCpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
+
+// Pin the calling thread to one CPU; best effort
+static void pinToCpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+// One load generator thread and everything it owns. Nothing is shared with
+// other workers while they run; results are read after join.
+struct LoadWorker {
+    LoadOptions opts;       // This worker's share of sessions and concurrency
+    unsigned index;
+    int cpu;                // -1: do not pin
+    bool timed;             // Record phase timings into timings
+    bool valid;
+    int ok;
+    int errors;
+    int connect_failures;
+    unsigned long pipelined;
+    double depth_weighted;
+    unsigned max_depth;
+    unsigned long reused;
+    unsigned long opened;
+    TimingReport timings;
+};
+
+static void runWorker(const URLInfo& info, LoadWorker& w) {
+    if (w.cpu >= 0) {
+        pinToCpu(w.cpu);
+    }
+    TimingReport* previous_timings = session_timings;
+    session_timings = w.timed ? &w.timings : nullptr;
+    StatsSlot* previous_slot = stats_slot;
+    stats_slot = statsSlot(w.index);
+
+    LoadBackend* backend = createBackend(w.opts);
+    w.valid = backend->valid();
+    if (w.valid) {
+        LoadGenerator generator(*backend, info, w.opts);
+        generator.run();
+        w.ok = generator.ok();
+        w.errors = generator.errors();
+        w.connect_failures = generator.connectFailures();
+        w.pipelined = generator.pipelined();
+        w.depth_weighted = generator.meanDepth() * generator.pipelined();
+        w.max_depth = generator.maxDepth();
+        if (backend->pool() != nullptr) {
+            w.reused = backend->pool()->reused();
+            w.opened = backend->pool()->misses();
+        }
+    }
+    delete backend;
+    flushOutput();
+    session_timings = previous_timings;
+    stats_slot = previous_slot;
+}
+
+bool runLoadGenerator(const URLInfo& info, const LoadOptions& opts) {
+    // Resolve while the backend is set up; sessions then only hit the cache
+    ResolverCache& resolver = ResolverCache::instance();
+    resolver.prefetch(info.host);
+    raiseFileLimit();
+
+    // Every worker needs at least one session in flight
+    std::vector<int> cpus = usableCpus();
+    int workers = opts.workers > 0 ? opts.workers : (cpus.empty() ? 1 : (int)cpus.size());
+    workers = std::min(workers, std::min(opts.concurrency, opts.sessions));
+
+    std::vector<LoadWorker> shards((size_t)workers);
+    for (int i = 0; i < workers; i++) {
+        LoadWorker& w = shards[(size_t)i];
+        w.opts = opts;
+        w.index = (unsigned)i;
+        w.opts.sessions = opts.sessions / workers + (i < opts.sessions % workers ? 1 : 0);
+        w.opts.concurrency = opts.concurrency / workers + (i < opts.concurrency % workers ? 1 : 0);
+        // A single worker stays on the calling thread, unpinned
+        w.cpu = workers > 1 && !cpus.empty() ? cpus[(size_t)i % cpus.size()] : -1;
+        w.timed = session_timings != nullptr;
+        w.valid = false;
+        w.ok = w.errors = w.connect_failures = 0;
+        w.pipelined = w.reused = w.opened = 0;
+        w.depth_weighted = 0.0;
+        w.max_depth = 0;
+    }
+
+    // Per-session output would dominate the run time, only the summary is
+    // printed (and the records, with -o)
+    bool was_quiet = quiet_mode;
+    quiet_mode = true;
+
+    auto start = std::chrono::steady_clock::now();
+    if (workers == 1) {
+        runWorker(info, shards[0]);
+    } else {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < workers; i++) {
+            threads.push_back(std::thread(runWorker, std::cref(info), std::ref(shards[(size_t)i])));
+        }
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    quiet_mode = was_quiet;
+
+    int ok = 0, errors = 0, connect_failures = 0;
+    unsigned long pipelined = 0, reused = 0, opened = 0;
+    double depth_weighted = 0.0;
+    unsigned max_depth = 0;
+    for (size_t i = 0; i < shards.size(); i++) {
+        const LoadWorker& w = shards[i];
+        if (!w.valid) {
+            printError("Failed to set up the I/O backend");
+            return false;
+        }
+        ok += w.ok;
+        errors += w.errors;
+        connect_failures += w.connect_failures;
+        pipelined += w.pipelined;
+        depth_weighted += w.depth_weighted;
+        max_depth = std::max(max_depth, w.max_depth);
+        reused += w.reused;
+        opened += w.opened;
+        if (session_timings != nullptr) {
+            session_timings->merge(w.timings);
+        }
+    }
+
+    int concurrency = opts.concurrency < opts.sessions ? opts.concurrency : opts.sessions;
+    std::cout << "Sessions: " << opts.sessions << " (concurrency " << concurrency << ", "
+              << backendName(opts.backend);
+    if (workers > 1) {
+        std::cout << ", " << workers << " workers";
+    }
+    std::cout << ")" << std::endl;
+    if (opts.pipeline_depth > 0) {
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Pipeline: depth " << opts.pipeline_depth << ", achieved mean "
+                  << (pipelined > 0 ? depth_weighted / pipelined : 0.0)
+                  << ", max " << max_depth << std::endl;
+    }
+    std::cout << "OK: " << ok << ", ERROR: " << errors
+              << " (" << connect_failures << " connect failures)" << std::endl;
+    std::cout << std::fixed << std::setprecision(3)
+              << "Elapsed: " << elapsed << " s, "
+              << std::setprecision(1) << (elapsed > 0 ? opts.sessions / elapsed : 0.0)
+              << " sessions/sec" << std::endl;
+    if (opts.persistent) {
+        std::cout << "TCP connections: " << opened << " opened, " << reused << " reused" << std::endl;
+    }
+    std::cout << "DNS: " << resolver.lookups() << " lookups, " << resolver.hits() << " cache hits" << std::endl;
+
+    return errors == 0;
+}
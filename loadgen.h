@@ -0,0 +1,36 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include "client.h"
+
+// I/O backend used by the load generator (-b)
+enum IOBackend {
+    IO_BACKEND_EPOLL,
+    IO_BACKEND_URING,  // Only available when built with IO_URING=raw or IO_URING=liburing
+    IO_BACKEND_MMSG    // epoll, with UDP sessions multiplexed over shared sockets
+};
+
+// Options for the multi-session load generator mode (-n/-c)
+struct LoadOptions {
+    int sessions;     // Total number of sessions to run
+    int concurrency;  // Number of sessions in flight at the same time
+    IOBackend backend;
+    int udp_sessions_per_socket;  // Binary UDP sessions sharing one socket with IO_BACKEND_MMSG
+    bool persistent;  // Reuse TCP connections between sessions (-k); not with IO_BACKEND_URING
+    int pipeline_depth;  // > 0: run the sessions as pipelined assignments over TCP (-p); not with IO_BACKEND_URING
+    int workers;      // Threads, each with its own backend and share of sessions (-w); 0 = one per CPU
+};
+
+// Run opts.sessions sessions against the URL inside this process, keeping
+// opts.concurrency of them in flight. Sessions and concurrency are split
+// evenly over opts.workers threads, each pinned to a CPU and running its own
+// event loop, sockets and statistics; the statistics are merged once all
+// workers are done. Prints sessions/sec and OK/ERROR counts when done.
+// Returns true if every session succeeded.
+//
+// With opts.pipeline_depth each of the opts.concurrency TCP connections runs
+// its share of the sessions as pipelined assignments with up to that many
+// outstanding; the achieved depth is reported as well.
+bool runLoadGenerator(const URLInfo& info, const LoadOptions& opts);
+
+#endif // LOADGEN_H
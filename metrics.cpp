@@ -0,0 +1,234 @@
+#include <cstdio>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+// Longest request head read from a scraper; the rest is not looked at
+#define METRICS_REQUEST_MAX 4096
+#define METRICS_RECV_TIMEOUT_MS 1000
+
+// Histogram bounds: microseconds and the matching "le" label in seconds
+static const struct {
+    uint64_t us;
+    const char* le;
+} LATENCY_BOUNDS[] = {
+    { 100, "0.0001" }, { 250, "0.00025" }, { 500, "0.0005" },
+    { 1000, "0.001" }, { 2500, "0.0025" }, { 5000, "0.005" },
+    { 10000, "0.01" }, { 25000, "0.025" }, { 50000, "0.05" },
+    { 100000, "0.1" }, { 250000, "0.25" }, { 500000, "0.5" },
+    { 1000000, "1" }, { 2500000, "2.5" }, { 5000000, "5" }, { 10000000, "10" }
+};
+
+static void appendCounter(std::string& out, const char* name, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += " counter\n";
+}
+
+static void appendSample(std::string& out, const char* name, const char* labels, uint64_t value) {
+    out += name;
+    out += labels;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+static void appendHistogram(std::string& out, const char* transport, const std::vector<uint64_t>& counts,
+                            uint64_t sum_us) {
+    static const char NAME[] = "calc_client_session_latency_seconds";
+    char labels[64];
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (size_t i = 0; i < sizeof(LATENCY_BOUNDS) / sizeof(LATENCY_BOUNDS[0]); i++) {
+        while (bucket < counts.size() && LatencyHistogram::highestValueIn(bucket) <= LATENCY_BOUNDS[i].us) {
+            cumulative += counts[bucket++];
+        }
+        snprintf(labels, sizeof(labels), "_bucket{transport=\"%s\",le=\"%s\"}", transport, LATENCY_BOUNDS[i].le);
+        appendSample(out, NAME, labels, cumulative);
+    }
+    while (bucket < counts.size()) {
+        cumulative += counts[bucket++];
+    }
+    snprintf(labels, sizeof(labels), "_bucket{transport=\"%s\",le=\"+Inf\"}", transport);
+    appendSample(out, NAME, labels, cumulative);
+
+    char sum[64];
+    snprintf(sum, sizeof(sum), "_sum{transport=\"%s\"} %llu.%06llu\n", transport,
+             (unsigned long long)(sum_us / 1000000), (unsigned long long)(sum_us % 1000000));
+    out += NAME;
+    out += sum;
+    snprintf(labels, sizeof(labels), "_count{transport=\"%s\"}", transport);
+    appendSample(out, NAME, labels, cumulative);
+}
+
+std::string formatMetrics(const StatsSnapshot& s) {
+    std::string out;
+    appendCounter(out, "calc_client_sessions_started_total", "Sessions started by a driver.");
+    appendSample(out, "calc_client_sessions_started_total", "", s.counters[STAT_STARTED]);
+    appendCounter(out, "calc_client_sessions_total", "Finished sessions by result.");
+    appendSample(out, "calc_client_sessions_total", "{result=\"ok\"}", s.counters[STAT_OK]);
+    appendSample(out, "calc_client_sessions_total", "{result=\"error\"}", s.counters[STAT_ERROR]);
+    appendCounter(out, "calc_client_session_timeouts_total", "Sessions that failed waiting for the server.");
+    appendSample(out, "calc_client_session_timeouts_total", "", s.counters[STAT_TIMEOUT]);
+    appendCounter(out, "calc_client_connect_failures_total", "Sessions that never reached the server.");
+    appendSample(out, "calc_client_connect_failures_total", "", s.counters[STAT_CONNECT_FAILED]);
+    appendCounter(out, "calc_client_protocol_errors_total", "Protocol errors by kind.");
+    appendSample(out, "calc_client_protocol_errors_total", "{error=\"mismatch_protocol\"}", s.counters[STAT_MISMATCH]);
+    appendSample(out, "calc_client_protocol_errors_total", "{error=\"wrong_size\"}", s.counters[STAT_WRONG_SIZE]);
+
+    out += "# HELP calc_client_session_latency_seconds Latency of OK sessions.\n"
+           "# TYPE calc_client_session_latency_seconds histogram\n";
+    appendHistogram(out, "tcp", s.latency[1], s.latency_sum[1]);
+    appendHistogram(out, "udp", s.latency[0], s.latency_sum[0]);
+
+    out += "# HELP calc_client_start_time_seconds Unix time the client started.\n"
+           "# TYPE calc_client_start_time_seconds gauge\n";
+    appendSample(out, "calc_client_start_time_seconds", "", (uint64_t)s.started);
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+
+MetricsServer::MetricsServer() : listen_fd_(-1) {
+    wake_[0] = wake_[1] = -1;
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(const std::string& address, std::string& error) {
+    std::string host = "127.0.0.1";
+    std::string port = address;
+    size_t colon = address.rfind(':');
+    if (colon != std::string::npos) {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+        if (host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+    struct addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+        error = "Invalid metrics address " + address;
+        return false;
+    }
+    listen_fd_ = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    bool ok = listen_fd_ >= 0 &&
+              setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0 &&
+              bind(listen_fd_, res->ai_addr, res->ai_addrlen) == 0 &&
+              listen(listen_fd_, 16) == 0 &&
+              pipe2(wake_, O_CLOEXEC) == 0;
+    freeaddrinfo(res);
+    if (!ok) {
+        error = "Failed to listen on " + address + ": " + strerror(errno);
+        stop();
+        return false;
+    }
+
+    thread_ = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (thread_.joinable()) {
+        char c = 0;
+        while (write(wake_[1], &c, 1) < 0 && errno == EINTR) {
+        }
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (wake_[i] >= 0) {
+            close(wake_[i]);
+            wake_[i] = -1;
+        }
+    }
+}
+
+void MetricsServer::run() {
+    for (;;) {
+        struct pollfd fds[2] = { { listen_fd_, POLLIN, 0 }, { wake_[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            serve(fd);
+            close(fd);
+        }
+    }
+}
+
+// Read the request head, answer it and let the scraper close
+void MetricsServer::serve(int fd) {
+    struct timeval timeout = { METRICS_RECV_TIMEOUT_MS / 1000, (METRICS_RECV_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < METRICS_REQUEST_MAX) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        request.append(buf, (size_t)n);
+    }
+
+    std::string status = "404 Not Found";
+    std::string body = "Not found, try /metrics\n";
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0) {
+        StatsSnapshot snapshot;
+        readStats(*statsFile(), snapshot);
+        status = "200 OK";
+        body = formatMetrics(snapshot);
+    }
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+
+    const char* p = response.data();
+    size_t left = response.size();
+    while (left > 0) {
+        ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+}
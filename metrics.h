@@ -0,0 +1,43 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <thread>
+
+#include "stats.h"
+
+// Minimal HTTP listener serving the live counters (stats.h) in the Prometheus
+// text format at /metrics (-M). It runs on a thread of its own and only reads
+// the per-thread slots with relaxed loads, so a scrape never takes a lock or
+// stalls a session. One scrape is served at a time.
+class MetricsServer {
+public:
+    MetricsServer();
+    ~MetricsServer();
+
+    // Listen on address ("HOST:PORT", "[IPv6]:PORT" or just "PORT" for
+    // 127.0.0.1) and serve statsFile(), which must be open. Returns false with
+    // the reason in error.
+    bool start(const std::string& address, std::string& error);
+
+    // Close the listener and wait for the thread
+    void stop();
+
+private:
+    MetricsServer(const MetricsServer&);
+    MetricsServer& operator=(const MetricsServer&);
+
+    void run();
+    void serve(int fd);
+
+    int listen_fd_;
+    int wake_[2];       // Written to by stop()
+    std::thread thread_;
+};
+
+// The snapshot as a Prometheus text exposition. The latency histograms have
+// fixed bounds from 100 us to 10 s, filled from the finer LatencyHistogram
+// buckets (so a bound is exact to within one of those).
+std::string formatMetrics(const StatsSnapshot& snapshot);
+
+#endif // METRICS_H
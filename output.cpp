@@ -0,0 +1,197 @@
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+#include <errno.h>
+
+#include "output.h"
+#include "binproto.h"
+#include "calcLib.h"
+#include "textproto.h"
+
+OutputFormat output_format = OUTPUT_TEXT;
+
+// Longest JSON record; text from the server (error messages) and job targets
+// are cut to fit
+#define JSON_RECORD_MAX 2048
+#define JSON_TEXT_MAX 256
+
+static_assert(JSON_RECORD_MAX <= PIPE_BUF, "a record must fit into one OutputBuffer");
+
+OutputBuffer& OutputBuffer::local() {
+    static thread_local OutputBuffer buffer;
+    return buffer;
+}
+
+void OutputBuffer::flush() {
+    const char* p = buf_;
+    while (len_ > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, len_);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;      // Nowhere to write to (closed pipe): drop the records
+        }
+        p += n;
+        len_ -= (size_t)n;
+    }
+    len_ = 0;
+}
+
+// Builds one JSON record in the space reserved for it
+class JsonWriter {
+public:
+    explicit JsonWriter(char* begin) : begin_(begin), p_(begin) {}
+
+    size_t size() const { return (size_t)(p_ - begin_); }
+
+    void raw(const char* text) {
+        size_t len = strlen(text);
+        memcpy(p_, text, len);
+        p_ += len;
+    }
+
+    void integer(int32_t value) { p_ += formatInt32(value, p_); }
+
+    // ,"key":
+    void key(const char* name) {
+        *p_++ = ',';
+        string(name, strlen(name));
+        *p_++ = ':';
+    }
+
+    // Bytes outside printable ASCII are escaped, so the record stays valid
+    // UTF-8 whatever the server sent
+    void string(const char* text, size_t len) {
+        static const char HEX[] = "0123456789abcdef";
+        if (len > JSON_TEXT_MAX) {
+            len = JSON_TEXT_MAX;
+        }
+        *p_++ = '"';
+        for (size_t i = 0; i < len; i++) {
+            unsigned char c = (unsigned char)text[i];
+            if (c == '"' || c == '\\') {
+                *p_++ = '\\';
+                *p_++ = (char)c;
+            } else if (c < 0x20 || c >= 0x7f) {
+                memcpy(p_, "\\u00", 4);
+                p_[4] = HEX[c >> 4];
+                p_[5] = HEX[c & 0xf];
+                p_ += 6;
+            } else {
+                *p_++ = (char)c;
+            }
+        }
+        *p_++ = '"';
+    }
+
+    void string(const char* text) { string(text, strlen(text)); }
+
+    // Fixed point with three decimals
+    void milliseconds(double ms) {
+        int64_t us = ms > 0 ? (int64_t)(ms * 1000.0 + 0.5) : 0;
+        if (us > INT32_MAX) {
+            us = INT32_MAX;
+        }
+        integer((int32_t)(us / 1000));
+        char frac[4] = { '.', (char)('0' + us / 100 % 10), (char)('0' + us / 10 % 10), (char)('0' + us % 10) };
+        memcpy(p_, frac, sizeof(frac));
+        p_ += sizeof(frac);
+    }
+
+private:
+    char* begin_;
+    char* p_;
+};
+
+static void writeSessionJson(const Session& session, uint64_t latency_us, bool connect_failed) {
+    OutputBuffer& out = OutputBuffer::local();
+    JsonWriter json(out.reserve(JSON_RECORD_MAX));
+    bool ok = session.status() == SESSION_OK;
+
+    json.raw("{\"type\":\"session\"");
+    json.key("transport");
+    json.string(session.isDatagram() ? "UDP" : "TCP");
+    json.key("api");
+    json.string(session.isText() ? "TEXT" : "BINARY");
+    json.key("verdict");
+    json.string(ok ? "OK" : "ERROR");
+    json.key("phase");
+    json.string(session.phase() != PHASE_NONE ? phaseName(session.phase()) : "none");
+    json.key("latency_us");
+    json.integer(latency_us > INT32_MAX ? INT32_MAX : (int32_t)latency_us);
+
+    const SolvedAssignment& solved = session.assignment();
+    if (solved.op != 0) {
+        json.key("op");
+        json.string(operation_to_string(solved.op));
+        json.key("value1");
+        json.integer(solved.value1);
+        json.key("value2");
+        json.integer(solved.value2);
+        json.key("result");
+        json.integer(solved.result);
+    }
+    if (!ok) {
+        json.key("error");
+        if (connect_failed) {
+            json.string("CANT CONNECT");
+        } else if (!session.done()) {
+            json.string("UNFINISHED");
+        } else if (session.error().empty()) {
+            // Failures without a message of their own
+            json.string(session.phase() == PHASE_VERDICT ? "Verdict not OK" : "Invalid assignment");
+        } else {
+            json.string(session.error().data(), session.error().size());
+        }
+    }
+    json.raw("}\n");
+    out.commit(json.size());
+}
+
+static void writeSessionBinary(const Session& session, uint64_t latency_us, bool connect_failed) {
+    OutputBuffer& out = OutputBuffer::local();
+    char* record = out.reserve(SESSION_RECORD_SIZE);
+    const SolvedAssignment& solved = session.assignment();
+
+    uint8_t flags = 0;
+    flags |= session.isDatagram() ? 0 : SESSION_RECORD_TCP;
+    flags |= session.isText() ? SESSION_RECORD_TEXT : 0;
+    flags |= session.status() == SESSION_OK ? SESSION_RECORD_OK : 0;
+    flags |= connect_failed ? SESSION_RECORD_CONNECT_FAIL : 0;
+
+    record[0] = SESSION_RECORD_VERSION;
+    record[1] = (char)flags;
+    record[2] = (char)(session.phase() != PHASE_NONE ? session.phase() : 0xff);
+    record[3] = (char)(solved.op <= 0xff ? solved.op : 0);
+    storeBE32(record + 4, (uint32_t)solved.value1);
+    storeBE32(record + 8, (uint32_t)solved.value2);
+    storeBE32(record + 12, (uint32_t)solved.result);
+    storeBE32(record + 16, latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_us);
+    out.commit(SESSION_RECORD_SIZE);
+}
+
+void writeSessionRecord(const Session& session, const PhaseTimes& times, bool connect_failed) {
+    switch (output_format) {
+        case OUTPUT_JSONL:  writeSessionJson(session, times.elapsed(), connect_failed); break;
+        case OUTPUT_BINARY: writeSessionBinary(session, times.elapsed(), connect_failed); break;
+        default:            break;
+    }
+}
+
+void writeJobRecord(const std::string& target, const char* transport, const char* verdict, double latency_ms) {
+    OutputBuffer& out = OutputBuffer::local();
+    JsonWriter json(out.reserve(JSON_RECORD_MAX));
+    json.raw("{\"type\":\"job\"");
+    json.key("target");
+    json.string(target.data(), target.size());
+    json.key("transport");
+    json.string(transport);
+    json.key("verdict");
+    json.string(verdict);
+    json.key("latency_ms");
+    json.milliseconds(latency_ms);
+    json.raw("}\n");
+    out.commit(json.size());
+}
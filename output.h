@@ -0,0 +1,84 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "session.h"
+#include "timing.h"
+
+// Output format of the per-session results (-o)
+enum OutputFormat {
+    OUTPUT_TEXT,    // "ASSIGNMENT: ..." and "OK (myresult=...)" lines (the default)
+    OUTPUT_JSONL,   // One JSON object per line
+    OUTPUT_BINARY   // Fixed-size SESSION_RECORD_SIZE records
+};
+
+// Set once from -o, before any session starts
+extern OutputFormat output_format;
+
+// Binary session record, all fields in network byte order:
+//   0  uint8   version (SESSION_RECORD_VERSION)
+//   1  uint8   flags (SESSION_RECORD_*)
+//   2  uint8   last phase reached (SessionPhase; 0xff for none)
+//   3  uint8   op (ARITH_*; 0 if no assignment was solved)
+//   4  int32   value1
+//   8  int32   value2
+//  12  int32   result
+//  16  uint32  microseconds from the start of the session to its end
+#define SESSION_RECORD_SIZE 20
+#define SESSION_RECORD_VERSION 1
+#define SESSION_RECORD_TCP          0x01
+#define SESSION_RECORD_TEXT         0x02
+#define SESSION_RECORD_OK           0x04
+#define SESSION_RECORD_CONNECT_FAIL 0x08
+
+// Records are appended to a buffer of the calling thread and written to
+// stdout with one write() when the next record would not fit. The buffer is
+// PIPE_BUF bytes and ends on a record boundary, so every write() is atomic on
+// a pipe and threads never interleave within a record, without any locking.
+class OutputBuffer {
+public:
+    OutputBuffer() : len_(0) {}
+    ~OutputBuffer() { flush(); }
+
+    // This thread's buffer
+    static OutputBuffer& local();
+
+    // Room for one record of at most len bytes (flushing first if needed);
+    // finish it with commit()
+    char* reserve(size_t len) {
+        if (len_ + len > sizeof(buf_)) {
+            flush();
+        }
+        return buf_ + len_;
+    }
+    void commit(size_t len) { len_ += len; }
+
+    void flush();
+
+private:
+    OutputBuffer(const OutputBuffer&);
+    OutputBuffer& operator=(const OutputBuffer&);
+
+    char buf_[PIPE_BUF];
+    size_t len_;
+};
+
+// Drivers call this when a session ends; writes its record unless the
+// format is OUTPUT_TEXT. JSONL records look like
+//   {"type":"session","transport":"TCP","api":"TEXT","verdict":"OK","phase":"verdict",
+//    "latency_us":412,"op":"add","value1":5,"value2":3,"result":8}
+// with "error" added to failed sessions and the assignment fields left out
+// until one was solved.
+void writeSessionRecord(const Session& session, const PhaseTimes& times, bool connect_failed);
+
+// Batch mode (JSONL only):
+//   {"type":"job","target":"...","transport":"TCP","verdict":"OK","latency_ms":0.412}
+void writeJobRecord(const std::string& target, const char* transport, const char* verdict, double latency_ms);
+
+// Write out what this thread has buffered
+inline void flushOutput() { OutputBuffer::local().flush(); }
+
+#endif // OUTPUT_H
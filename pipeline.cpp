@@ -0,0 +1,157 @@
+#include <cstring>
+
+#include "pipeline.h"
+#include "client.h"
+#include "calcLib.h"
+#include "textproto.h"
+#include "binproto.h"
+
+PipelineSession::PipelineSession(bool text, unsigned assignments, unsigned depth)
+    : StreamSession(text), negotiated_(false), offers_pipeline_(false),
+      assignments_(assignments), depth_(depth > 0 ? depth : 1), requested_(0),
+      completed_(0), succeeded_(0), max_depth_(0), depth_sum_(0) {
+}
+
+const char* PipelineSession::waitError() const {
+    return negotiated_ ? "Failed to receive server response" : "Failed to receive protocol information";
+}
+
+void PipelineSession::process() {
+    while (!done()) {
+        if (!negotiated_ || isText()) {
+            const char* line;
+            size_t len;
+            if (!rx_.nextLine(line, len)) {
+                return;
+            }
+            if (!negotiated_) {
+                onBannerLine(line, lineLength(line, line + len));
+            } else if (!onTextLine(line, len)) {
+                fail("Invalid pipelined message");
+            }
+        } else if (!onBinaryFrame()) {
+            return;
+        }
+    }
+}
+
+// The protocol list ends with an empty line
+void PipelineSession::onBannerLine(const char* line, size_t len) {
+    static const char TEXT_PIPELINE[] = "TEXT TCP 1.1 " PIPELINE_TOKEN;
+    static const char BINARY_PIPELINE[] = "BINARY TCP 1.1 " PIPELINE_TOKEN;
+    const char* wanted = isText() ? TEXT_PIPELINE : BINARY_PIPELINE;
+
+    if (len > 0) {
+        offers_pipeline_ = offers_pipeline_ || (len == strlen(wanted) && memcmp(line, wanted, len) == 0);
+        return;
+    }
+
+    if (!offers_pipeline_) {
+        fail("MISSMATCH PROTOCOL (server does not offer " PIPELINE_TOKEN ")");
+        return;
+    }
+    tx_ += wanted;
+    tx_ += " OK\n";
+    negotiated_ = true;
+    reach(PHASE_NEGOTIATE);
+    advance();
+    requestMore();
+}
+
+void PipelineSession::requestMore() {
+    while (requested_ < assignments_ && requested_ - completed_ < depth_) {
+        if (isText()) {
+            tx_ += PERSIST_TEXT_NEXT;
+        } else {
+            appendCalcMessage(tx_, makeCalcMessage(0, PROTOCOL_TCP));
+        }
+        requested_++;
+    }
+}
+
+bool PipelineSession::onTextLine(const char* line, size_t len) {
+    uint32_t id;
+    uint32_t op;
+    int32_t value1, value2;
+    bool ok;
+
+    if (parseTextIdAssignment(line, line + len, id, op, value1, value2)) {
+        int32_t result = calculate(op, value1, value2);
+        awaiting_verdict_[id] = result;
+
+        char answer[2 * INT32_TEXT_MAX + 2];
+        size_t answer_len = formatUint32(id, answer);
+        answer[answer_len++] = ' ';
+        answer_len += formatInt32(result, answer + answer_len);
+        answer[answer_len++] = '\n';
+        tx_.append(answer, answer_len);
+        return true;
+    }
+
+    if (parseTextIdVerdict(line, line + len, id, ok)) {
+        onVerdict(id, ok);
+        return true;
+    }
+    return false;
+}
+
+// Returns false if no complete frame is buffered (or the session failed)
+bool PipelineSession::onBinaryFrame() {
+    if (rx_.size() < sizeof(uint16_t)) {
+        return false;
+    }
+    uint16_t type = frameType(rx_.data());
+
+    const char* frame;
+    if (type == MSG_TYPE_CALC_PROTOCOL) {
+        if (!rx_.nextFrame(sizeof(calcProtocol), frame)) {
+            return false;
+        }
+        calcProtocol assignment = decodeCalcProtocol(frame);
+        int32_t result = calculate(assignment.arith, assignment.inValue1, assignment.inValue2);
+        awaiting_verdict_[assignment.id] = result;
+
+        assignment.inResult = result;
+        appendCalcProtocol(tx_, assignment);
+        return true;
+    }
+
+    if (type == MSG_TYPE_CALC_VERDICT) {
+        if (!rx_.nextFrame(sizeof(calcVerdict), frame)) {
+            return false;
+        }
+        calcVerdict verdict = decodeCalcVerdict(frame);
+        onVerdict(verdict.id, verdict.message == 1);
+        return true;
+    }
+
+    fail("WRONG SIZE OR INCORRECT PROTOCOL");
+    return false;
+}
+
+void PipelineSession::onVerdict(uint32_t id, bool ok) {
+    std::map<uint32_t, int32_t>::iterator it = awaiting_verdict_.find(id);
+    if (it == awaiting_verdict_.end()) {
+        fail("Verdict for unknown assignment id " + std::to_string(id));
+        return;
+    }
+    awaiting_verdict_.erase(it);
+
+    unsigned outstanding = requested_ - completed_;
+    depth_sum_ += outstanding;
+    if (outstanding > max_depth_) {
+        max_depth_ = outstanding;
+    }
+
+    completed_++;
+    if (ok) {
+        succeeded_++;
+    }
+    advance();
+
+    if (completed_ == assignments_) {
+        finish(succeeded_ == completed_);
+        return;
+    }
+    requestMore();
+}
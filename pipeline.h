@@ -0,0 +1,49 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <map>
+
+#include "session.h"
+
+// Runs a batch of assignments over one TCP connection using the PIPELINE
+// protocol extension: up to depth assignments are requested ahead, results
+// are sent as soon as an assignment arrives and verdicts are matched to them
+// by id, so throughput is no longer bounded by one round trip per assignment.
+// The session finishes once every assignment got its verdict; it succeeds if
+// all of them were OK. A server without PIPELINE fails it with MISSMATCH PROTOCOL.
+class PipelineSession : public StreamSession {
+public:
+    PipelineSession(bool text, unsigned assignments, unsigned depth);
+
+    // Assignments that got a verdict, and how many of those were OK
+    unsigned completed() const { return completed_; }
+    unsigned succeeded() const { return succeeded_; }
+
+    // Outstanding requests at the time each verdict arrived
+    unsigned maxDepth() const { return max_depth_; }
+    double meanDepth() const { return completed_ > 0 ? (double)depth_sum_ / completed_ : 0.0; }
+
+protected:
+    void process() override;
+    const char* waitError() const override;
+
+private:
+    void onBannerLine(const char* line, size_t len);
+    void requestMore();
+    bool onTextLine(const char* line, size_t len);
+    bool onBinaryFrame();
+    void onVerdict(uint32_t id, bool ok);
+
+    bool negotiated_;
+    bool offers_pipeline_;
+    unsigned assignments_;              // Assignments this session runs in total
+    unsigned depth_;                    // Maximum requests outstanding
+    unsigned requested_;
+    unsigned completed_;
+    unsigned succeeded_;
+    unsigned max_depth_;
+    unsigned long depth_sum_;
+    std::map<uint32_t, int32_t> awaiting_verdict_;  // id -> result we sent
+};
+
+#endif // PIPELINE_H
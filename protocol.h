@@ -11,10 +11,29 @@
 #define MSG_TYPE_CALC_MESSAGE 22
 #define MSG_TYPE_CALC_PROTOCOL 1
 #define MSG_TYPE_NOT_OK 2
+#define MSG_TYPE_CALC_VERDICT 23
 
 // Protocol ID
+#define PROTOCOL_TCP 6
 #define PROTOCOL_UDP 17
 
+// TCP extension: keep the connection open after the verdict. Servers offer it
+// as an extra banner line ("TEXT TCP 1.1 PERSIST" / "BINARY TCP 1.1 PERSIST"),
+// clients accept with "<line> OK". After each verdict the client may ask for
+// another assignment with PERSIST_TEXT_NEXT (TEXT) or a calcMessage with
+// message 0 and protocol PROTOCOL_TCP (BINARY), or simply close.
+#define PERSIST_TOKEN "PERSIST"
+#define PERSIST_TEXT_NEXT "NEXT\n"
+
+// TCP extension: many assignments in flight on one connection. Offered and
+// accepted like PERSIST ("TEXT TCP 1.1 PIPELINE" / "... PIPELINE OK"). No
+// assignment is sent until requested; the client may send any number of
+// requests (same as PERSIST) without waiting. Every assignment, result and
+// verdict carries the assignment id:
+//   TEXT:   "<id> <op> <value1> <value2>\n", "<id> <result>\n", "<id> OK\n" / "<id> ERROR\n"
+//   BINARY: calcProtocol, calcProtocol, calcVerdict
+#define PIPELINE_TOKEN "PIPELINE"
+
 // Arithmetic operations
 #define ARITH_ADD 1
 #define ARITH_SUB 2
@@ -42,4 +61,11 @@ typedef struct {
     int32_t inResult;       // Result (filled by client)
 } __attribute__((packed)) calcProtocol;
 
+// Verdict for one pipelined BINARY assignment
+typedef struct {
+    uint16_t type;           // Message type (23 for calcVerdict)
+    uint16_t message;        // 1 for OK, 2 for NOT OK
+    uint32_t id;             // calcProtocol.id of the assignment
+} __attribute__((packed)) calcVerdict;
+
 #endif // PROTOCOL_H
@@ -0,0 +1,199 @@
+#include <cstring>
+#include <thread>
+
+#include "resolver.h"
+
+ResolverCache& ResolverCache::instance() {
+    // Never destroyed: background lookups may still be running at exit
+    static ResolverCache* cache = new ResolverCache();
+    return *cache;
+}
+
+ResolverCache::LocalCache::LocalCache() : hits(0) {
+    ResolverCache& cache = instance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    cache.locals_.push_back(this);
+}
+
+ResolverCache::LocalCache::~LocalCache() {
+    ResolverCache& cache = instance();
+    std::lock_guard<std::mutex> lock(cache.mutex_);
+    cache.retired_hits_ += hits.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < cache.locals_.size(); i++) {
+        if (cache.locals_[i] == this) {
+            cache.locals_.erase(cache.locals_.begin() + i);
+            break;
+        }
+    }
+}
+
+ResolverCache::LocalCache& ResolverCache::local() {
+    static thread_local LocalCache cache;
+    return cache;
+}
+
+// Runs without the lock held; getaddrinfo() may take seconds
+void ResolverCache::lookup(const std::string& host) {
+    struct addrinfo hints, *res = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;  // One entry per address; the port is filled in per call
+
+    // getaddrinfo() sorts by RFC 6724 preference; keep that order within each family
+    std::vector<SocketAddress> by_family[2];
+    int first_family = AF_UNSPEC;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &res) == 0) {
+        for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+            if ((ai->ai_family != AF_INET && ai->ai_family != AF_INET6) || ai->ai_addrlen > sizeof(struct sockaddr_storage)) {
+                continue;
+            }
+            if (first_family == AF_UNSPEC) {
+                first_family = ai->ai_family;
+            }
+            SocketAddress a;
+            memset(&a.addr, 0, sizeof(a.addr));
+            memcpy(&a.addr, ai->ai_addr, ai->ai_addrlen);
+            a.len = (socklen_t)ai->ai_addrlen;
+            by_family[ai->ai_family == first_family ? 0 : 1].push_back(a);
+        }
+        freeaddrinfo(res);
+    }
+
+    // Alternate families so one unreachable family does not delay the other
+    std::vector<SocketAddress> addresses;
+    for (size_t i = 0; i < by_family[0].size() || i < by_family[1].size(); i++) {
+        for (int f = 0; f < 2; f++) {
+            if (i < by_family[f].size()) {
+                addresses.push_back(by_family[f][i]);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = entries_[host];
+    lookups_++;
+    // A failed refresh keeps the addresses we had (serve stale) until the next attempt
+    bool found = !addresses.empty();
+    if (found) {
+        entry.addresses.swap(addresses);
+    }
+    entry.expires = Clock::now() + std::chrono::milliseconds(found ? DNS_CACHE_TTL_MS : DNS_NEGATIVE_TTL_MS);
+    entry.resolved = true;
+    entry.resolving = false;
+    resolved_.notify_all();
+}
+
+// Called with the lock held
+void ResolverCache::refreshInBackground(const std::string& host, Entry& entry) {
+    if (entry.resolving) {
+        return;
+    }
+    entry.resolving = true;
+    std::thread(&ResolverCache::lookup, this, host).detach();
+}
+
+void ResolverCache::prefetch(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = entries_[host];
+    if (!entry.resolved || Clock::now() >= entry.expires) {
+        refreshInBackground(host, entry);
+    }
+}
+
+// The entry for host once it holds the result of a lookup; called with the lock held
+ResolverCache::Entry* ResolverCache::usableEntry(const std::string& host, std::unique_lock<std::mutex>& lock,
+                                                 bool& hit) {
+    Entry* entry = &entries_[host];     // std::map entries stay put while the lock is dropped
+
+    bool stale = entry->resolved && Clock::now() >= entry->expires;
+    if (stale && !entry->addresses.empty()) {
+        refreshInBackground(host, *entry);
+        hit = true;
+    } else if (stale || !entry->resolved) {
+        // Nothing usable yet: wait for the lookup in progress, or do it here
+        if (!entry->resolving) {
+            entry->resolving = true;
+            lock.unlock();
+            lookup(host);
+            lock.lock();
+        }
+        while (entry->resolving) {
+            resolved_.wait(lock);
+        }
+    } else {
+        hit = true;
+    }
+    return entry;
+}
+
+// The addresses of host, from this thread's copy while that is fresh
+const std::vector<SocketAddress>& ResolverCache::addressesOf(const std::string& host) {
+    LocalCache& cache = local();
+    Clock::time_point now = Clock::now();
+    std::map<std::string, LocalCache::Copy>::iterator it = cache.entries.find(host);
+    if (it != cache.entries.end() && now < it->second.expires) {
+        cache.hits.store(cache.hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return it->second.addresses;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool hit = false;
+    Entry* entry = usableEntry(host, lock, hit);
+    LocalCache::Copy& copy = cache.entries[host];
+    copy.addresses = entry->addresses;
+    copy.expires = entry->expires;      // Already past while a stale entry is refreshed
+    lock.unlock();
+
+    if (hit) {
+        cache.hits.store(cache.hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    return copy.addresses;
+}
+
+static void setPort(SocketAddress& a, int port) {
+    uint16_t net_port = htons((uint16_t)port);
+    if (a.addr.ss_family == AF_INET) {
+        ((struct sockaddr_in*)&a.addr)->sin_port = net_port;
+    } else {
+        ((struct sockaddr_in6*)&a.addr)->sin6_port = net_port;
+    }
+}
+
+bool ResolverCache::resolve(const std::string& host, int port, int family,
+                            struct sockaddr_storage& addr, socklen_t& addr_len) {
+    const std::vector<SocketAddress>& addresses = addressesOf(host);
+
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (family != AF_UNSPEC && addresses[i].addr.ss_family != family) {
+            continue;
+        }
+        SocketAddress a = addresses[i];
+        setPort(a, port);
+        addr = a.addr;
+        addr_len = a.len;
+        return true;
+    }
+    return false;
+}
+
+bool ResolverCache::resolveAll(const std::string& host, int port, std::vector<SocketAddress>& addresses) {
+    addresses = addressesOf(host);
+    for (size_t i = 0; i < addresses.size(); i++) {
+        setPort(addresses[i], port);
+    }
+    return !addresses.empty();
+}
+
+unsigned long ResolverCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    unsigned long hits = retired_hits_;
+    for (size_t i = 0; i < locals_.size(); i++) {
+        hits += locals_[i]->hits.load(std::memory_order_relaxed);
+    }
+    return hits;
+}
+
+unsigned long ResolverCache::lookups() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lookups_;
+}
@@ -0,0 +1,92 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "client.h"
+
+// How long a successful lookup is used before it is refreshed
+#define DNS_CACHE_TTL_MS 30000
+
+// How long a failed lookup is remembered (negative caching)
+#define DNS_NEGATIVE_TTL_MS 5000
+
+// Process-wide cache of getaddrinfo() results, shared by TCP and UDP and by
+// every thread. getaddrinfo() does not report record TTLs, so entries live for
+// a fixed DNS_CACHE_TTL_MS. An expired entry keeps being served while a
+// background thread refreshes it, so after the first lookup (or a prefetch())
+// callers never wait for the resolver. Every thread keeps a copy of the
+// entries it used until they expire, so load generator workers resolving for
+// each session neither take the lock nor share a cache line.
+class ResolverCache {
+public:
+    static ResolverCache& instance();
+
+    // Resolve host to its first address of the given family (AF_UNSPEC or
+    // AF_INET) with port filled in. Blocks only if host has never been looked
+    // up, or its last lookup failed more than DNS_NEGATIVE_TTL_MS ago.
+    bool resolve(const std::string& host, int port, int family,
+                 struct sockaddr_storage& addr, socklen_t& addr_len);
+
+    // All addresses of host with port filled in, IPv6 and IPv4 interleaved
+    // (RFC 8305, section 4) starting with the family getaddrinfo() put first.
+    // Blocks like resolve().
+    bool resolveAll(const std::string& host, int port, std::vector<SocketAddress>& addresses);
+
+    // Start looking host up in the background, so the first resolve() does not block
+    void prefetch(const std::string& host);
+
+    // resolve() calls answered from the cache (counted per thread and summed
+    // here), and getaddrinfo() calls made
+    unsigned long hits() const;
+    unsigned long lookups() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        bool resolved;                  // A lookup finished (addresses may be empty: negative entry)
+        bool resolving;                 // A lookup is in progress
+        std::vector<SocketAddress> addresses;
+        Clock::time_point expires;
+        Entry() : resolved(false), resolving(false) {}
+    };
+
+    // A thread's copies of the entries it used, and its hit count
+    struct LocalCache {
+        struct Copy {
+            std::vector<SocketAddress> addresses;
+            Clock::time_point expires;
+        };
+        std::map<std::string, Copy> entries;
+        std::atomic<unsigned long> hits;    // Only the owning thread writes it
+
+        LocalCache();
+        ~LocalCache();
+    };
+
+    ResolverCache() : retired_hits_(0), lookups_(0) {}
+    ResolverCache(const ResolverCache&);
+    ResolverCache& operator=(const ResolverCache&);
+
+    void lookup(const std::string& host);
+    void refreshInBackground(const std::string& host, Entry& entry);
+    Entry* usableEntry(const std::string& host, std::unique_lock<std::mutex>& lock, bool& hit);
+    const std::vector<SocketAddress>& addressesOf(const std::string& host);
+    static LocalCache& local();
+
+    mutable std::mutex mutex_;
+    std::condition_variable resolved_;
+    std::map<std::string, Entry> entries_;
+    std::vector<LocalCache*> locals_;   // Caches of the threads still running
+    unsigned long retired_hits_;        // Hits of the threads that exited
+    unsigned long lookups_;
+};
+
+#endif // RESOLVER_H
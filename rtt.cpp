@@ -0,0 +1,41 @@
+#include <map>
+#include <string>
+
+#include "rtt.h"
+
+// Clock granularity G in RFC 6298: the event loop counts whole milliseconds
+#define RTT_CLOCK_GRANULARITY_MS 1.0
+
+RttEstimator::RttEstimator() : srtt_(0.0), rttvar_(0.0), rto_(RTO_INITIAL_MS), samples_(0) {
+}
+
+void RttEstimator::sample(uint64_t rtt_ms) {
+    double r = (double)rtt_ms;
+    if (samples_ == 0) {
+        srtt_ = r;
+        rttvar_ = r / 2;
+    } else {
+        // alpha = 1/8, beta = 1/4; RTTVAR is updated with the old SRTT
+        double delta = srtt_ > r ? srtt_ - r : r - srtt_;
+        rttvar_ = 0.75 * rttvar_ + 0.25 * delta;
+        srtt_ = 0.875 * srtt_ + 0.125 * r;
+    }
+    samples_++;
+
+    double k_rttvar = 4 * rttvar_;
+    rto_ = srtt_ + (k_rttvar > RTT_CLOCK_GRANULARITY_MS ? k_rttvar : RTT_CLOCK_GRANULARITY_MS);
+}
+
+uint64_t RttEstimator::timeoutMs(unsigned retransmits) const {
+    double rto = rto_ < RTO_MIN_MS ? RTO_MIN_MS : rto_;
+    for (unsigned i = 0; i < retransmits && rto < RTO_MAX_MS; i++) {
+        rto *= 2;
+    }
+    return rto > RTO_MAX_MS ? RTO_MAX_MS : (uint64_t)rto;
+}
+
+RttEstimator& rttEstimatorFor(const struct sockaddr* addr, socklen_t addr_len) {
+    // Keyed by the raw address bytes (family, port and address)
+    static thread_local std::map<std::string, RttEstimator> estimators;
+    return estimators[std::string((const char*)addr, (size_t)addr_len)];
+}
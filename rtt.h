@@ -0,0 +1,79 @@
+#ifndef RTT_H
+#define RTT_H
+
+#include <stdint.h>
+
+#include "client.h"
+
+// Retransmission timeout before the first RTT sample (RFC 6298, 2.1)
+#define RTO_INITIAL_MS 1000
+
+// RFC 6298 asks for at least one second; lab servers answer within a few
+// milliseconds, so that would make every lost datagram cost a second again
+#define RTO_MIN_MS 100
+
+// Backed-off timeouts are capped at the fixed wait UDP sessions used to have
+#define RTO_MAX_MS 2000
+
+// Smoothed round trip time and retransmission timeout for one destination,
+// computed as in RFC 6298. Samples must only be taken from exchanges whose
+// request was not retransmitted (Karn's algorithm).
+class RttEstimator {
+public:
+    RttEstimator();
+
+    void sample(uint64_t rtt_ms);
+
+    bool hasSample() const { return samples_ > 0; }
+    double srttMs() const { return srtt_; }
+    double rttvarMs() const { return rttvar_; }
+
+    // Timeout for a request that has been retransmitted `retransmits` times:
+    // the RTO doubled for every retransmission, within [RTO_MIN_MS, RTO_MAX_MS]
+    uint64_t timeoutMs(unsigned retransmits) const;
+
+private:
+    double srtt_;
+    double rttvar_;
+    double rto_;
+    unsigned long samples_;
+};
+
+// What a driver tracks for one datagram session: when the current request
+// first went out and whether it had to be retransmitted since
+class RetransmitTracker {
+public:
+    RetransmitTracker() : estimator_(nullptr), sent_ms_(0), retransmitted_(false) {}
+
+    void start(RttEstimator* estimator, uint64_t now_ms) {
+        estimator_ = estimator;
+        sent_ms_ = now_ms;
+        retransmitted_ = false;
+    }
+
+    bool active() const { return estimator_ != nullptr; }
+
+    // A reply to the current request arrived; the next request, if any, goes out now
+    void onReply(uint64_t now_ms) {
+        if (!retransmitted_) {
+            estimator_->sample(now_ms - sent_ms_);
+        }
+        sent_ms_ = now_ms;
+        retransmitted_ = false;
+    }
+
+    void onRetransmit() { retransmitted_ = true; }
+
+    uint64_t timeoutMs(unsigned retransmits) const { return estimator_->timeoutMs(retransmits); }
+
+private:
+    RttEstimator* estimator_;
+    uint64_t sent_ms_;
+    bool retransmitted_;
+};
+
+// The estimator for addr, shared by all sessions of the calling thread that
+// talk to that destination
+RttEstimator& rttEstimatorFor(const struct sockaddr* addr, socklen_t addr_len);
+
+#endif // RTT_H
@@ -0,0 +1,874 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <csignal>
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "protocol.h"
+#include "calcLib.h"
+#include "eventloop.h"
+#include "textproto.h"
+#include "binproto.h"
+#include "framebuf.h"
+
+// Reference calculator server for local testing and benchmarking. Speaks
+// TEXT and BINARY over TCP and UDP on one port. Every worker thread owns its
+// own SO_REUSEPORT listening sockets and event loop, so workers share nothing.
+
+// Idle time after which a TCP connection is dropped
+#define CONNECTION_TIMEOUT_MS 10000
+
+// How long UDP assignments are remembered while waiting for the result
+#define UDP_ASSIGNMENT_TTL_MS 10000
+
+// How long a UDP verdict is remembered to answer retransmitted results again
+#define UDP_VERDICT_TTL_MS 5000
+
+// Interval of the sweep that forgets stale UDP assignments
+#define UDP_SWEEP_INTERVAL_MS 1000
+
+// Pipelined assignments a client may have outstanding on one connection
+#define PIPELINE_MAX_OUTSTANDING 4096
+
+// Assignments generated (and solved with calculate_batch) at a time
+#define ASSIGNMENT_BLOCK 256
+
+static const char TCP_BANNER[] = "TEXT TCP 1.1\nBINARY TCP 1.1\n"
+                                 "TEXT TCP 1.1 " PERSIST_TOKEN "\nBINARY TCP 1.1 " PERSIST_TOKEN "\n"
+                                 "TEXT TCP 1.1 " PIPELINE_TOKEN "\nBINARY TCP 1.1 " PIPELINE_TOKEN "\n\n";
+
+static std::atomic<bool> stop_requested(false);
+
+static void onSignal(int) {
+    stop_requested = true;
+}
+
+void printError(const std::string& message) {
+    std::cerr << "ERROR: " << message << std::endl;
+}
+
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Per-worker counters, summed when the server shuts down
+struct ServerStats {
+    unsigned long ok[4];
+    unsigned long error[4];
+    ServerStats() {
+        memset(ok, 0, sizeof(ok));
+        memset(error, 0, sizeof(error));
+    }
+};
+
+enum Variant { TCP_TEXT, TCP_BINARY, UDP_TEXT, UDP_BINARY };
+static const char* VARIANT_NAMES[4] = { "TCP TEXT", "TCP BINARY", "UDP TEXT", "UDP BINARY" };
+
+// One random assignment
+struct Assignment {
+    uint32_t id;
+    uint32_t arith;
+    int32_t value1;
+    int32_t value2;
+    int32_t expected;
+};
+
+// "<op> <value1> <value2>\n"
+#define ASSIGNMENT_TEXT_MAX (3 + 1 + INT32_TEXT_MAX + 1 + INT32_TEXT_MAX + 1)
+
+// Format a text assignment line into buf (ASSIGNMENT_TEXT_MAX bytes); returns its length
+static size_t formatAssignment(const Assignment& a, char* buf) {
+    memcpy(buf, operation_to_string(a.arith), 3);
+    size_t len = 3;
+    buf[len++] = ' ';
+    len += formatInt32(a.value1, buf + len);
+    buf[len++] = ' ';
+    len += formatInt32(a.value2, buf + len);
+    buf[len++] = '\n';
+    return len;
+}
+
+// The calcProtocol frame handing out a
+static calcProtocol assignmentFrame(const Assignment& a) {
+    return calcProtocol{ MSG_TYPE_CALC_PROTOCOL, MAJOR_VERSION, MINOR_VERSION, a.id, a.arith, a.value1, a.value2, 0 };
+}
+
+class Worker;
+
+// ---------------------------------------------------------------------------
+// TCP connection
+
+class Connection : public EventHandler, public TimerHandler {
+public:
+    Connection(Worker& worker, int fd);
+    ~Connection();
+
+    void onEvent(uint32_t events) override;
+    void onTimer() override;
+
+private:
+    void process();
+    void sendAssignment();
+    bool sendPipelinedAssignment();
+    bool checkPipelinedResult(uint32_t id, int32_t value, bool& ok);
+    bool processPipelinedLine();
+    bool processPipelinedFrame();
+    void flush();
+    void closeLater();
+
+    // S_IDLE: verdict sent on a persistent connection, waiting for the next request
+    // S_PIPELINE: PIPELINE extension, requests and results in any order
+    enum State { S_NEGOTIATE, S_RESULT, S_IDLE, S_PIPELINE, S_DONE };
+
+    Worker& worker_;
+    int fd_;
+    State state_;
+    bool text_;
+    bool persistent_;
+    Assignment assignment_;
+    std::map<uint32_t, int32_t> pipeline_;     // Outstanding pipelined assignments: id -> expected result
+    FrameBuffer rx_;
+    std::string tx_;
+    bool writing_;
+    Timer timer_;
+};
+
+// ---------------------------------------------------------------------------
+// Worker: one thread, one event loop, its own TCP and UDP sockets
+
+class Worker : public EventHandler, public TimerHandler {
+public:
+    Worker(int tcp_fd, int udp_fd, unsigned seed, unsigned loss_percent);
+    ~Worker();
+
+    void run();
+
+    EventLoop& loop() { return loop_; }
+    ServerStats& stats() { return stats_; }
+    Assignment newAssignment();
+
+    void onEvent(uint32_t events) override;
+    void onTimer() override;
+
+private:
+    // Receives readiness of the UDP socket
+    struct UdpHandler : public EventHandler {
+        Worker* worker;
+        void onEvent(uint32_t) override { worker->onDatagrams(); }
+    };
+
+    // Clients retransmit requests and results whose reply got lost, so both
+    // are answered the same way again until the entry expires
+    struct PendingUdp {
+        Assignment assignment;
+        uint16_t verdict;       // 0 while waiting for the result, then 1 (OK) or 2 (NOT OK)
+        uint64_t expires;
+    };
+
+    void refillAssignments();
+    uint64_t nextRandom();
+    bool dropDatagram();
+    void onDatagrams();
+    void handleDatagram(const char* data, size_t len, const struct sockaddr_storage& from, socklen_t from_len);
+    void sendDatagram(const void* data, size_t len, const struct sockaddr_storage& to, socklen_t to_len);
+    void sendVerdict(uint16_t message, const struct sockaddr_storage& to, socklen_t to_len);
+    void sendAssignment(const Assignment& a, const struct sockaddr_storage& to, socklen_t to_len);
+
+    EventLoop loop_;
+    int tcp_fd_;
+    int udp_fd_;
+    UdpHandler udp_handler_;
+    uint64_t rng_;
+    uint32_t next_id_;
+    unsigned loss_percent_;     // Simulated loss of received and sent datagrams (-l)
+
+    // Block of pre-generated assignments; next_assignment_ indexes the next unused one
+    uint32_t block_ops_[ASSIGNMENT_BLOCK];
+    int32_t block_v1_[ASSIGNMENT_BLOCK];
+    int32_t block_v2_[ASSIGNMENT_BLOCK];
+    int32_t block_expected_[ASSIGNMENT_BLOCK];
+    size_t next_assignment_;
+    ServerStats stats_;
+    Timer sweep_timer_;
+
+    // Text clients are only identifiable by source address; binary ones by id
+    std::map<std::string, PendingUdp> pending_text_;
+    std::map<uint32_t, PendingUdp> pending_binary_;
+};
+
+Worker::Worker(int tcp_fd, int udp_fd, unsigned seed, unsigned loss_percent)
+    : tcp_fd_(tcp_fd), udp_fd_(udp_fd), rng_(0x9E3779B97F4A7C15ULL * (seed + 1)),
+      next_id_(seed << 24), loss_percent_(loss_percent), next_assignment_(ASSIGNMENT_BLOCK), sweep_timer_(this) {
+    udp_handler_.worker = this;
+    loop_.add(tcp_fd_, EV_READ, this);
+    loop_.add(udp_fd_, EV_READ, &udp_handler_);
+    loop_.addTimer(&sweep_timer_, UDP_SWEEP_INTERVAL_MS);
+}
+
+Worker::~Worker() {
+    loop_.remove(tcp_fd_);
+    loop_.remove(udp_fd_);
+    close(tcp_fd_);
+    close(udp_fd_);
+}
+
+void Worker::run() {
+    while (!stop_requested) {
+        loop_.runOnce(200);
+    }
+}
+
+// xorshift64*: cheap, and good enough for picking operands
+uint64_t Worker::nextRandom() {
+    rng_ ^= rng_ >> 12;
+    rng_ ^= rng_ << 25;
+    rng_ ^= rng_ >> 27;
+    return rng_ * 0x2545F4914F6CDD1DULL;
+}
+
+bool Worker::dropDatagram() {
+    return loss_percent_ > 0 && nextRandom() % 100 < loss_percent_;
+}
+
+void Worker::refillAssignments() {
+    for (size_t i = 0; i < ASSIGNMENT_BLOCK; i++) {
+        uint64_t r = nextRandom();
+
+        block_ops_[i] = (uint32_t)(r % 4) + ARITH_ADD;
+        block_v1_[i] = (int32_t)((r >> 8) % 200001) - 100000;
+        block_v2_[i] = (int32_t)((r >> 32) % 200001) - 100000;
+    }
+    // Many products overflow; calculate_batch() wraps them exactly like the client's calculate()
+    calculate_batch(block_ops_, block_v1_, block_v2_, block_expected_, ASSIGNMENT_BLOCK);
+    next_assignment_ = 0;
+}
+
+Assignment Worker::newAssignment() {
+    if (next_assignment_ == ASSIGNMENT_BLOCK) {
+        refillAssignments();
+    }
+
+    size_t i = next_assignment_++;
+    Assignment a;
+    a.id = next_id_++;
+    a.arith = block_ops_[i];
+    a.value1 = block_v1_[i];
+    a.value2 = block_v2_[i];
+    a.expected = block_expected_[i];
+    return a;
+}
+
+void Worker::onEvent(uint32_t) {
+    // Accept everything that is pending on the listening socket
+    for (;;) {
+        int fd = accept(tcp_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (!setNonBlocking(fd)) {
+            close(fd);
+            continue;
+        }
+        new Connection(*this, fd);
+    }
+}
+
+void Worker::onTimer() {
+    uint64_t now = loop_.now();
+    for (std::map<std::string, PendingUdp>::iterator it = pending_text_.begin(); it != pending_text_.end();) {
+        if (it->second.expires <= now) {
+            if (it->second.verdict == 0) {
+                stats_.error[UDP_TEXT]++;
+            }
+            pending_text_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    for (std::map<uint32_t, PendingUdp>::iterator it = pending_binary_.begin(); it != pending_binary_.end();) {
+        if (it->second.expires <= now) {
+            if (it->second.verdict == 0) {
+                stats_.error[UDP_BINARY]++;
+            }
+            pending_binary_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    loop_.addTimer(&sweep_timer_, UDP_SWEEP_INTERVAL_MS);
+}
+
+void Worker::onDatagrams() {
+    char buffer[1500];
+    for (;;) {
+        struct sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(udp_fd_, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &from_len);
+        if (n < 0) {
+            return;
+        }
+        if (!dropDatagram()) {
+            handleDatagram(buffer, (size_t)n, from, from_len);
+        }
+    }
+}
+
+void Worker::sendDatagram(const void* data, size_t len, const struct sockaddr_storage& to, socklen_t to_len) {
+    if (dropDatagram()) {
+        return;
+    }
+    sendto(udp_fd_, data, len, 0, (const struct sockaddr*)&to, to_len);
+}
+
+void Worker::sendVerdict(uint16_t message, const struct sockaddr_storage& to, socklen_t to_len) {
+    char verdict[sizeof(calcMessage)];
+    encodeCalcMessage(makeCalcMessage(message, PROTOCOL_UDP), verdict);
+    sendDatagram(verdict, sizeof(verdict), to, to_len);
+}
+
+void Worker::sendAssignment(const Assignment& a, const struct sockaddr_storage& to, socklen_t to_len) {
+    char frame[sizeof(calcProtocol)];
+    encodeCalcProtocol(assignmentFrame(a), frame);
+    sendDatagram(frame, sizeof(frame), to, to_len);
+}
+
+// Binary messages start with a big-endian type; text never starts with a NUL
+static bool hasMessageType(const char* data, size_t len, uint16_t type) {
+    return len >= sizeof(uint16_t) && frameType(data) == type;
+}
+
+void Worker::handleDatagram(const char* data, size_t len, const struct sockaddr_storage& from, socklen_t from_len) {
+    uint64_t now = loop_.now();
+
+    // BINARY: initial calcMessage. A retransmitted one can not be told apart
+    // from a new client, so it gets a fresh assignment that will expire.
+    // (A 9-digit TEXT result is 10 bytes as well, hence the type check.)
+    if (len == sizeof(calcMessage) && hasMessageType(data, len, MSG_TYPE_CALC_MESSAGE)) {
+        calcMessage msg = decodeCalcMessage(data);
+        if (msg.type != MSG_TYPE_CALC_MESSAGE || msg.message != 0 || msg.protocol != PROTOCOL_UDP ||
+            msg.major_version != MAJOR_VERSION || msg.minor_version != MINOR_VERSION) {
+            stats_.error[UDP_BINARY]++;
+            sendVerdict(2, from, from_len);
+            return;
+        }
+
+        PendingUdp pending;
+        pending.assignment = newAssignment();
+        pending.verdict = 0;
+        pending.expires = now + UDP_ASSIGNMENT_TTL_MS;
+        pending_binary_[pending.assignment.id] = pending;
+        sendAssignment(pending.assignment, from, from_len);
+        return;
+    }
+
+    // BINARY: result
+    if (len == sizeof(calcProtocol) && hasMessageType(data, len, MSG_TYPE_CALC_PROTOCOL)) {
+        std::map<uint32_t, PendingUdp>::iterator it = pending_binary_.find(calcProtocolId(data));
+        if (it == pending_binary_.end()) {
+            stats_.error[UDP_BINARY]++;
+            sendVerdict(2, from, from_len);
+            return;
+        }
+        PendingUdp& pending = it->second;
+        if (pending.verdict == 0) {
+            bool ok = calcProtocolResult(data) == pending.assignment.expected;
+            (ok ? stats_.ok : stats_.error)[UDP_BINARY]++;
+            pending.verdict = ok ? 1 : 2;
+            pending.expires = now + UDP_VERDICT_TTL_MS;
+        }
+        sendVerdict(pending.verdict, from, from_len);
+        return;
+    }
+
+    static const char TEXT_HELLO[] = "TEXT UDP 1.1\n";
+    std::string key((const char*)&from, from_len);
+    std::map<std::string, PendingUdp>::iterator it = pending_text_.find(key);
+
+    // TEXT: protocol announcement; a retransmitted one gets the same assignment
+    if (len == sizeof(TEXT_HELLO) - 1 && memcmp(data, TEXT_HELLO, len) == 0) {
+        if (it == pending_text_.end() || it->second.verdict != 0) {
+            PendingUdp pending;
+            pending.assignment = newAssignment();
+            pending.verdict = 0;
+            pending.expires = now + UDP_ASSIGNMENT_TTL_MS;
+            pending_text_[key] = pending;
+        }
+
+        char line[ASSIGNMENT_TEXT_MAX];
+        sendDatagram(line, formatAssignment(pending_text_[key].assignment, line), from, from_len);
+        return;
+    }
+
+    // TEXT: result
+    if (it == pending_text_.end()) {
+        sendDatagram("ERROR\n", 6, from, from_len);
+        return;
+    }
+    PendingUdp& pending = it->second;
+    if (pending.verdict == 0) {
+        int32_t value;
+        bool ok = parseTextInt32(data, data + len, value) && value == pending.assignment.expected;
+        (ok ? stats_.ok : stats_.error)[UDP_TEXT]++;
+        pending.verdict = ok ? 1 : 2;
+        pending.expires = now + UDP_VERDICT_TTL_MS;
+    }
+    bool ok = pending.verdict == 1;
+    sendDatagram(ok ? "OK\n" : "ERROR\n", ok ? 3 : 6, from, from_len);
+}
+
+// ---------------------------------------------------------------------------
+// Connection implementation
+
+Connection::Connection(Worker& worker, int fd)
+    : worker_(worker), fd_(fd), state_(S_NEGOTIATE), text_(true), persistent_(false), writing_(false), timer_(this) {
+    memset(&assignment_, 0, sizeof(assignment_));
+    worker_.loop().add(fd_, EV_READ, this);
+    worker_.loop().addTimer(&timer_, CONNECTION_TIMEOUT_MS);
+    tx_ = TCP_BANNER;
+    flush();
+}
+
+Connection::~Connection() {
+    worker_.loop().cancelTimer(&timer_);
+    if (fd_ >= 0) {
+        worker_.loop().remove(fd_);
+        close(fd_);
+    }
+}
+
+void Connection::closeLater() {
+    if (fd_ < 0) {
+        return;
+    }
+    if (state_ == S_NEGOTIATE || state_ == S_RESULT) {
+        worker_.stats().error[text_ ? TCP_TEXT : TCP_BINARY]++;
+    }
+    worker_.stats().error[text_ ? TCP_TEXT : TCP_BINARY] += pipeline_.size();
+    worker_.loop().cancelTimer(&timer_);
+    worker_.loop().remove(fd_);
+    close(fd_);
+    fd_ = -1;
+    worker_.loop().deleteLater(this);
+}
+
+void Connection::onTimer() {
+    closeLater();
+}
+
+void Connection::onEvent(uint32_t events) {
+    if (fd_ < 0) {
+        return;
+    }
+
+    if (events & EV_READ) {
+        for (;;) {
+            long n = rx_.readFrom(fd_);
+            if (n > 0) {
+                process();
+                if (fd_ < 0) {
+                    return;
+                }
+                if (rx_.full()) {
+                    // No complete message fits: not a calculator client
+                    closeLater();
+                    return;
+                }
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                break;
+            }
+            // Peer closed or failed
+            closeLater();
+            return;
+        }
+    }
+
+    flush();
+}
+
+void Connection::sendAssignment() {
+    assignment_ = worker_.newAssignment();
+    if (text_) {
+        char line[ASSIGNMENT_TEXT_MAX];
+        tx_.append(line, formatAssignment(assignment_, line));
+    } else {
+        appendCalcProtocol(tx_, assignmentFrame(assignment_));
+    }
+    state_ = S_RESULT;
+    worker_.loop().addTimer(&timer_, CONNECTION_TIMEOUT_MS);
+}
+
+void Connection::process() {
+    while (fd_ >= 0) {
+        if (state_ == S_NEGOTIATE) {
+            const char* data;
+            size_t len;
+            if (!rx_.nextLine(data, len)) {
+                return;
+            }
+            std::string line(data, lineLength(data, data + len));
+
+            if (line == "TEXT TCP 1.1 OK" || line == "TEXT TCP 1.0 OK") {
+                text_ = true;
+            } else if (line == "BINARY TCP 1.1 OK") {
+                text_ = false;
+            } else if (line == "TEXT TCP 1.1 " PERSIST_TOKEN " OK") {
+                text_ = true;
+                persistent_ = true;
+            } else if (line == "BINARY TCP 1.1 " PERSIST_TOKEN " OK") {
+                text_ = false;
+                persistent_ = true;
+            } else if (line == "TEXT TCP 1.1 " PIPELINE_TOKEN " OK" || line == "BINARY TCP 1.1 " PIPELINE_TOKEN " OK") {
+                // Assignments are only sent on request
+                text_ = line[0] == 'T';
+                state_ = S_PIPELINE;
+                continue;
+            } else {
+                closeLater();
+                return;
+            }
+            sendAssignment();
+        } else if (state_ == S_RESULT) {
+            bool ok;
+            if (text_) {
+                const char* line;
+                size_t len;
+                if (!rx_.nextLine(line, len)) {
+                    return;
+                }
+                int32_t value;
+                ok = parseTextInt32(line, line + len, value) && value == assignment_.expected;
+                tx_ += ok ? "OK\n" : "ERROR\n";
+            } else {
+                const char* data;
+                if (!rx_.nextFrame(sizeof(calcProtocol), data)) {
+                    return;
+                }
+                ok = calcProtocolId(data) == assignment_.id && calcProtocolResult(data) == assignment_.expected;
+                appendCalcMessage(tx_, makeCalcMessage(ok ? 1 : 2, PROTOCOL_TCP));
+            }
+            (ok ? worker_.stats().ok : worker_.stats().error)[text_ ? TCP_TEXT : TCP_BINARY]++;
+            state_ = persistent_ ? S_IDLE : S_DONE;
+            worker_.loop().addTimer(&timer_, CONNECTION_TIMEOUT_MS);
+        } else if (state_ == S_IDLE) {
+            // Persistent connection: wait for the request for the next assignment
+            bool next;
+            if (text_) {
+                const char* line;
+                size_t len;
+                if (!rx_.nextLine(line, len)) {
+                    return;
+                }
+                next = len == sizeof(PERSIST_TEXT_NEXT) - 1 && memcmp(line, PERSIST_TEXT_NEXT, len) == 0;
+            } else {
+                const char* data;
+                if (!rx_.nextFrame(sizeof(calcMessage), data)) {
+                    return;
+                }
+                calcMessage request = decodeCalcMessage(data);
+                next = request.type == MSG_TYPE_CALC_MESSAGE && request.message == 0 &&
+                       request.protocol == PROTOCOL_TCP;
+            }
+            if (!next) {
+                closeLater();
+                return;
+            }
+            sendAssignment();
+        } else if (state_ == S_PIPELINE) {
+            if (!(text_ ? processPipelinedLine() : processPipelinedFrame())) {
+                return;
+            }
+            worker_.loop().addTimer(&timer_, CONNECTION_TIMEOUT_MS);
+        } else {
+            return;
+        }
+    }
+}
+
+// Issue a pipelined assignment; false if the client has too many outstanding
+bool Connection::sendPipelinedAssignment() {
+    if (pipeline_.size() >= PIPELINE_MAX_OUTSTANDING) {
+        return false;
+    }
+    Assignment a = worker_.newAssignment();
+    pipeline_[a.id] = a.expected;
+
+    if (text_) {
+        char line[INT32_TEXT_MAX + 1 + ASSIGNMENT_TEXT_MAX];
+        size_t len = formatUint32(a.id, line);
+        line[len++] = ' ';
+        len += formatAssignment(a, line + len);
+        tx_.append(line, len);
+    } else {
+        appendCalcProtocol(tx_, assignmentFrame(a));
+    }
+    return true;
+}
+
+// Check a pipelined result; false if the id is not outstanding
+bool Connection::checkPipelinedResult(uint32_t id, int32_t value, bool& ok) {
+    std::map<uint32_t, int32_t>::iterator it = pipeline_.find(id);
+    if (it == pipeline_.end()) {
+        return false;
+    }
+    ok = value == it->second;
+    pipeline_.erase(it);
+    (ok ? worker_.stats().ok : worker_.stats().error)[text_ ? TCP_TEXT : TCP_BINARY]++;
+    return true;
+}
+
+// One TEXT request or result; false if no complete line is buffered or the connection was closed
+bool Connection::processPipelinedLine() {
+    const char* line;
+    size_t len;
+    if (!rx_.nextLine(line, len)) {
+        return false;
+    }
+
+    if (len == sizeof(PERSIST_TEXT_NEXT) - 1 && memcmp(line, PERSIST_TEXT_NEXT, len) == 0) {
+        if (!sendPipelinedAssignment()) {
+            closeLater();
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t id;
+    int32_t value;
+    bool ok;
+    if (!parseTextIdResult(line, line + len, id, value) || !checkPipelinedResult(id, value, ok)) {
+        closeLater();
+        return false;
+    }
+
+    char verdict[INT32_TEXT_MAX + 8];
+    size_t verdict_len = formatUint32(id, verdict);
+    const char* word = ok ? " OK\n" : " ERROR\n";
+    memcpy(verdict + verdict_len, word, strlen(word));
+    tx_.append(verdict, verdict_len + strlen(word));
+    return true;
+}
+
+// One BINARY request or result; false if no complete frame is buffered or the connection was closed
+bool Connection::processPipelinedFrame() {
+    if (rx_.size() < sizeof(uint16_t)) {
+        return false;
+    }
+    uint16_t type = frameType(rx_.data());
+
+    const char* data;
+    if (type == MSG_TYPE_CALC_MESSAGE) {
+        if (!rx_.nextFrame(sizeof(calcMessage), data)) {
+            return false;
+        }
+        calcMessage request = decodeCalcMessage(data);
+        if (request.message != 0 || request.protocol != PROTOCOL_TCP || !sendPipelinedAssignment()) {
+            closeLater();
+            return false;
+        }
+        return true;
+    }
+
+    if (type == MSG_TYPE_CALC_PROTOCOL) {
+        if (!rx_.nextFrame(sizeof(calcProtocol), data)) {
+            return false;
+        }
+        uint32_t id = calcProtocolId(data);
+        bool ok;
+        if (!checkPipelinedResult(id, calcProtocolResult(data), ok)) {
+            closeLater();
+            return false;
+        }
+
+        calcVerdict verdict = { MSG_TYPE_CALC_VERDICT, (uint16_t)(ok ? 1 : 2), id };
+        appendCalcVerdict(tx_, verdict);
+        return true;
+    }
+
+    closeLater();
+    return false;
+}
+
+void Connection::flush() {
+    while (!tx_.empty()) {
+        ssize_t n = send(fd_, tx_.data(), tx_.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                break;
+            }
+            closeLater();
+            return;
+        }
+        tx_.erase(0, (size_t)n);
+    }
+
+    // The session is over once the verdict is out; the client closes its side
+    if (tx_.empty() && state_ == S_DONE) {
+        closeLater();
+        return;
+    }
+
+    bool want_write = !tx_.empty();
+    if (want_write != writing_) {
+        writing_ = want_write;
+        worker_.loop().modify(fd_, EV_READ | (want_write ? EV_WRITE : 0), this);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Setup
+
+// Create a non-blocking SO_REUSEPORT socket bound to the port, dual-stack if possible
+static int bindSocket(int socktype, int port) {
+    int families[2] = { AF_INET6, AF_INET };
+    for (int i = 0; i < 2; i++) {
+        int fd = socket(families[i], socktype, 0);
+        if (fd < 0) {
+            continue;
+        }
+
+        int one = 1;
+        int zero = 0;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
+        memset(&addr, 0, sizeof(addr));
+        if (families[i] == AF_INET6) {
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+            struct sockaddr_in6* a6 = (struct sockaddr_in6*)&addr;
+            a6->sin6_family = AF_INET6;
+            a6->sin6_addr = in6addr_any;
+            a6->sin6_port = htons((uint16_t)port);
+            addr_len = sizeof(*a6);
+        } else {
+            struct sockaddr_in* a4 = (struct sockaddr_in*)&addr;
+            a4->sin_family = AF_INET;
+            a4->sin_addr.s_addr = htonl(INADDR_ANY);
+            a4->sin_port = htons((uint16_t)port);
+            addr_len = sizeof(*a4);
+        }
+
+        if (bind(fd, (struct sockaddr*)&addr, addr_len) == 0 &&
+            (socktype != SOCK_STREAM || listen(fd, SOMAXCONN) == 0) &&
+            setNonBlocking(fd)) {
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [-t THREADS] [-l LOSS_PERCENT] PORT" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) {
+        threads = 1;
+    }
+    int port = -1;
+    int loss_percent = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads <= 0) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            long value = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || value < 0 || value >= 100) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            loss_percent = (int)value;
+        } else if (port < 0) {
+            char* end = nullptr;
+            long value = strtol(argv[i], &end, 10);
+            if (end == argv[i] || *end != '\0' || value <= 0 || value > 65535) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            port = (int)value;
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (port < 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    // One TCP and one UDP socket per worker; the kernel spreads clients over them
+    std::vector<Worker*> workers;
+    for (int i = 0; i < threads; i++) {
+        int tcp_fd = bindSocket(SOCK_STREAM, port);
+        int udp_fd = bindSocket(SOCK_DGRAM, port);
+        if (tcp_fd < 0 || udp_fd < 0) {
+            printError("Failed to bind port " + std::to_string(port));
+            return EXIT_FAILURE;
+        }
+        workers.push_back(new Worker(tcp_fd, udp_fd, (unsigned)i, (unsigned)loss_percent));
+    }
+
+    std::cout << "Listening on port " << port << " (TCP+UDP, TEXT+BINARY) with "
+              << threads << " worker(s)" << std::endl;
+    if (loss_percent > 0) {
+        std::cout << "Dropping " << loss_percent << "% of UDP datagrams in each direction" << std::endl;
+    }
+
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < workers.size(); i++) {
+        pool.push_back(std::thread(&Worker::run, workers[i]));
+    }
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i].join();
+    }
+
+    ServerStats total;
+    for (size_t i = 0; i < workers.size(); i++) {
+        for (int v = 0; v < 4; v++) {
+            total.ok[v] += workers[i]->stats().ok[v];
+            total.error[v] += workers[i]->stats().error[v];
+        }
+        delete workers[i];
+    }
+    for (int v = 0; v < 4; v++) {
+        std::cout << VARIANT_NAMES[v] << ": OK " << total.ok[v] << ", ERROR " << total.error[v] << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
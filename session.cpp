@@ -0,0 +1,463 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#include "session.h"
+#include "client.h"
+#include "calcLib.h"
+#include "textproto.h"
+#include "binproto.h"
+#include "stats.h"
+
+Session::Session(bool datagram, bool text)
+    : solved_(), datagram_(datagram), text_(text), status_(SESSION_RUNNING), progress_(0), phase_(PHASE_NONE), retransmits_(0) {
+}
+
+bool Session::retransmit() {
+    if (!datagram_ || done() || last_datagram_.empty() || retransmits_ >= UDP_MAX_RETRANSMITS) {
+        return false;
+    }
+    if (tx_.empty()) {
+        tx_ = last_datagram_;
+    }
+    retransmits_++;
+    return true;
+}
+
+void Session::onClosed() {
+    fail(waitError());
+}
+
+void Session::onTimeout() {
+    if (!done()) {
+        statsCount(STAT_TIMEOUT);
+    }
+    fail(datagram_ ? "MESSAGE LOST (TIMEOUT)" : waitError());
+}
+
+void Session::fail(const std::string& message) {
+    if (!done()) {
+        printError(message);
+        error_ = message;
+        status_ = SESSION_ERROR;
+    }
+}
+
+void Session::finish(bool ok) {
+    status_ = ok ? SESSION_OK : SESSION_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+// Protocol steps shared by the TCP and UDP variants of each API
+
+// Parse and solve a text assignment line ("operation value1 value2", newline optional).
+// On success the answer line is appended to tx.
+bool solveTextAssignment(const char* line, size_t len, SolvedAssignment& solved, std::string& tx) {
+    len = lineLength(line, line + len);
+    if (!quiet_mode) {
+        std::cout << "ASSIGNMENT: ";
+        std::cout.write(line, len);
+        std::cout << std::endl;
+    }
+
+    uint32_t op_code;
+    int32_t value1, value2;
+    if (!parseTextAssignment(line, line + len, op_code, value1, value2)) {
+        printError("Invalid assignment format: " + std::string(line, len));
+        return false;
+    }
+    int32_t result = calculate(op_code, value1, value2);
+    DEBUG_PRINT("Calculated the result to " << result);
+    solved.op = op_code;
+    solved.value1 = value1;
+    solved.value2 = value2;
+    solved.result = result;
+
+    char answer[INT32_TEXT_MAX + 1];
+    size_t answer_len = formatInt32(result, answer);
+    answer[answer_len++] = '\n';
+    tx.append(answer, answer_len);
+    return true;
+}
+
+// Handle the server's text verdict line (newline optional)
+bool checkTextVerdict(const char* line, size_t len, int32_t result) {
+    len = lineLength(line, line + len);
+    if (len == 2 && line[0] == 'O' && line[1] == 'K') {
+        if (!quiet_mode) std::cout << "OK (myresult=" << result << ")" << std::endl;
+        return true;
+    }
+    if (!quiet_mode) std::cout << "ERROR (myresult=" << result << ")" << std::endl;
+    return false;
+}
+
+// A UDP text datagram that is an assignment rather than a verdict: the server
+// answered a retransmitted request again
+bool isDuplicateAssignment(const char* data, size_t len) {
+    uint32_t op_code;
+    int32_t value1, value2;
+    return parseTextAssignment(data, data + len, op_code, value1, value2);
+}
+
+// Decode, check and solve a calcProtocol assignment frame.
+// On success the answer frame is appended to tx.
+bool solveBinaryAssignment(const char* frame, SolvedAssignment& solved, std::string& tx) {
+    calcProtocol calc_msg = decodeCalcProtocol(frame);
+
+    // Check message type and version
+    if (calc_msg.type != MSG_TYPE_CALC_PROTOCOL ||
+        calc_msg.major_version != MAJOR_VERSION ||
+        calc_msg.minor_version != MINOR_VERSION) {
+        printError("WRONG SIZE OR INCORRECT PROTOCOL");
+        return false;
+    }
+
+    if (!quiet_mode) std::cout << "ASSIGNMENT: " << operation_to_string(calc_msg.arith)
+                               << " " << calc_msg.inValue1 << " " << calc_msg.inValue2 << std::endl;
+
+    int32_t result = calculate(calc_msg.arith, calc_msg.inValue1, calc_msg.inValue2);
+    DEBUG_PRINT("Calculated the result to " << result);
+    solved.op = calc_msg.arith;
+    solved.value1 = calc_msg.inValue1;
+    solved.value2 = calc_msg.inValue2;
+    solved.result = result;
+
+    // Answer with the assignment and the result filled in
+    calc_msg.inResult = result;
+    appendCalcProtocol(tx, calc_msg);
+    return true;
+}
+
+// Handle the server's calcMessage verdict frame
+bool checkBinaryVerdict(const char* frame, int32_t result) {
+    calcMessage response = decodeCalcMessage(frame);
+
+    if (response.type == MSG_TYPE_CALC_MESSAGE) {
+        if (response.message == 1) { // OK
+            if (!quiet_mode) std::cout << "OK (myresult=" << result << ")" << std::endl;
+            return true;
+        } else if (response.message == 2) { // NOT OK
+            printError("Server sent NOT OK message");
+            return false;
+        }
+    }
+
+    printError("Invalid server response");
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// Encoding policies: what the messages of one API look like. Everything is
+// static so the session template below calls straight into it.
+
+enum CalcState { S_BANNER, S_ASSIGNMENT, S_VERDICT };
+
+// Does [data, data + len) contain needle?
+static bool contains(const char* data, size_t len, const char* needle) {
+    size_t needle_len = strlen(needle);
+    return std::search(data, data + len, needle, needle + needle_len) != data + len;
+}
+
+// TEXT: newline terminated lines
+struct TextEncoding {
+    static const bool TEXT = true;
+
+    // TCP: the TEXT versions listed in the banner
+    class Banner {
+    public:
+        Banner() : offers_text_(false), offers_11_(false), offers_10_(false), offers_persist_(false) {}
+
+        void onLine(const char* line, size_t len) {
+            offers_text_ = offers_text_ || contains(line, len, "TEXT TCP");
+            offers_11_ = offers_11_ || contains(line, len, "TEXT TCP 1.1");
+            offers_10_ = offers_10_ || contains(line, len, "TEXT TCP 1.0");
+            offers_persist_ = offers_persist_ || contains(line, len, "TEXT TCP 1.1 " PERSIST_TOKEN);
+        }
+
+        bool offered() const { return offers_text_; }
+        bool offersPersist() const { return offers_persist_; }
+
+        // Try 1.1 first, fall back to what the server offers
+        const char* accept(bool persist) const {
+            if (persist) {
+                return "TEXT TCP 1.1 " PERSIST_TOKEN " OK\n";
+            }
+            return offers_11_ || !offers_10_ ? "TEXT TCP 1.1 OK\n" : "TEXT TCP 1.0 OK\n";
+        }
+
+    private:
+        bool offers_text_;
+        bool offers_11_;
+        bool offers_10_;
+        bool offers_persist_;
+    };
+
+    // TCP: servers may skip negotiation and send the assignment directly
+    static bool isBareAssignment(const char* line, size_t len) { return !contains(line, len, " TCP "); }
+
+    static bool nextMessage(FrameBuffer& rx, CalcState, const char*& msg, size_t& len) {
+        return rx.nextLine(msg, len);
+    }
+
+    // The opening UDP datagram, or the request for the next assignment on a
+    // persistent connection
+    static void appendRequest(std::string& tx, bool datagram) { tx += datagram ? "TEXT UDP 1.1\n" : PERSIST_TEXT_NEXT; }
+
+    // Error for a message that cannot be what the state expects, if any
+    static const char* badAssignment(const char*, size_t) { return nullptr; }
+    static const char* badVerdict(const char*, size_t) { return nullptr; }
+
+    static bool solveAssignment(const char* msg, size_t len, SolvedAssignment& solved, std::string& tx) {
+        return solveTextAssignment(msg, len, solved, tx);
+    }
+    static bool isDuplicate(const char* msg, size_t len) { return isDuplicateAssignment(msg, len); }
+    static bool checkVerdict(const char* msg, size_t len, int32_t result) { return checkTextVerdict(msg, len, result); }
+
+    static const char* waitError(bool, CalcState state) {
+        switch (state) {
+            case S_BANNER:     return "Failed to receive message from server";
+            case S_ASSIGNMENT: return "Failed to receive assignment";
+            default:           return "Failed to receive server response";
+        }
+    }
+};
+
+// BINARY: calcProtocol assignments and calcMessage requests and verdicts
+struct BinaryEncoding {
+    static const bool TEXT = false;
+
+    // TCP: the banner must offer BINARY TCP 1.1
+    class Banner {
+    public:
+        Banner() : offers_binary_(false), offers_persist_(false) {}
+
+        void onLine(const char* line, size_t len) {
+            static const char BINARY_11[] = "BINARY TCP 1.1";
+            static const char BINARY_PERSIST[] = "BINARY TCP 1.1 " PERSIST_TOKEN;
+            size_t n = sizeof(BINARY_11) - 1;
+            offers_binary_ = offers_binary_ || (len >= n && memcmp(line + len - n, BINARY_11, n) == 0);
+            offers_persist_ = offers_persist_ || contains(line, len, BINARY_PERSIST);
+        }
+
+        bool offered() const { return offers_binary_; }
+        bool offersPersist() const { return offers_persist_; }
+
+        const char* accept(bool persist) const {
+            return persist ? "BINARY TCP 1.1 " PERSIST_TOKEN " OK\n" : "BINARY TCP 1.1 OK\n";
+        }
+
+    private:
+        bool offers_binary_;
+        bool offers_persist_;
+    };
+
+    static bool isBareAssignment(const char*, size_t) { return false; }
+
+    static bool nextMessage(FrameBuffer& rx, CalcState state, const char*& msg, size_t& len) {
+        len = state == S_VERDICT ? sizeof(calcMessage) : sizeof(calcProtocol);
+        return rx.nextFrame(len, msg);
+    }
+
+    static void appendRequest(std::string& tx, bool datagram) {
+        appendCalcMessage(tx, makeCalcMessage(0, datagram ? PROTOCOL_UDP : PROTOCOL_TCP));
+    }
+
+    // TCP frames always have the expected size; UDP datagrams need not
+    static const char* badAssignment(const char* msg, size_t len) {
+        if (len == sizeof(calcMessage)) {
+            calcMessage reply = decodeCalcMessage(msg);
+            if (reply.type == MSG_TYPE_CALC_MESSAGE && reply.message == 2) {
+                return "Server sent NOT OK message";
+            }
+        }
+        return len != sizeof(calcProtocol) ? "WRONG SIZE OR INCORRECT PROTOCOL" : nullptr;
+    }
+    static const char* badVerdict(const char*, size_t len) {
+        return len != sizeof(calcMessage) ? "WRONG SIZE OR INCORRECT PROTOCOL" : nullptr;
+    }
+
+    static bool solveAssignment(const char* msg, size_t, SolvedAssignment& solved, std::string& tx) {
+        return solveBinaryAssignment(msg, solved, tx);
+    }
+    // The same assignment again, or a second one (another id) that the server will let expire
+    static bool isDuplicate(const char*, size_t len) { return len == sizeof(calcProtocol); }
+    static bool checkVerdict(const char* msg, size_t, int32_t result) { return checkBinaryVerdict(msg, result); }
+
+    static const char* waitError(bool datagram, CalcState state) {
+        if (datagram) {
+            return state == S_ASSIGNMENT ? "Failed to receive server response" : "Failed to receive final response";
+        }
+        return state == S_BANNER ? "Failed to receive protocol information" : "WRONG SIZE OR INCORRECT PROTOCOL";
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Transport policies: the Session base a protocol runs on. Both bases hand
+// complete messages to Derived::onMessage() without a virtual call.
+
+// TCP: lines and frames are cut out of the receive buffer by Derived::nextMessage()
+template <typename Derived>
+class FramedStreamSession : public StreamSession {
+public:
+    void resume() override {
+        persistent_ = true;
+        static_cast<Derived*>(this)->onResume();
+    }
+
+protected:
+    explicit FramedStreamSession(bool text) : StreamSession(text) {}
+
+    void process() override {
+        Derived& self = static_cast<Derived&>(*this);
+        const char* msg;
+        size_t len;
+        while (!done() && self.nextMessage(rx_, msg, len)) {
+            self.onMessage(msg, len);
+        }
+    }
+
+    bool wantPersistent() const { return want_persistent_; }
+    void setPersistent() { persistent_ = true; }
+    void setExchanged() { exchanged_ = true; }
+};
+
+// UDP: every datagram is one message
+template <typename Derived>
+class DatagramSession : public Session {
+public:
+    void onReceive(const char* data, size_t len) override {
+        static_cast<Derived*>(this)->onMessage(data, len);
+    }
+
+protected:
+    explicit DatagramSession(bool text) : Session(true, text) {}
+
+    // Persistence is a TCP extension
+    bool wantPersistent() const { return false; }
+    void setPersistent() {}
+    void setExchanged() {}
+};
+
+struct StreamTransport {
+    template <typename Derived> using Base = FramedStreamSession<Derived>;
+    static const bool DATAGRAM = false;
+};
+
+struct DatagramTransport {
+    template <typename Derived> using Base = DatagramSession<Derived>;
+    static const bool DATAGRAM = true;
+};
+
+// ---------------------------------------------------------------------------
+// One state machine for every transport and API:
+// [banner ->] assignment -> verdict
+
+template <typename Transport, typename Encoding>
+class CalcSession : public Transport::template Base<CalcSession<Transport, Encoding> > {
+    typedef typename Transport::template Base<CalcSession> Base;
+    friend Base;
+
+public:
+    CalcSession() : Base(Encoding::TEXT), state_(Transport::DATAGRAM ? S_ASSIGNMENT : S_BANNER), banner_lines_(0) {}
+
+    void start() override {
+        if (Transport::DATAGRAM) {
+            this->tx_.clear();
+            Encoding::appendRequest(this->tx_, true);
+        }
+    }
+
+protected:
+    const char* waitError() const override { return Encoding::waitError(Transport::DATAGRAM, state_); }
+
+private:
+    // TCP: an earlier session left the connection negotiated
+    void onResume() {
+        state_ = S_ASSIGNMENT;
+        Encoding::appendRequest(this->tx_, false);
+    }
+
+    // TCP: the banner is lines for every API
+    bool nextMessage(FrameBuffer& rx, const char*& msg, size_t& len) {
+        if (state_ == S_BANNER) {
+            return rx.nextLine(msg, len);
+        }
+        return Encoding::nextMessage(rx, state_, msg, len);
+    }
+
+    void onMessage(const char* msg, size_t len) {
+        if (state_ == S_BANNER) {
+            if (banner_lines_++ == 0 && Encoding::isBareAssignment(msg, len)) {
+                state_ = S_ASSIGNMENT;
+            } else {
+                onBannerLine(msg, lineLength(msg, msg + len));
+                return;
+            }
+        }
+
+        if (state_ == S_ASSIGNMENT) {
+            const char* error = Encoding::badAssignment(msg, len);
+            if (error != nullptr) {
+                this->fail(error);
+                return;
+            }
+            if (!Encoding::solveAssignment(msg, len, this->solved_, this->tx_)) {
+                this->finish(false);
+                return;
+            }
+            state_ = S_VERDICT;
+            this->reach(PHASE_ASSIGNMENT);
+            this->advance();
+            return;
+        }
+
+        if (Transport::DATAGRAM && Encoding::isDuplicate(msg, len)) {
+            // Our request was retransmitted and the server answered twice
+            DEBUG_PRINT("Ignoring duplicate assignment");
+            return;
+        }
+        const char* error = Encoding::badVerdict(msg, len);
+        if (error != nullptr) {
+            this->fail(error);
+            return;
+        }
+        this->reach(PHASE_VERDICT);
+        this->finish(Encoding::checkVerdict(msg, len, this->solved_.result));
+        this->setExchanged();
+    }
+
+    // The protocol list, one per line, ends with an empty line
+    void onBannerLine(const char* line, size_t len) {
+        if (len > 0) {
+            banner_.onLine(line, len);
+            return;
+        }
+
+        if (!banner_.offered()) {
+            this->fail("MISSMATCH PROTOCOL");
+            return;
+        }
+        bool persist = this->wantPersistent() && banner_.offersPersist();
+        this->tx_ += banner_.accept(persist);
+        if (persist) {
+            this->setPersistent();
+        }
+        state_ = S_ASSIGNMENT;
+        this->reach(PHASE_NEGOTIATE);
+        this->advance();
+    }
+
+    CalcState state_;
+    unsigned banner_lines_;
+    typename Encoding::Banner banner_;
+};
+
+Session* createSession(bool tcp, bool text) {
+    if (tcp) {
+        return text ? static_cast<Session*>(new CalcSession<StreamTransport, TextEncoding>())
+                    : new CalcSession<StreamTransport, BinaryEncoding>();
+    }
+    return text ? static_cast<Session*>(new CalcSession<DatagramTransport, TextEncoding>())
+                : new CalcSession<DatagramTransport, BinaryEncoding>();
+}
@@ -0,0 +1,219 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "framebuf.h"
+
+// Times a UDP session sends the same datagram again before giving up on a reply
+#define UDP_MAX_RETRANSMITS 3
+
+enum SessionStatus {
+    SESSION_RUNNING,
+    SESSION_OK,
+    SESSION_ERROR
+};
+
+// Milestones of a session, in order. Drivers time the transport ones
+// (resolve, connect) and the result leaving; the Session reports the rest.
+enum SessionPhase {
+    PHASE_NONE = -1,
+    PHASE_RESOLVE,      // Server address known (and UDP socket set up)
+    PHASE_CONNECT,      // TCP connection established
+    PHASE_NEGOTIATE,    // Protocol accepted (TCP banner)
+    PHASE_ASSIGNMENT,   // Assignment received and solved
+    PHASE_RESULT,       // Result handed to the kernel
+    PHASE_VERDICT,      // Verdict received
+    PHASE_COUNT
+};
+
+// An assignment and the answer computed for it
+struct SolvedAssignment {
+    uint32_t op;        // ARITH_*, 0 until an assignment has been solved
+    int32_t value1;
+    int32_t value2;
+    int32_t result;
+};
+
+// Non-blocking protocol state machine for one calculator session
+// (negotiate -> assignment -> result -> verdict). A Session never touches a
+// socket: the driver feeds it whatever bytes arrive and transmits whatever it
+// queues, which lets the same state machines run on top of any I/O backend.
+class Session {
+public:
+    virtual ~Session() {}
+
+    // True for UDP sessions: every onReceive() call is exactly one datagram and
+    // every queued output is exactly one datagram
+    bool isDatagram() const { return datagram_; }
+
+    // True for the TEXT API, false for BINARY
+    bool isText() const { return text_; }
+
+    // Queue the client's opening message, if the protocol has one
+    virtual void start() {}
+
+    // Process received bytes (TCP) or one received datagram (UDP)
+    virtual void onReceive(const char* data, size_t len) = 0;
+
+    // Persistent connections (TCP, negotiated "PERSIST" protocol extension):
+    // offer persistence during negotiation; call before the banner arrives
+    virtual void requestPersistent() {}
+
+    // Start on a connection an earlier session left negotiated and idle:
+    // skip the banner and ask the server for the next assignment
+    virtual void resume() {}
+
+    // The session finished its exchange on a persistent connection, which can
+    // now carry another session
+    virtual bool reusable() const { return false; }
+
+    // TCP sessions expose their receive buffer so the driver can recv() into it
+    // directly and then call onBuffered(); nullptr for UDP sessions
+    virtual FrameBuffer* receiveBuffer() { return nullptr; }
+    virtual void onBuffered() {}
+
+    // The peer closed the connection before the session finished
+    virtual void onClosed();
+
+    // Nothing arrived within timeoutMs() of the last progress
+    virtual void onTimeout();
+
+    // The driver hit an I/O error
+    void abort(const std::string& message) { fail(message); }
+
+    // UDP: the reply to the last datagram did not arrive in time, queue it
+    // again. Returns false once the current step has used up its
+    // UDP_MAX_RETRANSMITS; the driver then calls onTimeout().
+    bool retransmit();
+
+    // Retransmissions of the current step's datagram
+    unsigned retransmits() const { return retransmits_; }
+
+    // How long the driver may wait for the next message in the current state
+    // (UDP drivers use their RttEstimator instead)
+    int timeoutMs() const { return datagram_ ? 2000 : 5000; }
+
+    SessionStatus status() const { return status_; }
+    bool done() const { return status_ != SESSION_RUNNING; }
+    int32_t result() const { return solved_.result; }
+
+    // The assignment solved so far, and why the session failed (if it did)
+    const SolvedAssignment& assignment() const { return solved_; }
+    const std::string& error() const { return error_; }
+
+    // Bytes (TCP) or the datagram (UDP) waiting to be sent
+    bool hasOutput() const { return !tx_.empty(); }
+    const std::string& output() const { return tx_; }
+    void consumeOutput(size_t len) {
+        if (datagram_) {
+            last_datagram_.assign(tx_, 0, len);
+        }
+        tx_.erase(0, len);
+    }
+
+    // Number of completed protocol steps; the driver re-arms its timeout when it changes
+    unsigned progress() const { return progress_; }
+
+    // Last milestone the protocol reached (negotiate, assignment or verdict)
+    SessionPhase phase() const { return phase_; }
+
+protected:
+    Session(bool datagram, bool text);
+
+    void fail(const std::string& message);
+    void finish(bool ok);
+    void advance() {
+        progress_++;
+        retransmits_ = 0;
+    }
+    void reach(SessionPhase phase) { phase_ = phase; }
+
+    // Message printed when the connection closes or times out in the current state
+    virtual const char* waitError() const = 0;
+
+    std::string tx_;
+    SolvedAssignment solved_;
+
+private:
+    bool datagram_;
+    bool text_;
+    SessionStatus status_;
+    unsigned progress_;
+    SessionPhase phase_;
+    std::string last_datagram_;     // UDP: kept for retransmit()
+    unsigned retransmits_;
+    std::string error_;
+};
+
+// A TCP session: bytes accumulate in a FrameBuffer and process() takes
+// complete lines and frames out of it
+class StreamSession : public Session {
+public:
+    void requestPersistent() override { want_persistent_ = true; }
+
+    bool reusable() const override { return persistent_ && exchanged_ && rx_.empty(); }
+
+    void onReceive(const char* data, size_t len) override {
+        if (!rx_.append(data, len)) {
+            fail("Message too long");
+            return;
+        }
+        onBuffered();
+    }
+
+    FrameBuffer* receiveBuffer() override { return &rx_; }
+
+    void onBuffered() override {
+        process();
+        if (!done() && rx_.full()) {
+            fail("Message too long");
+        }
+    }
+
+protected:
+    explicit StreamSession(bool text)
+        : Session(false, text), want_persistent_(false), persistent_(false), exchanged_(false) {}
+
+    virtual void process() = 0;
+
+    FrameBuffer rx_;
+    bool want_persistent_;      // Accept the PERSIST extension if offered
+    bool persistent_;           // The connection runs with PERSIST
+    bool exchanged_;            // The verdict arrived; the connection is idle again
+};
+
+// Create the state machine for one protocol/API combination: one template
+// (session.cpp) with the transport and the encoding as policies, so the
+// protocol steps are direct calls with no runtime protocol checks
+Session* createSession(bool tcp, bool text);
+
+// Protocol steps, shared by the Session state machines and the coroutine
+// sessions (cosession.cpp). The solve functions print the assignment and
+// append the answer to tx; the verdict checks print OK/ERROR.
+bool solveTextAssignment(const char* line, size_t len, SolvedAssignment& solved, std::string& tx);
+bool checkTextVerdict(const char* line, size_t len, int32_t result);
+bool isDuplicateAssignment(const char* data, size_t len);     // UDP: an assignment line instead of a verdict
+bool solveBinaryAssignment(const char* frame, SolvedAssignment& solved, std::string& tx);
+bool checkBinaryVerdict(const char* frame, int32_t result);
+
+// Backend-independent view of something that drives a Session over a socket
+class SessionDriver {
+public:
+    virtual ~SessionDriver() {}
+    virtual bool done() const = 0;
+    virtual bool ok() const = 0;
+    virtual bool connectFailed() const = 0;
+    virtual bool isTCP() const = 0;
+};
+
+// Notified when a driven session has finished (successfully or not)
+class SessionObserver {
+public:
+    virtual ~SessionObserver() {}
+    virtual void onSessionDone(SessionDriver* session) = 0;
+};
+
+#endif // SESSION_H
@@ -0,0 +1,186 @@
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+thread_local StatsSlot* stats_slot = nullptr;
+
+static StatsFile* stats_file = nullptr;
+
+static void initStats(StatsFile* file) {
+    StatsHeader& header = file->header;
+    header.version = STATS_VERSION;
+    header.slots = STATS_SLOTS;
+    header.rtt_buckets = STATS_RTT_BUCKETS;
+    header.pid = (int64_t)getpid();
+    header.started = (int64_t)time(nullptr);
+    header.magic.store(STATS_MAGIC, std::memory_order_release);
+}
+
+// The file is set up under a temporary name and renamed into place, so a
+// clientstat still watching the file of an earlier run keeps its mapping
+bool openStatsFile(const std::string& path) {
+    std::string temp = path + ".tmp";
+    int fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    // Pages nobody counts into are never touched, so the file stays sparse
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(StatsFile)) == 0) {
+        map = mmap(nullptr, sizeof(StatsFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        unlink(temp.c_str());
+        return false;
+    }
+
+    initStats(static_cast<StatsFile*>(map));
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        munmap(map, sizeof(StatsFile));
+        unlink(temp.c_str());
+        return false;
+    }
+    stats_file = static_cast<StatsFile*>(map);
+    stats_slot = &stats_file->slots[0];
+    return true;
+}
+
+bool openStatsMemory() {
+    void* map = mmap(nullptr, sizeof(StatsFile), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    initStats(static_cast<StatsFile*>(map));
+    stats_file = static_cast<StatsFile*>(map);
+    stats_slot = &stats_file->slots[0];
+    return true;
+}
+
+void closeStatsFile() {
+    if (stats_file == nullptr) {
+        return;
+    }
+    stats_file->header.finished.store(1, std::memory_order_release);
+    munmap(stats_file, sizeof(StatsFile));
+    stats_file = nullptr;
+    stats_slot = nullptr;
+}
+
+const StatsFile* statsFile() {
+    return stats_file;
+}
+
+StatsSlot* statsSlot(unsigned index) {
+    return stats_file != nullptr ? &stats_file->slots[index % STATS_SLOTS] : nullptr;
+}
+
+void statsSessionDone(bool tcp, bool ok, bool connect_failed, uint64_t latency_us) {
+    if (!ok) {
+        statsCount(STAT_ERROR);
+        if (connect_failed) {
+            statsCount(STAT_CONNECT_FAILED);
+        }
+        return;
+    }
+    statsCount(STAT_OK);
+    size_t bucket = LatencyHistogram::bucketOf(latency_us);
+    if (bucket >= STATS_RTT_BUCKETS) {
+        bucket = STATS_RTT_BUCKETS - 1;
+    }
+    stats_slot->latency[tcp ? 1 : 0][bucket].fetch_add(1, std::memory_order_relaxed);
+    stats_slot->latency_sum[tcp ? 1 : 0].fetch_add(latency_us, std::memory_order_relaxed);
+}
+
+static bool startsWith(const std::string& s, const char* prefix) {
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+void statsCountError(const std::string& message) {
+    if (stats_slot == nullptr) {
+        return;
+    }
+    if (startsWith(message, "MISSMATCH PROTOCOL")) {
+        statsCount(STAT_MISMATCH);
+    } else if (startsWith(message, "WRONG SIZE")) {
+        statsCount(STAT_WRONG_SIZE);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Read side
+
+StatsReader::~StatsReader() {
+    if (file_ != nullptr) {
+        munmap(const_cast<StatsFile*>(file_), sizeof(StatsFile));
+    }
+}
+
+bool StatsReader::open(const std::string& path, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Failed to open " + path;
+        return false;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size != (off_t)sizeof(StatsFile)) {
+        close(fd);
+        error = path + " is not a stats file of this version";
+        return false;
+    }
+    void* map = mmap(nullptr, sizeof(StatsFile), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error = "Failed to map " + path;
+        return false;
+    }
+    file_ = static_cast<const StatsFile*>(map);
+    return true;
+}
+
+StatsReadResult StatsReader::read(StatsSnapshot& snapshot) const {
+    const StatsHeader& header = file_->header;
+    uint32_t magic = header.magic.load(std::memory_order_acquire);
+    if (magic == 0) {
+        return STATS_READ_NOT_READY;
+    }
+    if (magic != STATS_MAGIC || header.version != STATS_VERSION || header.slots != STATS_SLOTS ||
+        header.rtt_buckets != STATS_RTT_BUCKETS) {
+        return STATS_READ_MISMATCH;
+    }
+    readStats(*file_, snapshot);
+    return STATS_READ_OK;
+}
+
+void readStats(const StatsFile& file, StatsSnapshot& snapshot) {
+    const StatsHeader& header = file.header;
+    snapshot.pid = header.pid;
+    snapshot.started = header.started;
+    snapshot.finished = header.finished.load(std::memory_order_acquire) != 0;
+    for (int c = 0; c < STAT_COUNT; c++) {
+        snapshot.counters[c] = 0;
+    }
+    for (int t = 0; t < 2; t++) {
+        snapshot.latency[t].assign(STATS_RTT_BUCKETS, 0);
+        snapshot.latency_sum[t] = 0;
+    }
+
+    for (size_t i = 0; i < STATS_SLOTS; i++) {
+        const StatsSlot& slot = file.slots[i];
+        for (int c = 0; c < STAT_COUNT; c++) {
+            snapshot.counters[c] += slot.counters[c].load(std::memory_order_relaxed);
+        }
+        for (int t = 0; t < 2; t++) {
+            for (size_t b = 0; b < STATS_RTT_BUCKETS; b++) {
+                snapshot.latency[t][b] += slot.latency[t][b].load(std::memory_order_relaxed);
+            }
+            snapshot.latency_sum[t] += slot.latency_sum[t].load(std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "session.h"
+#include "timing.h"
+#include "histogram.h"
+
+// Live counters of a running client, published in a memory-mapped file (-s)
+// so that clientstat can watch a long load run while it goes, and served to
+// Prometheus by the metrics endpoint (-M, metrics.h). Every thread
+// counts into a slot of its own with relaxed atomic adds: the cache lines stay
+// with the core that owns them, the hot path takes no lock and the reader never
+// blocks a writer. Readers sum the slots; counters of one snapshot may be a few
+// sessions apart, which is fine for a monitor.
+#define STATS_MAGIC 0x31545343      // "CST1"
+#define STATS_VERSION 2
+#define STATS_SLOTS 64              // Threads beyond this share slots (the adds stay atomic)
+
+// Latency histograms use the LatencyHistogram buckets up to 2^STATS_RTT_BITS
+// microseconds (33 s, longer than any session can take); larger values land in
+// the last bucket
+#define STATS_RTT_BITS 25
+#define STATS_RTT_BUCKETS (HISTOGRAM_SUB_BUCKETS * (STATS_RTT_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1))
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+    #error "the stats file needs lock-free 64-bit atomics"
+#endif
+
+enum StatsCounter {
+    STAT_STARTED,           // Sessions a driver started
+    STAT_OK,
+    STAT_ERROR,             // Every failed session, including the ones below
+    STAT_TIMEOUT,           // Failed waiting for the server
+    STAT_CONNECT_FAILED,    // Never got to talk to the server
+    STAT_MISMATCH,          // "MISSMATCH PROTOCOL" errors
+    STAT_WRONG_SIZE,        // "WRONG SIZE OR INCORRECT PROTOCOL" errors
+    STAT_COUNT
+};
+
+// The file: a StatsHeader, then STATS_SLOTS slots. It starts out zero-filled,
+// which is a valid value for every counter.
+struct StatsHeader {
+    std::atomic<uint32_t> magic;        // Written last; 0 while the file is being set up
+    uint32_t version;
+    uint32_t slots;
+    uint32_t rtt_buckets;
+    int64_t pid;
+    int64_t started;                    // Unix time the client started publishing
+    std::atomic<uint32_t> finished;     // Set when the client is done
+};
+
+struct alignas(64) StatsSlot {
+    std::atomic<uint64_t> counters[STAT_COUNT];
+    std::atomic<uint64_t> latency[2][STATS_RTT_BUCKETS];   // [tcp], OK sessions, microseconds
+    std::atomic<uint64_t> latency_sum[2];                   // [tcp], microseconds
+};
+
+struct StatsFile {
+    alignas(64) StatsHeader header;
+    StatsSlot slots[STATS_SLOTS];
+};
+
+// Where this thread counts; nullptr (the default) when nothing is published.
+// Load generator workers each take their own slot.
+extern thread_local StatsSlot* stats_slot;
+
+// Create (or truncate) and map the stats file and count the calling thread
+// into slot 0. Returns false if the file could not be set up.
+bool openStatsFile(const std::string& path);
+
+// The same without a file, for the metrics endpoint alone
+bool openStatsMemory();
+
+// Mark the run finished and unmap the file; the file stays for a last look
+void closeStatsFile();
+
+// The counters being published, nullptr if none
+const StatsFile* statsFile();
+
+// Slot for the index-th worker thread; nullptr when nothing is published
+StatsSlot* statsSlot(unsigned index);
+
+inline void statsCount(StatsCounter counter) {
+    if (stats_slot != nullptr) {
+        stats_slot->counters[counter].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// A driver gave up on a session before it ran (e.g. the server did not resolve)
+inline void statsStartFailed() {
+    statsCount(STAT_ERROR);
+    statsCount(STAT_CONNECT_FAILED);
+}
+
+// Drivers call this when a session ends, next to recordTimings()
+void statsSessionDone(bool tcp, bool ok, bool connect_failed, uint64_t latency_us);
+
+inline void recordStats(const Session& session, const PhaseTimes& times, bool connect_failed) {
+    if (stats_slot != nullptr) {
+        statsSessionDone(!session.isDatagram(), session.status() == SESSION_OK, connect_failed, times.elapsed());
+    }
+}
+
+// printError() hands every message here to count the protocol errors
+void statsCountError(const std::string& message);
+
+// Read side (clientstat, metrics endpoint): a consistent-enough sum over all slots
+struct StatsSnapshot {
+    int64_t pid;
+    int64_t started;
+    bool finished;
+    uint64_t counters[STAT_COUNT];
+    std::vector<uint64_t> latency[2];   // [tcp], per LatencyHistogram bucket
+    uint64_t latency_sum[2];            // [tcp], microseconds
+};
+
+// Sum the slots of a file set up by this build
+void readStats(const StatsFile& file, StatsSnapshot& snapshot);
+
+enum StatsReadResult {
+    STATS_READ_OK,
+    STATS_READ_NOT_READY,       // The client is still setting the file up
+    STATS_READ_MISMATCH         // Written by a build with another layout
+};
+
+class StatsReader {
+public:
+    StatsReader() : file_(nullptr) {}
+    ~StatsReader();
+
+    // Map path read-only; false (with the reason in error) if it is not a stats file
+    bool open(const std::string& path, std::string& error);
+
+    // Fills snapshot only if the file is set up and matches this build
+    StatsReadResult read(StatsSnapshot& snapshot) const;
+
+private:
+    StatsReader(const StatsReader&);
+    StatsReader& operator=(const StatsReader&);
+
+    const StatsFile* file_;
+};
+
+#endif // STATS_H
@@ -1,12 +1,32 @@
 #include <iostream>
 #include <string>
 #include <cassert>
+#include <climits>
+#include <cstring>
 #include "calcLib.h"
 #include "protocol.h"
+#include "textproto.h"
+#include "binproto.h"
+#include "url.h"
+#include "framebuf.h"
+#include "rtt.h"
+#include "resolver.h"
+#include "timing.h"
+#include "metrics.h"
 
 // Test function prototypes
 void testCalculations();
+void testBatchCalculations();
 void testStringOperations();
+void testTextParser();
+void testURLParser();
+void testIntegerFormatter();
+void testFrameBuffer();
+void testRttEstimator();
+void testResolverCache();
+void testLatencyHistogram();
+void testMetricsFormat();
+void testBinaryCodec();
 void testProtocolStructures();
 
 int main() {
@@ -14,7 +34,17 @@ int main() {
     
     try {
         testCalculations();
+        testBatchCalculations();
         testStringOperations();
+        testTextParser();
+        testURLParser();
+        testIntegerFormatter();
+        testFrameBuffer();
+        testRttEstimator();
+        testResolverCache();
+        testLatencyHistogram();
+        testMetricsFormat();
+        testBinaryCodec();
         testProtocolStructures();
         
         std::cout << "All tests passed!" << std::endl;
@@ -44,10 +74,48 @@ void testCalculations() {
     assert(calculate(ARITH_DIV, 12, 3) == 4);
     assert(calculate(ARITH_DIV, 13, 3) == 4); // Integer division
     assert(calculate(ARITH_DIV, 10, 0) == 0); // Division by zero
+
+    // Overflow wraps around, as in calculate_batch()
+    assert(calculate(ARITH_MUL, 100000, 99999) == (int32_t)1409965408);
+    assert(calculate(ARITH_MUL, -100000, 100000) == (int32_t)-1410065408);
+    assert(calculate(ARITH_ADD, INT_MAX, 1) == INT_MIN);
+    assert(calculate(ARITH_SUB, INT_MIN, 1) == INT_MAX);
+    assert(calculate(ARITH_DIV, INT_MIN, -1) == INT_MIN);
     
     std::cout << "Arithmetic calculations: PASSED" << std::endl;
 }
 
+void testBatchCalculations() {
+    std::cout << "Testing batch calculations..." << std::endl;
+
+    // 19 entries: exercises full vectors and the scalar tail of every kernel
+    const uint32_t ops[] = { ARITH_ADD, ARITH_SUB, ARITH_MUL, ARITH_DIV, ARITH_DIV, ARITH_DIV, ARITH_DIV,
+                             ARITH_MUL, ARITH_ADD, 99, 0, ARITH_DIV, ARITH_SUB, ARITH_MUL, ARITH_DIV,
+                             ARITH_ADD, ARITH_DIV, ARITH_MUL, ARITH_DIV };
+    const int32_t v1[] = { 5, 3, -4, 13, -13, 10, 0, 46341, INT_MAX, 1, 1, INT_MIN, INT_MIN, 65536, 7,
+                           -1, INT_MAX, -3, -7 };
+    const int32_t v2[] = { 3, 10, 3, 3, 3, 0, 5, 46341, 1, 1, 1, -1, 1, 65536, -2,
+                           -1, -1, 100000, 0 };
+    // 46341 * 46341 wraps around to -2147479015
+    const int32_t expected[] = { 8, -7, -12, 4, -4, 0, 0, -2147479015, INT_MIN, 0, 0, INT_MIN, INT_MAX, 0, -3,
+                                 -2, -INT_MAX, -300000, 0 };
+    const size_t n = sizeof(ops) / sizeof(ops[0]);
+
+    for (int k = CALC_KERNEL_SCALAR; k <= (int)calculate_batch_best_kernel(); k++) {
+        int32_t out[n];
+        calculate_batch_kernel((calc_kernel)k, ops, v1, v2, out, n);
+        for (size_t i = 0; i < n; i++) {
+            assert(out[i] == expected[i]);
+        }
+    }
+
+    int32_t out[n];
+    calculate_batch(ops, v1, v2, out, n);
+    assert(out[0] == 8 && out[n - 1] == 0);
+
+    std::cout << "Batch calculations: PASSED" << std::endl;
+}
+
 void testStringOperations() {
     std::cout << "Testing string to operation conversion..." << std::endl;
     
@@ -72,12 +140,361 @@ void testStringOperations() {
     std::cout << "String operations: PASSED" << std::endl;
 }
 
+static bool parseAssignment(const char* line, uint32_t& op, int32_t& value1, int32_t& value2) {
+    return parseTextAssignment(line, line + strlen(line), op, value1, value2);
+}
+
+void testTextParser() {
+    std::cout << "Testing text assignment parser..." << std::endl;
+
+    uint32_t op;
+    int32_t value1, value2;
+
+    // Well-formed lines
+    assert(parseAssignment("add 5 3\n", op, value1, value2));
+    assert(op == ARITH_ADD && value1 == 5 && value2 == 3);
+    assert(parseAssignment("DIV -12 +4", op, value1, value2));
+    assert(op == ARITH_DIV && value1 == -12 && value2 == 4);
+    assert(parseAssignment("  Mul\t7   -8 \r\n", op, value1, value2));
+    assert(op == ARITH_MUL && value1 == 7 && value2 == -8);
+    assert(parseAssignment("sub -2147483648 2147483647", op, value1, value2));
+    assert(op == ARITH_SUB && value1 == INT_MIN && value2 == INT_MAX);
+
+    // Malformed lines
+    assert(!parseAssignment("", op, value1, value2));
+    assert(!parseAssignment("add 5", op, value1, value2));
+    assert(!parseAssignment("add 5 3 7", op, value1, value2));
+    assert(!parseAssignment("mod 5 3", op, value1, value2));
+    assert(!parseAssignment("adds 5 3", op, value1, value2));
+    assert(!parseAssignment("add5 3", op, value1, value2));
+    assert(!parseAssignment("add 5x 3", op, value1, value2));
+    assert(!parseAssignment("add - 3", op, value1, value2));
+    assert(!parseAssignment("add 2147483648 1", op, value1, value2));
+    assert(!parseAssignment("add 1 -2147483649", op, value1, value2));
+    assert(!parseAssignment("add 99999999999999999999 1", op, value1, value2));
+
+    // Ranges are not NUL-terminated: only the first 7 bytes are parsed
+    const char* line = "add 5 3999";
+    assert(parseTextAssignment(line, line + 7, op, value1, value2) && value2 == 3);
+
+    // Single integers (client results)
+    int32_t value;
+    const char* result = "-42\n";
+    assert(parseTextInt32(result, result + strlen(result), value) && value == -42);
+    result = "42 43\n";
+    assert(!parseTextInt32(result, result + strlen(result), value));
+
+    // Pipelined lines carry a leading id
+    uint32_t id;
+    bool ok;
+    line = "4000000000 mul 6 -7\n";
+    assert(parseTextIdAssignment(line, line + strlen(line), id, op, value1, value2));
+    assert(id == 4000000000u && op == ARITH_MUL && value1 == 6 && value2 == -7);
+    line = "17 -42\n";
+    assert(parseTextIdResult(line, line + strlen(line), id, value) && id == 17 && value == -42);
+    line = "17 ERROR\n";
+    assert(parseTextIdVerdict(line, line + strlen(line), id, ok) && id == 17 && !ok);
+    line = "-1 OK\n";
+    assert(!parseTextIdVerdict(line, line + strlen(line), id, ok));
+    line = "4294967296 1";
+    assert(!parseTextIdResult(line, line + strlen(line), id, value));
+    line = "17OK";
+    assert(!parseTextIdVerdict(line, line + strlen(line), id, ok));
+
+    // Line endings
+    assert(lineLength("OK\r\n", "OK\r\n" + 4) == 2);
+    assert(lineLength("OK\n", "OK\n" + 3) == 2);
+    assert(lineLength("OK", "OK" + 2) == 2);
+
+    std::cout << "Text assignment parser: PASSED" << std::endl;
+}
+
+void testURLParser() {
+    std::cout << "Testing URL parser..." << std::endl;
+
+    URLInfo info;
+    assert(parseURL("tcp://alice.nplab.bth.se:5000/text", info));
+    assert(info.host == "alice.nplab.bth.se" && info.port == 5000);
+    assert(info.transport == URL_TCP && info.text && info.protocol == "tcp" && info.api == "text");
+    assert(parseURL("UDP://127.0.0.1:65535/Binary", info));
+    assert(info.transport == URL_UDP && !info.text && info.port == 65535 && info.protocol == "UDP");
+    assert(parseURL("any://[::1]:5000/BINARY", info));
+    assert(info.transport == URL_ANY && info.host == "::1" && !info.text);
+    assert(parseURL("tcp://[::ffff:127.0.0.1]:1/text", info) && info.host == "::ffff:127.0.0.1");
+
+    // Malformed URLs leave info alone
+    const char* bad[] = { "", "invalid_url", "http://host:5000/text", "tcp:/host:5000/text", "tcp://:5000/text",
+                          "tcp://host/text", "tcp://host:/text", "tcp://host:0/text", "tcp://host:65536/text",
+                          "tcp://host:99999999999/text", "tcp://host:50x0/text", "tcp://host:5000",
+                          "tcp://host:5000/", "tcp://host:5000/json", "tcp://host:5000/texts", "tcp://[::1/text",
+                          "tcp://[]:5000/text", "tcp://[host]:5000/text", "tcp://::1:5000/text", "tcpp://host:5000/text" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        assert(!parseURL(bad[i], info));
+    }
+    assert(info.host == "::ffff:127.0.0.1" && info.port == 1);
+
+    std::cout << "URL parser: PASSED" << std::endl;
+}
+
+void testIntegerFormatter() {
+    std::cout << "Testing integer formatter..." << std::endl;
+
+    const int32_t values[] = { 0, 7, -7, 10, 1817235081, INT_MAX, INT_MIN, -100000 };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        char buf[INT32_TEXT_MAX];
+        size_t len = formatInt32(values[i], buf);
+        assert(std::string(buf, len) == std::to_string(values[i]));
+    }
+
+    std::cout << "Integer formatter: PASSED" << std::endl;
+}
+
+void testFrameBuffer() {
+    std::cout << "Testing frame buffer..." << std::endl;
+
+    const char* line;
+    const char* frame;
+    size_t len;
+
+    // A line split over several reads
+    FrameBuffer rx(64);
+    assert(!rx.nextLine(line, len));
+    assert(rx.append("TEXT TCP", 8));
+    assert(!rx.nextLine(line, len));
+    assert(rx.append(" 1.1\n", 5));
+    assert(rx.nextLine(line, len) && std::string(line, len) == "TEXT TCP 1.1\n");
+    assert(rx.empty());
+
+    // Several messages coalesced into one read, followed by a binary frame
+    assert(rx.append("a\n\nb\n0123456789", 15));
+    assert(rx.nextLine(line, len) && std::string(line, len) == "a\n");
+    assert(rx.nextLine(line, len) && std::string(line, len) == "\n");
+    assert(rx.nextLine(line, len) && std::string(line, len) == "b\n");
+    assert(!rx.nextFrame(11, frame));
+    assert(rx.nextFrame(4, frame) && std::string(frame, 4) == "0123");
+    assert(rx.size() == 6);
+
+    // Leftover bytes survive compaction when the tail runs out of room
+    std::string chunk(50, 'x');
+    assert(rx.append(chunk.data(), chunk.size()));
+    assert(rx.nextFrame(56, frame));
+    assert(std::string(frame, 6) == "456789" && frame[55] == 'x');
+    assert(rx.empty());
+
+    // A message longer than the capacity fills the buffer
+    std::string too_long(64, 'y');
+    assert(rx.append(too_long.data(), too_long.size()));
+    assert(rx.full() && !rx.nextLine(line, len));
+    assert(!rx.append("\n", 1));
+
+    std::cout << "Frame buffer: PASSED" << std::endl;
+}
+
+void testRttEstimator() {
+    std::cout << "Testing RTT estimator..." << std::endl;
+
+    RttEstimator rtt;
+    assert(!rtt.hasSample());
+    assert(rtt.timeoutMs(0) == RTO_INITIAL_MS);
+    assert(rtt.timeoutMs(1) == RTO_MAX_MS);
+
+    // First sample: SRTT = R, RTTVAR = R/2, RTO = SRTT + 4 * RTTVAR
+    rtt.sample(200);
+    assert(rtt.srttMs() == 200.0 && rtt.rttvarMs() == 100.0);
+    assert(rtt.timeoutMs(0) == 600);
+
+    // RTTVAR = 3/4 * 100 + 1/4 * |200 - 40|, SRTT = 7/8 * 200 + 1/8 * 40
+    rtt.sample(40);
+    assert(rtt.rttvarMs() == 115.0 && rtt.srttMs() == 180.0);
+    assert(rtt.timeoutMs(0) == 640 && rtt.timeoutMs(1) == 1280 && rtt.timeoutMs(2) == RTO_MAX_MS);
+
+    // Fast links are held at the minimum RTO
+    RttEstimator lan;
+    for (int i = 0; i < 20; i++) {
+        lan.sample(0);
+    }
+    assert(lan.timeoutMs(0) == RTO_MIN_MS && lan.timeoutMs(3) == 8 * RTO_MIN_MS);
+
+    std::cout << "RTT estimator: PASSED" << std::endl;
+}
+
+void testResolverCache() {
+    std::cout << "Testing resolver cache..." << std::endl;
+
+    // Numeric hosts: getaddrinfo() answers them without the network
+    ResolverCache& cache = ResolverCache::instance();
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+
+    assert(cache.resolve("127.0.0.1", 4000, AF_INET, addr, addr_len));
+    assert(addr.ss_family == AF_INET && addr_len == sizeof(struct sockaddr_in));
+    assert(ntohs(((struct sockaddr_in*)&addr)->sin_port) == 4000);
+
+    // Same host, other port and family filter: answered from the cache
+    unsigned long lookups = cache.lookups();
+    unsigned long hits = cache.hits();
+    assert(cache.resolve("127.0.0.1", 4001, AF_UNSPEC, addr, addr_len));
+    assert(ntohs(((struct sockaddr_in*)&addr)->sin_port) == 4001);
+    assert(!cache.resolve("127.0.0.1", 4001, AF_INET6, addr, addr_len));
+    assert(cache.lookups() == lookups && cache.hits() == hits + 2);
+
+    // A prefetched host is resolved in the background
+    cache.prefetch("::1");
+    assert(cache.resolve("::1", 4002, AF_UNSPEC, addr, addr_len));
+    assert(addr.ss_family == AF_INET6 && ntohs(((struct sockaddr_in6*)&addr)->sin6_port) == 4002);
+    assert(cache.lookups() == lookups + 1);
+
+    // resolveAll() fills in the port of every address
+    std::vector<SocketAddress> all;
+    assert(cache.resolveAll("::1", 4003, all));
+    assert(all.size() == 1 && all[0].len == sizeof(struct sockaddr_in6));
+    assert(ntohs(((struct sockaddr_in6*)&all[0].addr)->sin6_port) == 4003);
+
+    std::cout << "Resolver cache: PASSED" << std::endl;
+}
+
+void testLatencyHistogram() {
+    std::cout << "Testing latency histogram..." << std::endl;
+
+    // Small values are exact, larger ones land in buckets of < 1% width
+    for (uint64_t v = 0; v < 2 * HISTOGRAM_SUB_BUCKETS; v++) {
+        assert(LatencyHistogram::highestValueIn(LatencyHistogram::bucketOf(v)) == v);
+    }
+    uint64_t values[] = { 256, 1000, 12345, 999999, 1ULL << 40, UINT64_MAX };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        uint64_t high = LatencyHistogram::highestValueIn(LatencyHistogram::bucketOf(values[i]));
+        assert(high >= values[i] && high - values[i] <= values[i] / HISTOGRAM_SUB_BUCKETS);
+    }
+
+    LatencyHistogram h;
+    assert(h.count() == 0 && h.percentile(50.0) == 0);
+    for (uint64_t v = 1; v <= 1000; v++) {
+        h.record(v);
+    }
+    assert(h.count() == 1000 && h.min() == 1 && h.max() == 1000);
+    assert(h.mean() > 500.4 && h.mean() < 500.6);
+    assert(h.percentile(50.0) >= 500 && h.percentile(50.0) <= 504);
+    assert(h.percentile(99.0) >= 990 && h.percentile(99.0) <= 997);
+    assert(h.percentile(100.0) == 1000);
+
+    LatencyHistogram other;
+    other.record(5000);
+    h.merge(other);
+    assert(h.count() == 1001 && h.max() == 5000 && h.percentile(100.0) == 5000);
+
+    // Phase durations run from the previous phase reached
+    PhaseTimes times;
+    times.begin();
+    times.mark(PHASE_RESOLVE);
+    times.mark(PHASE_ASSIGNMENT);
+    assert(times.reached(PHASE_ASSIGNMENT) && !times.reached(PHASE_CONNECT));
+    assert(times.duration(PHASE_ASSIGNMENT) < 1000000);
+
+    std::cout << "Latency histogram: PASSED" << std::endl;
+}
+
+void testMetricsFormat() {
+    std::cout << "Testing Prometheus metrics format..." << std::endl;
+
+    StatsSnapshot s;
+    s.pid = 1;
+    s.started = 1700000000;
+    s.finished = false;
+    for (int c = 0; c < STAT_COUNT; c++) {
+        s.counters[c] = (uint64_t)c * 10;
+    }
+    for (int t = 0; t < 2; t++) {
+        s.latency[t].assign(STATS_RTT_BUCKETS, 0);
+        s.latency_sum[t] = 0;
+    }
+    // TCP: 50 us twice, 300 us, and one past the largest bound
+    s.latency[1][LatencyHistogram::bucketOf(50)] += 2;
+    s.latency[1][LatencyHistogram::bucketOf(300)] += 1;
+    s.latency[1][STATS_RTT_BUCKETS - 1] += 1;
+    s.latency_sum[1] = 20000400;
+
+    std::string text = formatMetrics(s);
+    assert(text.find("# TYPE calc_client_sessions_started_total counter\ncalc_client_sessions_started_total 0\n") != std::string::npos);
+    assert(text.find("calc_client_sessions_total{result=\"ok\"} 10\n") != std::string::npos);
+    assert(text.find("calc_client_sessions_total{result=\"error\"} 20\n") != std::string::npos);
+    assert(text.find("calc_client_protocol_errors_total{error=\"mismatch_protocol\"} 50\n") != std::string::npos);
+    assert(text.find("calc_client_protocol_errors_total{error=\"wrong_size\"} 60\n") != std::string::npos);
+
+    // Cumulative buckets, the overflow only in +Inf
+    assert(text.find("_bucket{transport=\"tcp\",le=\"0.0001\"} 2\n") != std::string::npos);
+    assert(text.find("_bucket{transport=\"tcp\",le=\"0.00025\"} 2\n") != std::string::npos);
+    assert(text.find("_bucket{transport=\"tcp\",le=\"0.0005\"} 3\n") != std::string::npos);
+    assert(text.find("_bucket{transport=\"tcp\",le=\"10\"} 3\n") != std::string::npos);
+    assert(text.find("_bucket{transport=\"tcp\",le=\"+Inf\"} 4\n") != std::string::npos);
+    assert(text.find("_sum{transport=\"tcp\"} 20.000400\n") != std::string::npos);
+    assert(text.find("_count{transport=\"tcp\"} 4\n") != std::string::npos);
+    assert(text.find("_count{transport=\"udp\"} 0\n") != std::string::npos);
+
+    std::cout << "Prometheus metrics format: PASSED" << std::endl;
+}
+
+// An assignment as it appears on the wire: id 0x01020304, mul -2 7, no result yet
+static constexpr char ASSIGNMENT_FRAME[] = "\x00\x01\x00\x01\x00\x01\x01\x02\x03\x04\x00\x00\x00\x03"
+                                           "\xff\xff\xff\xfe\x00\x00\x00\x07\x00\x00\x00\x00";
+
+void testBinaryCodec() {
+    std::cout << "Testing binary codec..." << std::endl;
+
+    // Decoding is usable at compile time
+    static_assert(decodeCalcProtocol(ASSIGNMENT_FRAME).id == 0x01020304, "id is big-endian");
+    static_assert(decodeCalcProtocol(ASSIGNMENT_FRAME).inValue1 == -2, "operands are signed");
+    static_assert(frameType(ASSIGNMENT_FRAME) == MSG_TYPE_CALC_PROTOCOL, "type comes first");
+
+    calcProtocol assignment = decodeCalcProtocol(ASSIGNMENT_FRAME);
+    assert(assignment.type == MSG_TYPE_CALC_PROTOCOL && assignment.major_version == 1 && assignment.minor_version == 1);
+    assert(assignment.arith == ARITH_MUL && assignment.inValue2 == 7 && assignment.inResult == 0);
+
+    // Encoding reproduces the frame, and fields can be read in place
+    char wire[2 * sizeof(calcProtocol)];
+    encodeCalcProtocol(assignment, wire);
+    assert(memcmp(wire, ASSIGNMENT_FRAME, sizeof(calcProtocol)) == 0);
+    assignment.inResult = -14;
+    encodeCalcProtocol(assignment, wire);
+    assert(calcProtocolId(wire) == 0x01020304 && calcProtocolResult(wire) == -14);
+    assert(memcmp(wire + 22, "\xff\xff\xff\xf2", 4) == 0);
+
+    // Same layout as the structs converted field by field with htons/htonl
+    calcMessage msg = makeCalcMessage(2, PROTOCOL_UDP);
+    calcMessage swapped = { htons(msg.type), htons(msg.message), htons(msg.protocol),
+                            htons(msg.major_version), htons(msg.minor_version) };
+    encodeCalcMessage(msg, wire);
+    assert(memcmp(wire, &swapped, sizeof(swapped)) == 0);
+    calcMessage decoded = decodeCalcMessage(wire);
+    assert(decoded.type == MSG_TYPE_CALC_MESSAGE && decoded.message == 2 && decoded.protocol == PROTOCOL_UDP);
+
+    calcVerdict verdict = { MSG_TYPE_CALC_VERDICT, 1, 4000000000u };
+    encodeCalcVerdict(verdict, wire);
+    assert(memcmp(wire, "\x00\x17\x00\x01\xee\x6b\x28\x00", sizeof(calcVerdict)) == 0);
+    assert(decodeCalcVerdict(wire).id == 4000000000u);
+
+    // Batches of back-to-back frames
+    calcProtocol batch[2] = { assignment, assignment };
+    batch[1].id = 7;
+    encodeCalcProtocols(batch, 2, wire);
+    calcProtocol back[2];
+    decodeCalcProtocols(wire, back, 2);
+    assert(back[0].id == 0x01020304 && back[0].inResult == -14 && back[1].id == 7);
+
+    std::string out;
+    appendCalcMessage(out, msg);
+    appendCalcProtocol(out, assignment);
+    assert(out.size() == sizeof(calcMessage) + sizeof(calcProtocol));
+    assert(calcProtocolResult(out.data() + sizeof(calcMessage)) == -14);
+
+    std::cout << "Binary codec: PASSED" << std::endl;
+}
+
 void testProtocolStructures() {
     std::cout << "Testing protocol structure sizes..." << std::endl;
     
     // Test structure sizes
     assert(sizeof(calcMessage) == 10); // 5 uint16_t fields
-    assert(sizeof(calcProtocol) == 22); // As per protocol specification
+    assert(sizeof(calcProtocol) == 26); // 3 uint16_t + 5 32-bit fields
     
     // Test that structures are properly packed
     calcMessage msg;
@@ -1,7 +1,18 @@
 #!/bin/bash
 
 # Simple test script to verify client functionality
-# Note: This requires the client to be built and servers to be accessible
+# Note: This requires the client and the reference server to be built (make client server)
+
+FAILURES=0
+
+pass() {
+    echo "✓ $1"
+}
+
+fail() {
+    echo "✗ $1"
+    FAILURES=$((FAILURES + 1))
+}
 
 echo "Testing client functionality..."
 
@@ -9,33 +20,244 @@ echo "Testing client functionality..."
 echo "Testing invalid URL format..."
 ./client invalid_url 2>/dev/null
 if [ $? -eq 1 ]; then
-    echo "✓ Invalid URL properly rejected"
+    pass "Invalid URL properly rejected"
 else
-    echo "✗ Invalid URL not properly rejected"
+    fail "Invalid URL not properly rejected"
 fi
 
 # Test with invalid protocol
 echo "Testing invalid protocol..."
 ./client xyz://example.com:5000/text 2>/dev/null
 if [ $? -eq 1 ]; then
-    echo "✓ Invalid protocol properly rejected"
+    pass "Invalid protocol properly rejected"
 else
-    echo "✗ Invalid protocol not properly rejected"
+    fail "Invalid protocol not properly rejected"
 fi
 
 # Test with invalid API
 echo "Testing invalid API..."
 ./client tcp://example.com:5000/invalidapi 2>/dev/null
 if [ $? -eq 1 ]; then
-    echo "✓ Invalid API properly rejected"
+    pass "Invalid API properly rejected"
+else
+    fail "Invalid API not properly rejected"
+fi
+
+# Test with a port out of range
+echo "Testing invalid port..."
+./client tcp://example.com:65536/text 2>/dev/null
+if [ $? -eq 1 ]; then
+    pass "Invalid port properly rejected"
 else
-    echo "✗ Invalid API not properly rejected"
+    fail "Invalid port not properly rejected"
 fi
 
 echo ""
 echo "Basic parsing tests completed."
 echo ""
-echo "To test network functionality, run:"
+
+# Network tests against the local reference server
+PORT=${TEST_PORT:-5999}
+if [ -x ./server ]; then
+    ./server -t 2 $PORT >/dev/null &
+    SERVER_PID=$!
+    trap 'kill $SERVER_PID 2>/dev/null' EXIT
+    sleep 0.5
+
+    for URL in tcp://127.0.0.1:$PORT/text tcp://127.0.0.1:$PORT/binary \
+               udp://127.0.0.1:$PORT/text udp://127.0.0.1:$PORT/binary \
+               any://localhost:$PORT/text any://localhost:$PORT/binary; do
+        echo "Testing $URL..."
+        if ./client $URL | grep -q "^OK"; then
+            pass "$URL"
+        else
+            fail "$URL"
+        fi
+    done
+    if ./client -a 0 any://127.0.0.1:$PORT/binary | grep -q "cancelled after"; then
+        pass "ANY race cancels the slower transport"
+    else
+        fail "ANY race cancels the slower transport"
+    fi
+
+    echo "Testing load generator..."
+    if ./client -n 1000 -c 50 tcp://127.0.0.1:$PORT/binary | grep -q "ERROR: 0 "; then
+        pass "1000 TCP sessions"
+    else
+        fail "1000 TCP sessions"
+    fi
+    if ./client -w 2 -n 1000 -c 50 -k tcp://127.0.0.1:$PORT/binary | grep -q "50 opened, 950 reused"; then
+        pass "1000 TCP sessions on 2 workers"
+    else
+        fail "1000 TCP sessions on 2 workers"
+    fi
+    if ./client -n 1000 -c 50 -k tcp://127.0.0.1:$PORT/text | grep -q "50 opened, 950 reused"; then
+        pass "1000 TCP sessions over 50 persistent connections"
+    else
+        fail "1000 TCP sessions over 50 persistent connections"
+    fi
+    if ./client -n 1000 -c 4 -p 16 tcp://127.0.0.1:$PORT/binary | grep -q "ERROR: 0 "; then
+        pass "1000 pipelined TCP assignments"
+    else
+        fail "1000 pipelined TCP assignments"
+    fi
+    if ./client -n 1000 -c 50 -b mmsg -m 16 udp://127.0.0.1:$PORT/binary | grep -q "ERROR: 0 "; then
+        pass "1000 UDP sessions over shared sockets"
+    else
+        fail "1000 UDP sessions over shared sockets"
+    fi
+    if ./client -n 100 -c 10 -j - tcp://127.0.0.1:$PORT/text | grep -q '"TCP/TEXT":{"resolve":{"count":100,.*"verdict":{"count":100,'; then
+        pass "Phase timings for 100 TCP sessions"
+    else
+        fail "Phase timings for 100 TCP sessions"
+    fi
+
+    echo "Testing batch mode..."
+    JOBS=$( (for i in $(seq 250); do
+                 echo "tcp://127.0.0.1:$PORT/text"; echo "udp://127.0.0.1:$PORT/binary"
+                 echo "any://localhost:$PORT/binary"; echo "tcp://127.0.0.1:$PORT/binary"
+             done) | ./client -c 50 -f - | cut -f 2,3 | sort | uniq -c | awk '{print $1, $2, $3}' | tr '\n' ' ')
+    if [ "$JOBS" = "500 TCP OK 500 UDP OK " ]; then
+        pass "1000 batch jobs from stdin"
+    else
+        fail "1000 batch jobs from stdin ($JOBS)"
+    fi
+    printf 'tcp://127.0.0.1:%s/text\n# comment\n\nnot_a_url\n' $PORT > /tmp/client_jobs.$$
+    JOBS=$(./client -f /tmp/client_jobs.$$ | cut -f 1,3 | tr '\t\n' '  ')
+    rm -f /tmp/client_jobs.$$
+    if [ "$JOBS" = "tcp://127.0.0.1:$PORT/text OK not_a_url INVALID_URL " ]; then
+        pass "Batch job file with an invalid line"
+    else
+        fail "Batch job file with an invalid line ($JOBS)"
+    fi
+
+    echo "Testing structured output..."
+    if ./client -o jsonl tcp://127.0.0.1:$PORT/binary 2>/dev/null |
+           grep -q '^{"type":"session","transport":"TCP","api":"BINARY","verdict":"OK",.*"result":-\?[0-9]*}$'; then
+        pass "JSON Lines record for one session"
+    else
+        fail "JSON Lines record for one session"
+    fi
+    RECORDS=$(./client -o jsonl -w 2 -n 1000 -c 50 udp://127.0.0.1:$PORT/text 2>/dev/null | grep -c '"verdict":"OK"')
+    if [ "$RECORDS" = "1000" ]; then
+        pass "1000 JSON Lines records from 2 workers"
+    else
+        fail "1000 JSON Lines records from 2 workers ($RECORDS)"
+    fi
+    BYTES=$(./client -o binary -n 100 -c 10 tcp://127.0.0.1:$PORT/text 2>/dev/null | wc -c)
+    if [ "$BYTES" -eq 2000 ]; then
+        pass "100 binary session records"
+    else
+        fail "100 binary session records ($BYTES bytes)"
+    fi
+
+    echo "Testing stats file..."
+    STATS=$(mktemp)
+    ./client -s $STATS -w 2 -n 500 -c 20 tcp://127.0.0.1:$PORT/binary > /dev/null
+    SNAPSHOT=$(./clientstat -1 $STATS)
+    if echo "$SNAPSHOT" | grep -q "^started: 500$" && echo "$SNAPSHOT" | grep -q "^ok: 500$" &&
+       echo "$SNAPSHOT" | grep -q "(finished)" && echo "$SNAPSHOT" | grep -q "^tcp_latency_us: count 500 "; then
+        pass "Counters of 500 sessions from 2 workers"
+    else
+        fail "Counters of 500 sessions from 2 workers"
+    fi
+    if ./clientstat -i 0.05 $STATS | grep -q "^ *[0-9.]* *500 *500 "; then
+        pass "clientstat follows a finished run"
+    else
+        fail "clientstat follows a finished run"
+    fi
+    # Same size, other version: refused instead of waited for
+    printf '\377\0\0\0' | dd of=$STATS bs=1 seek=4 conv=notrunc 2> /dev/null
+    if timeout 5 ./clientstat -1 $STATS 2>&1 | grep -q "not a stats file of this version"; then
+        pass "Stats file of another version rejected"
+    else
+        fail "Stats file of another version rejected"
+    fi
+
+    if command -v curl > /dev/null; then
+        echo "Testing metrics endpoint..."
+        METRICS_PORT=$((PORT + 1))
+        (echo tcp://127.0.0.1:$PORT/text; sleep 2) | ./client -M $METRICS_PORT -f - > /dev/null &
+        METRICS_PID=$!
+        METRICS=""
+        for i in $(seq 20); do
+            sleep 0.1
+            METRICS=$(curl -s http://127.0.0.1:$METRICS_PORT/metrics)
+            if echo "$METRICS" | grep -q '^calc_client_sessions_total{result="ok"} 1$'; then
+                break
+            fi
+        done
+        if echo "$METRICS" | grep -q '^calc_client_sessions_total{result="ok"} 1$' &&
+           echo "$METRICS" | grep -q '^calc_client_session_latency_seconds_count{transport="tcp"} 1$'; then
+            pass "Prometheus metrics served while the client runs"
+        else
+            fail "Prometheus metrics served while the client runs"
+        fi
+        wait $METRICS_PID
+    fi
+
+    if [ -x ./coclient ]; then
+        echo "Testing coroutine client..."
+        for URL in tcp://127.0.0.1:$PORT/text udp://127.0.0.1:$PORT/binary any://localhost:$PORT/text; do
+            if ./coclient $URL | grep -q "^OK"; then
+                pass "coclient $URL"
+            else
+                fail "coclient $URL"
+            fi
+        done
+        if ./coclient -n 1000 -c 100 tcp://127.0.0.1:$PORT/binary | grep -q "ERROR: 0 "; then
+            pass "1000 coroutine TCP sessions"
+        else
+            fail "1000 coroutine TCP sessions"
+        fi
+        if ./coclient -n 1000 -c 100 udp://127.0.0.1:$PORT/text | grep -q "ERROR: 0 "; then
+            pass "1000 coroutine UDP sessions"
+        else
+            fail "1000 coroutine UDP sessions"
+        fi
+    fi
+
+    # Without retransmission about a third of these sessions would fail
+    LOSSY_PORT=$((PORT + 1))
+    ./server -l 10 $LOSSY_PORT >/dev/null &
+    LOSSY_PID=$!
+    sleep 0.5
+    ERRORS=$(./client -n 200 -c 20 udp://127.0.0.1:$LOSSY_PORT/binary | sed -n 's/^OK: [0-9]*, ERROR: \([0-9]*\).*/\1/p')
+    kill $LOSSY_PID 2>/dev/null
+    wait $LOSSY_PID 2>/dev/null
+    if [ -n "$ERRORS" ] && [ "$ERRORS" -le 5 ]; then
+        pass "200 UDP sessions with 10% loss ($ERRORS failed)"
+    else
+        fail "200 UDP sessions with 10% loss (${ERRORS:-?} failed)"
+    fi
+
+    echo "Testing unreachable server..."
+    kill $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+    if ./client tcp://127.0.0.1:$PORT/text 2>&1 | grep -q "CANT CONNECT"; then
+        pass "Refused connection reported"
+    else
+        fail "Refused connection not reported"
+    fi
+    ./client -s $STATS -n 3 tcp://127.0.0.1:$PORT/text > /dev/null
+    if ./clientstat -1 $STATS | grep -q "^connect_failed: 3$"; then
+        pass "Connect failures counted in the stats file"
+    else
+        fail "Connect failures counted in the stats file"
+    fi
+    rm -f $STATS
+else
+    echo "Reference server not built, skipping network tests (make server)"
+fi
+
+echo ""
+echo "To test against the lab servers, run:"
 echo "  ./client tcp://alice.nplab.bth.se:5000/text"
 echo "  ./client udp://bob.nplab.bth.se:5000/binary"
 echo "  ./client any://bob.nplab.bth.se:5000/text"
+
+if [ $FAILURES -ne 0 ]; then
+    echo ""
+    echo "$FAILURES test(s) failed"
+    exit 1
+fi
@@ -0,0 +1,208 @@
+#include <cstring>
+
+#include "textproto.h"
+#include "protocol.h"
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p)) {
+        p++;
+    }
+    return p;
+}
+
+bool parseInt32(const char*& p, const char* end, int32_t& value) {
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+        negative = *q == '-';
+        q++;
+    }
+
+    // Accumulate as a negative number so INT32_MIN needs no special case
+    const char* digits = q;
+    int64_t acc = 0;
+    while (q < end && *q >= '0' && *q <= '9') {
+        acc = acc * 10 - (*q - '0');
+        if (acc < INT32_MIN) {
+            return false;
+        }
+        q++;
+    }
+    if (q == digits) {
+        return false;
+    }
+    if (!negative) {
+        if (acc == INT32_MIN) {
+            return false;
+        }
+        acc = -acc;
+    }
+
+    value = (int32_t)acc;
+    p = q;
+    return true;
+}
+
+bool parseUint32(const char*& p, const char* end, uint32_t& value) {
+    const char* q = p;
+    uint64_t acc = 0;
+    while (q < end && *q >= '0' && *q <= '9') {
+        acc = acc * 10 + (uint64_t)(*q - '0');
+        if (acc > UINT32_MAX) {
+            return false;
+        }
+        q++;
+    }
+    if (q == p) {
+        return false;
+    }
+    value = (uint32_t)acc;
+    p = q;
+    return true;
+}
+
+// Parse the leading "<id> " of a pipelined line; p ends up at the next token
+static bool parseIdPrefix(const char*& p, const char* end, uint32_t& id) {
+    p = skipBlanks(p, end);
+    if (!parseUint32(p, end, id)) {
+        return false;
+    }
+    if (p == end || (*p != ' ' && *p != '\t')) {
+        return false;
+    }
+    p = skipBlanks(p, end);
+    return true;
+}
+
+// The four operation names packed little-endian into a uint32_t, lower case
+#define OP_TOKEN(a, b, c) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16))
+
+static uint32_t parseOperation(const char* p) {
+    // ORing 0x20 lowercases letters; non-letters can not produce a match
+    uint32_t token = OP_TOKEN(p[0] | 0x20, p[1] | 0x20, p[2] | 0x20);
+    switch (token) {
+        case OP_TOKEN('a', 'd', 'd'): return ARITH_ADD;
+        case OP_TOKEN('s', 'u', 'b'): return ARITH_SUB;
+        case OP_TOKEN('m', 'u', 'l'): return ARITH_MUL;
+        case OP_TOKEN('d', 'i', 'v'): return ARITH_DIV;
+        default:                      return 0;
+    }
+}
+
+bool parseTextAssignment(const char* begin, const char* end, uint32_t& op, int32_t& value1, int32_t& value2) {
+    const char* p = skipBlanks(begin, end);
+
+    if (end - p < 4 || (p[3] != ' ' && p[3] != '\t')) {
+        return false;
+    }
+    op = parseOperation(p);
+    if (op == 0) {
+        return false;
+    }
+
+    p = skipBlanks(p + 3, end);
+    if (!parseInt32(p, end, value1)) {
+        return false;
+    }
+    if (p == end || (*p != ' ' && *p != '\t')) {
+        return false;
+    }
+
+    p = skipBlanks(p, end);
+    if (!parseInt32(p, end, value2)) {
+        return false;
+    }
+    return skipBlanks(p, end) == end;
+}
+
+bool parseTextIdAssignment(const char* begin, const char* end, uint32_t& id, uint32_t& op,
+                           int32_t& value1, int32_t& value2) {
+    const char* p = begin;
+    return parseIdPrefix(p, end, id) && parseTextAssignment(p, end, op, value1, value2);
+}
+
+bool parseTextIdResult(const char* begin, const char* end, uint32_t& id, int32_t& value) {
+    const char* p = begin;
+    return parseIdPrefix(p, end, id) && parseTextInt32(p, end, value);
+}
+
+bool parseTextIdVerdict(const char* begin, const char* end, uint32_t& id, bool& ok) {
+    const char* p = begin;
+    if (!parseIdPrefix(p, end, id)) {
+        return false;
+    }
+    const char* word = p;
+    while (p < end && !isBlank(*p)) {
+        p++;
+    }
+    size_t len = (size_t)(p - word);
+    if (skipBlanks(p, end) != end) {
+        return false;
+    }
+    if (len == 2 && memcmp(word, "OK", 2) == 0) {
+        ok = true;
+        return true;
+    }
+    if (len == 5 && memcmp(word, "ERROR", 5) == 0) {
+        ok = false;
+        return true;
+    }
+    return false;
+}
+
+bool parseTextInt32(const char* begin, const char* end, int32_t& value) {
+    const char* p = skipBlanks(begin, end);
+    if (!parseInt32(p, end, value)) {
+        return false;
+    }
+    return skipBlanks(p, end) == end;
+}
+
+size_t formatUint32(uint32_t value, char* buf) {
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    size_t len = 0;
+    while (n > 0) {
+        buf[len++] = digits[--n];
+    }
+    return len;
+}
+
+size_t formatInt32(int32_t value, char* buf) {
+    // Work on the magnitude as unsigned so INT32_MIN does not overflow
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    size_t len = 0;
+    if (value < 0) {
+        buf[len++] = '-';
+    }
+    while (n > 0) {
+        buf[len++] = digits[--n];
+    }
+    return len;
+}
+
+size_t lineLength(const char* begin, const char* end) {
+    if (end > begin && end[-1] == '\n') {
+        end--;
+        if (end > begin && end[-1] == '\r') {
+            end--;
+        }
+    }
+    return (size_t)(end - begin);
+}
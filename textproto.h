@@ -0,0 +1,48 @@
+#ifndef TEXTPROTO_H
+#define TEXTPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Allocation-free parsing and formatting for the TEXT protocol. All parsers
+// work on [begin, end) ranges that need not be NUL-terminated.
+
+// Longest formatted int32_t: "-2147483648"
+#define INT32_TEXT_MAX 11
+
+// Parse an optionally signed decimal int32_t at p, advancing p past it.
+// Fails (leaving p unchanged) on no digits or overflow.
+bool parseInt32(const char*& p, const char* end, int32_t& value);
+
+// Parse a whole "<op> <value1> <value2>" assignment line. Tokens are separated
+// by spaces or tabs; surrounding whitespace and a trailing "\r\n" or "\n" are
+// ignored. op is matched case-insensitively and returned as an ARITH_* code.
+// Returns false on anything else, including unknown operations.
+bool parseTextAssignment(const char* begin, const char* end, uint32_t& op, int32_t& value1, int32_t& value2);
+
+// Parse "<id> <op> <value1> <value2>" (PIPELINE extension)
+bool parseTextIdAssignment(const char* begin, const char* end, uint32_t& id, uint32_t& op,
+                           int32_t& value1, int32_t& value2);
+
+// Parse "<id> <result>" (PIPELINE extension)
+bool parseTextIdResult(const char* begin, const char* end, uint32_t& id, int32_t& value);
+
+// Parse "<id> OK" or "<id> ERROR" (PIPELINE extension)
+bool parseTextIdVerdict(const char* begin, const char* end, uint32_t& id, bool& ok);
+
+// Parse an unsigned decimal uint32_t at p, advancing p past it
+bool parseUint32(const char*& p, const char* end, uint32_t& value);
+
+// Parse a line holding exactly one integer, e.g. a result sent by a client
+bool parseTextInt32(const char* begin, const char* end, int32_t& value);
+
+// Write value in decimal to buf (at least INT32_TEXT_MAX bytes); returns the length
+size_t formatUint32(uint32_t value, char* buf);
+
+// Write value in decimal to buf (at least INT32_TEXT_MAX bytes, not NUL-terminated); returns the length
+size_t formatInt32(int32_t value, char* buf);
+
+// Length of [begin, end) without a trailing "\n" or "\r\n"
+size_t lineLength(const char* begin, const char* end);
+
+#endif // TEXTPROTO_H
@@ -0,0 +1,136 @@
+#include <chrono>
+#include <iomanip>
+
+#include "timing.h"
+
+thread_local TimingReport* session_timings = nullptr;
+
+uint64_t monotonicMicros() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* phaseName(SessionPhase phase) {
+    switch (phase) {
+        case PHASE_RESOLVE:    return "resolve";
+        case PHASE_CONNECT:    return "connect";
+        case PHASE_NEGOTIATE:  return "negotiate";
+        case PHASE_ASSIGNMENT: return "assignment";
+        case PHASE_RESULT:     return "result";
+        case PHASE_VERDICT:    return "verdict";
+        default:               return "?";
+    }
+}
+
+static const char* combinationName(int tcp, int text) {
+    static const char* const names[2][2] = { { "UDP/BINARY", "UDP/TEXT" }, { "TCP/BINARY", "TCP/TEXT" } };
+    return names[tcp][text];
+}
+
+// ---------------------------------------------------------------------------
+// PhaseTimes
+
+PhaseTimes::PhaseTimes() : start_(0) {
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        at_[i] = 0;
+    }
+}
+
+uint64_t PhaseTimes::duration(SessionPhase phase) const {
+    uint64_t since = start_;
+    for (int i = phase - 1; i >= 0; i--) {
+        if (at_[i] != 0) {
+            since = at_[i];
+            break;
+        }
+    }
+    return at_[phase] > since ? at_[phase] - since : 0;
+}
+
+// ---------------------------------------------------------------------------
+// TimingReport
+
+void TimingReport::record(const Session& session, const PhaseTimes& times) {
+    LatencyHistogram* histograms = histograms_[session.isDatagram() ? 0 : 1][session.isText() ? 1 : 0];
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (times.reached((SessionPhase)i)) {
+            histograms[i].record(times.duration((SessionPhase)i));
+        }
+    }
+}
+
+void TimingReport::merge(const TimingReport& other) {
+    for (int tcp = 0; tcp < 2; tcp++) {
+        for (int text = 0; text < 2; text++) {
+            for (int i = 0; i < PHASE_COUNT; i++) {
+                histograms_[tcp][text][i].merge(other.histograms_[tcp][text][i]);
+            }
+        }
+    }
+}
+
+void TimingReport::print(std::ostream& out) const {
+    out << "Phase latency (microseconds):" << std::endl;
+    out << std::left << std::setw(14) << "" << std::right << std::setw(10) << "count"
+        << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+        << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::endl;
+
+    for (int tcp = 1; tcp >= 0; tcp--) {
+        for (int text = 1; text >= 0; text--) {
+            const LatencyHistogram* histograms = histograms_[tcp][text];
+            bool header = false;
+            for (int i = 0; i < PHASE_COUNT; i++) {
+                const LatencyHistogram& h = histograms[i];
+                if (h.count() == 0) {
+                    continue;
+                }
+                if (!header) {
+                    out << combinationName(tcp, text) << std::endl;
+                    header = true;
+                }
+                out << "  " << std::left << std::setw(12) << phaseName((SessionPhase)i) << std::right
+                    << std::setw(10) << h.count() << std::setw(10) << h.percentile(50.0)
+                    << std::setw(10) << h.percentile(90.0) << std::setw(10) << h.percentile(99.0)
+                    << std::setw(10) << h.percentile(99.9) << std::setw(10) << h.max() << std::endl;
+            }
+        }
+    }
+}
+
+// {"unit":"us","TCP/TEXT":{"connect":{"count":1,"min":..,"mean":..,"p50":..,...},...},...}
+void TimingReport::printJson(std::ostream& out) const {
+    out << "{\"unit\":\"us\"";
+    for (int tcp = 1; tcp >= 0; tcp--) {
+        for (int text = 1; text >= 0; text--) {
+            const LatencyHistogram* histograms = histograms_[tcp][text];
+            bool first = true;
+            for (int i = 0; i < PHASE_COUNT; i++) {
+                const LatencyHistogram& h = histograms[i];
+                if (h.count() == 0) {
+                    continue;
+                }
+                if (first) {
+                    out << ",\"" << combinationName(tcp, text) << "\":{";
+                    first = false;
+                } else {
+                    out << ",";
+                }
+                out << "\"" << phaseName((SessionPhase)i) << "\":{\"count\":" << h.count()
+                    << ",\"min\":" << h.min() << ",\"mean\":" << std::fixed << std::setprecision(1) << h.mean()
+                    << ",\"p50\":" << h.percentile(50.0) << ",\"p90\":" << h.percentile(90.0)
+                    << ",\"p99\":" << h.percentile(99.0) << ",\"p999\":" << h.percentile(99.9)
+                    << ",\"max\":" << h.max() << "}";
+            }
+            if (!first) {
+                out << "}";
+            }
+        }
+    }
+    out << "}" << std::endl;
+}
+
+void recordTimings(const Session& session, const PhaseTimes& times) {
+    if (session_timings != nullptr) {
+        session_timings->record(session, times);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <ostream>
+#include <stdint.h>
+
+#include "session.h"
+#include "histogram.h"
+
+// Monotonic clock in microseconds
+uint64_t monotonicMicros();
+
+// When one session reached each SessionPhase. Drivers call begin() when they
+// start the session, mark() for the transport phases and track() whenever the
+// session may have moved on.
+class PhaseTimes {
+public:
+    PhaseTimes();
+
+    void begin() { start_ = monotonicMicros(); }
+
+    // Only the first mark of a phase counts (UDP retransmissions repeat steps)
+    void mark(SessionPhase phase) {
+        if (at_[phase] == 0) {
+            at_[phase] = monotonicMicros();
+        }
+    }
+
+    // Mark the phase the session reports, and PHASE_RESULT once its solved
+    // assignment has been sent
+    void track(const Session& session) {
+        if (session.phase() != PHASE_NONE) {
+            mark(session.phase());
+        }
+        if (at_[PHASE_ASSIGNMENT] != 0 && !session.hasOutput()) {
+            mark(PHASE_RESULT);
+        }
+    }
+
+    bool reached(SessionPhase phase) const { return at_[phase] != 0; }
+
+    // Time from the previous phase reached (or begin()) to phase
+    uint64_t duration(SessionPhase phase) const;
+
+    // Time since begin()
+    uint64_t elapsed() const { return monotonicMicros() - start_; }
+
+private:
+    uint64_t start_;
+    uint64_t at_[PHASE_COUNT];
+};
+
+// Latency histograms in microseconds, per protocol/API combination and phase
+class TimingReport {
+public:
+    void record(const Session& session, const PhaseTimes& times);
+    void merge(const TimingReport& other);
+
+    // p50/p90/p99/p99.9 per combination and phase, as a table or as JSON
+    void print(std::ostream& out) const;
+    void printJson(std::ostream& out) const;
+
+private:
+    // [tcp][text][phase]
+    LatencyHistogram histograms_[2][2][PHASE_COUNT];
+};
+
+// Where drivers on this thread record finished sessions; nullptr (the
+// default) disables timing. Load generator workers each have their own.
+extern thread_local TimingReport* session_timings;
+
+// Record session's phase times in session_timings, if set
+void recordTimings(const Session& session, const PhaseTimes& times);
+
+const char* phaseName(SessionPhase phase);
+
+#endif // TIMING_H
@@ -0,0 +1,397 @@
+#include <cstring>
+
+#include "udpmux.h"
+#include "textproto.h"
+#include "binproto.h"
+#include "output.h"
+#include "stats.h"
+
+// Datagrams moved per sendmmsg()/recvmmsg() call
+#define MMSG_BATCH 64
+
+// Largest datagram accepted from the server
+#define MMSG_BUFFER_SIZE 512
+
+#define NO_SOCKET ((size_t)-1)
+
+// ---------------------------------------------------------------------------
+// MuxSession
+
+MuxSession::MuxSession(UdpMux& mux, Session* session, SessionObserver* observer, size_t socket)
+    : mux_(mux), session_(session), observer_(observer), socket_(socket), id_(0),
+      has_id_(false), finished_(false), last_progress_(0), timer_(this) {
+}
+
+MuxSession::~MuxSession() {
+    mux_.loop_.cancelTimer(&timer_);
+    delete session_;
+}
+
+void MuxSession::onTimer() {
+    if (finished_) {
+        return;
+    }
+    if (session_->retransmit()) {
+        retransmit_.onRetransmit();
+        uint64_t timeout = retransmit_.timeoutMs(session_->retransmits());
+        mux_.loop_.addTimer(&timer_, timeout);
+        mux_.update(this);
+
+        // Shared sockets tell assignments apart by id, everything else by turn
+        UdpMux::Socket& sock = *mux_.sockets_[socket_];
+        if (sock.exclusive || session_->progress() != 0) {
+            sock.quiet_until = mux_.loop_.now() + timeout;
+        }
+        return;
+    }
+    session_->onTimeout();
+    mux_.finish(this);
+}
+
+// ---------------------------------------------------------------------------
+// UdpMux
+
+UdpMux::UdpMux(EventLoop& loop, const struct sockaddr_storage& server, socklen_t server_len,
+               unsigned sessions_per_socket)
+    : loop_(loop), server_(server), server_len_(server_len),
+      per_socket_(sessions_per_socket > 0 ? sessions_per_socket : 1), filling_(NO_SOCKET),
+      rtt_(rttEstimatorFor((const struct sockaddr*)&server, server_len)),
+      rx_buffers_(MMSG_BATCH * MMSG_BUFFER_SIZE) {
+    loop_.addPrepareHandler(this);
+}
+
+UdpMux::~UdpMux() {
+    loop_.removePrepareHandler(this);
+    for (size_t i = 0; i < graveyard_.size(); i++) {
+        delete graveyard_[i];
+    }
+    for (size_t i = 0; i < sockets_.size(); i++) {
+        loop_.cancelTimer(&sockets_[i]->timer);
+        loop_.remove(sockets_[i]->fd);
+        close(sockets_[i]->fd);
+        delete sockets_[i];
+    }
+}
+
+size_t UdpMux::pickSocket(bool exclusive) {
+    if (!exclusive && filling_ != NO_SOCKET && sockets_[filling_]->sessions < per_socket_) {
+        return filling_;
+    }
+
+    // A free socket still in its quiet period could hand a stale reply to the new session
+    size_t index = NO_SOCKET;
+    for (size_t i = free_sockets_.size(); i-- > 0;) {
+        if (sockets_[free_sockets_[i]]->quiet_until <= loop_.now()) {
+            index = free_sockets_[i];
+            free_sockets_.erase(free_sockets_.begin() + i);
+            break;
+        }
+    }
+    if (index == NO_SOCKET) {
+        int fd = socket(server_.ss_family, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            return NO_SOCKET;
+        }
+
+        // Connected so the kernel drops datagrams from anyone but the server
+        if (connect(fd, (const struct sockaddr*)&server_, server_len_) < 0 || !setNonBlocking(fd)) {
+            close(fd);
+            return NO_SOCKET;
+        }
+
+        Socket* sock = new Socket();
+        sock->mux = this;
+        sock->index = sockets_.size();
+        sock->fd = fd;
+        sock->sessions = 0;
+        sock->exclusive = false;
+        sock->quiet_until = 0;
+        if (!loop_.add(fd, EV_READ, sock)) {
+            close(fd);
+            delete sock;
+            return NO_SOCKET;
+        }
+        index = sockets_.size();
+        sockets_.push_back(sock);
+    }
+
+    sockets_[index]->exclusive = exclusive;
+    if (!exclusive) {
+        filling_ = index;
+    }
+    return index;
+}
+
+MuxSession* UdpMux::start(Session* session, SessionObserver* observer) {
+    // Text servers track clients by source address, so text sessions can not share
+    size_t index = pickSocket(session->isText() || per_socket_ == 1);
+    if (index == NO_SOCKET) {
+        delete session;
+        return nullptr;
+    }
+
+    Socket& sock = *sockets_[index];
+    sock.sessions++;
+    if (sock.sessions >= per_socket_ && filling_ == index) {
+        filling_ = NO_SOCKET;
+    }
+
+    MuxSession* s = new MuxSession(*this, session, observer, index);
+    sock.want_assignment.push_back(s);
+    s->retransmit_.start(&rtt_, loop_.now());
+    s->times_.begin();
+    statsCount(STAT_STARTED);
+    session->start();
+    loop_.addTimer(&s->timer_, s->retransmit_.timeoutMs(0));
+    update(s);
+    return s;
+}
+
+void UdpMux::release(MuxSession* session) {
+    graveyard_.push_back(session);
+}
+
+void UdpMux::onPrepare() {
+    for (size_t i = 0; i < dirty_.size(); i++) {
+        flush(*sockets_[dirty_[i]]);
+    }
+    dirty_.clear();
+
+    for (size_t i = 0; i < graveyard_.size(); i++) {
+        delete graveyard_[i];
+    }
+    graveyard_.clear();
+}
+
+void UdpMux::flush(Socket& sock) {
+    size_t sent = 0;
+#ifdef __linux__
+    struct mmsghdr msgs[MMSG_BATCH];
+    struct iovec iovs[MMSG_BATCH];
+
+    while (sent < sock.tx.size()) {
+        unsigned batch = 0;
+        for (; batch < MMSG_BATCH && sent + batch < sock.tx.size(); batch++) {
+            std::string& datagram = sock.tx[sent + batch];
+            iovs[batch].iov_base = &datagram[0];
+            iovs[batch].iov_len = datagram.size();
+            memset(&msgs[batch], 0, sizeof(msgs[batch]));
+            msgs[batch].msg_hdr.msg_iov = &iovs[batch];
+            msgs[batch].msg_hdr.msg_iovlen = 1;
+        }
+
+        int n = sendmmsg(sock.fd, msgs, batch, 0);
+        if (n <= 0) {
+            // Treated like loss on the wire: the affected sessions time out
+            break;
+        }
+        sent += (size_t)n;
+    }
+#else
+    for (; sent < sock.tx.size(); sent++) {
+        if (send(sock.fd, sock.tx[sent].data(), sock.tx[sent].size(), 0) < 0) {
+            break;
+        }
+    }
+#endif
+    sock.tx.clear();
+}
+
+void UdpMux::onReadable(Socket& sock, uint32_t events) {
+    if (!(events & EV_READ)) {
+        return;
+    }
+
+#ifdef __linux__
+    struct mmsghdr msgs[MMSG_BATCH];
+    struct iovec iovs[MMSG_BATCH];
+
+    for (;;) {
+        for (unsigned i = 0; i < MMSG_BATCH; i++) {
+            iovs[i].iov_base = &rx_buffers_[i * MMSG_BUFFER_SIZE];
+            iovs[i].iov_len = MMSG_BUFFER_SIZE;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int n = recvmmsg(sock.fd, msgs, MMSG_BATCH, MSG_DONTWAIT, nullptr);
+        if (n <= 0) {
+            // EAGAIN, or an ICMP error for an earlier datagram: sessions rely on their timeouts
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            route(sock, (const char*)iovs[i].iov_base, msgs[i].msg_len);
+        }
+        if (n < MMSG_BATCH) {
+            return;
+        }
+    }
+#else
+    for (;;) {
+        ssize_t n = recv(sock.fd, &rx_buffers_[0], MMSG_BUFFER_SIZE, 0);
+        if (n < 0) {
+            return;
+        }
+        route(sock, &rx_buffers_[0], (size_t)n);
+    }
+#endif
+}
+
+// "OK" (TEXT) or a calcMessage with message 1 (BINARY)
+static bool isOkVerdict(const char* data, size_t len) {
+    if (len == sizeof(calcMessage)) {
+        calcMessage msg = decodeCalcMessage(data);
+        return msg.type == MSG_TYPE_CALC_MESSAGE && msg.message == 1;
+    }
+    return lineLength(data, data + len) == 2 && data[0] == 'O' && data[1] == 'K';
+}
+
+void UdpMux::route(Socket& sock, const char* data, size_t len) {
+    MuxSession* target = nullptr;
+
+    if (!sock.exclusive && len == sizeof(calcProtocol)) {
+        uint32_t id = calcProtocolId(data);
+
+        // A retransmitted assignment for a session that already has one
+        if (by_id_.count(id) != 0) {
+            return;
+        }
+        if (sock.want_assignment.empty()) {
+            return;
+        }
+        target = sock.want_assignment.front();
+        sock.want_assignment.pop_front();
+        target->id_ = id;
+        target->has_id_ = true;
+        by_id_[id] = target;
+    } else if (!sock.want_verdict.empty()) {
+        target = sock.want_verdict.front();
+        sock.want_verdict.pop_front();
+    } else if (isOkVerdict(data, len) || (!sock.exclusive && sock.quiet_until > loop_.now())) {
+        // Duplicate verdict for a retransmitted result of a finished session
+        return;
+    } else if (!sock.want_assignment.empty()) {
+        target = sock.want_assignment.front();
+        sock.want_assignment.pop_front();
+    } else {
+        return;
+    }
+
+    deliver(target, data, len);
+}
+
+void UdpMux::deliver(MuxSession* s, const char* data, size_t len) {
+    unsigned progress = s->session_->progress();
+    s->session_->onReceive(data, len);
+    if (s->session_->progress() != progress || s->session_->done()) {
+        s->retransmit_.onReply(loop_.now());
+    }
+    Socket& sock = *sockets_[s->socket_];
+    if (!sock.exclusive && progress == 0 && s->session_->progress() != 0 && !s->session_->done()) {
+        // Got its assignment: the result waits for the socket's verdict slot
+        loop_.cancelTimer(&s->timer_);
+        s->times_.track(*s->session_);
+        sock.held.push_back(s);
+        nextTurn(sock);
+        return;
+    }
+
+    update(s);
+    if (s->finished_) {
+        return;
+    }
+
+    // Requeue according to what the session is waiting for now
+    if (s->session_->progress() == 0) {
+        sock.want_assignment.push_back(s);
+    } else {
+        sock.want_verdict.push_back(s);
+    }
+}
+
+// Send the next held result once the socket has no verdict outstanding
+void UdpMux::nextTurn(Socket& sock) {
+    if (!sock.want_verdict.empty() || sock.held.empty()) {
+        return;
+    }
+    uint64_t now = loop_.now();
+    if (sock.quiet_until > now) {
+        if (!sock.timer.armed()) {
+            loop_.addTimer(&sock.timer, sock.quiet_until - now);
+        }
+        return;
+    }
+
+    MuxSession* s = sock.held.front();
+    sock.held.pop_front();
+    sock.want_verdict.push_back(s);
+    s->retransmit_.start(&rtt_, now);
+    update(s);
+}
+
+void UdpMux::update(MuxSession* s) {
+    Session* session = s->session_;
+    if (session->hasOutput()) {
+        Socket& sock = *sockets_[s->socket_];
+        if (sock.tx.empty()) {
+            dirty_.push_back(s->socket_);
+        }
+        sock.tx.push_back(session->output());
+        session->consumeOutput(session->output().size());
+    }
+    s->times_.track(*session);
+
+    if (session->done()) {
+        finish(s);
+        return;
+    }
+
+    // Every protocol step gets a fresh timeout
+    if (session->progress() != s->last_progress_) {
+        s->last_progress_ = session->progress();
+        loop_.addTimer(&s->timer_, s->retransmit_.timeoutMs(session->retransmits()));
+    }
+}
+
+void UdpMux::unqueue(MuxSession* s) {
+    Socket& sock = *sockets_[s->socket_];
+    std::deque<MuxSession*>* queues[3] = { &sock.want_assignment, &sock.want_verdict, &sock.held };
+    for (int q = 0; q < 3; q++) {
+        for (std::deque<MuxSession*>::iterator it = queues[q]->begin(); it != queues[q]->end(); ++it) {
+            if (*it == s) {
+                queues[q]->erase(it);
+                return;
+            }
+        }
+    }
+}
+
+void UdpMux::finish(MuxSession* s) {
+    if (s->finished_) {
+        return;
+    }
+    s->finished_ = true;
+    loop_.cancelTimer(&s->timer_);
+    unqueue(s);
+    if (s->has_id_) {
+        by_id_.erase(s->id_);
+    }
+
+    Socket& sock = *sockets_[s->socket_];
+    sock.sessions--;
+    if (sock.sessions == 0) {
+        if (filling_ == s->socket_) {
+            filling_ = NO_SOCKET;
+        }
+        free_sockets_.push_back(s->socket_);
+    }
+    nextTurn(sock);
+
+    recordTimings(*s->session_, s->times_);
+    recordStats(*s->session_, s->times_, false);
+    writeSessionRecord(*s->session_, s->times_, false);
+    if (s->observer_) {
+        s->observer_->onSessionDone(s);
+    }
+}
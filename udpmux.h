@@ -0,0 +1,132 @@
+#ifndef UDPMUX_H
+#define UDPMUX_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "client.h"
+#include "eventloop.h"
+#include "session.h"
+#include "rtt.h"
+#include "timing.h"
+
+class UdpMux;
+
+// One UDP session carried over a socket shared with other sessions
+class MuxSession : public SessionDriver, public TimerHandler {
+public:
+    bool done() const override { return finished_; }
+    bool ok() const override { return finished_ && session_->status() == SESSION_OK; }
+    bool connectFailed() const override { return false; }
+    bool isTCP() const override { return false; }
+
+    void onTimer() override;
+
+private:
+    friend class UdpMux;
+
+    MuxSession(UdpMux& mux, Session* session, SessionObserver* observer, size_t socket);
+    ~MuxSession();
+    MuxSession(const MuxSession&);
+    MuxSession& operator=(const MuxSession&);
+
+    UdpMux& mux_;
+    Session* session_;
+    SessionObserver* observer_;
+    size_t socket_;         // Index of the shared socket this session uses
+    uint32_t id_;           // calcProtocol.id of the assignment, once received
+    bool has_id_;
+    bool finished_;
+    unsigned last_progress_;
+    RetransmitTracker retransmit_;
+    PhaseTimes times_;      // Starts at the first datagram; the mux resolved the server once
+    Timer timer_;
+};
+
+// Shares a few UDP sockets between many sessions to one server. Outgoing
+// datagrams are queued and flushed with one sendmmsg() per socket and loop
+// iteration; replies are drained with recvmmsg().
+//
+// Replies carry no session identifier except calcProtocol.id, so they are
+// routed as follows:
+//   - a calcProtocol whose id already belongs to a session is a duplicate and dropped
+//   - any other calcProtocol goes to the oldest session on that socket waiting
+//     for an assignment, which then owns the id
+//   - verdicts carry no id at all, so only one session per socket may have
+//     its result outstanding, and calcMessage and text replies go to that one.
+//     The results of the other sessions are held until its verdict arrives or
+//     it times out.
+// After a retransmitted result, replies to the copies may still be on their
+// way, so the socket gives no other session a turn (and is not handed to a
+// new session) until the last copy would have timed out. Replies that arrive
+// with no verdict outstanding are dropped then, and otherwise go to the
+// oldest session waiting for an assignment (a server rejecting the request).
+// Text servers keep their state per source address, so text sessions always
+// get a socket (source port) of their own.
+class UdpMux : public PrepareHandler {
+public:
+    // sessions_per_socket applies to binary sessions; text sessions use one each
+    UdpMux(EventLoop& loop, const struct sockaddr_storage& server, socklen_t server_len,
+           unsigned sessions_per_socket);
+    ~UdpMux();
+
+    // Start a UDP session; returns nullptr (after deleting session) if no socket could be set up
+    MuxSession* start(Session* session, SessionObserver* observer);
+
+    // Free a finished session
+    void release(MuxSession* session);
+
+    void onPrepare() override;
+
+private:
+    friend class MuxSession;
+
+    struct Socket : public EventHandler, public TimerHandler {
+        Socket() : timer(this) {}
+
+        UdpMux* mux;
+        size_t index;
+        int fd;
+        unsigned sessions;                      // Sessions currently bound to this socket
+        bool exclusive;                         // Holds a text session
+        std::vector<std::string> tx;            // Datagrams waiting for sendmmsg()
+        std::deque<MuxSession*> want_assignment;
+        std::deque<MuxSession*> want_verdict;   // At most one on a shared socket
+        std::deque<MuxSession*> held;           // Results waiting for their turn
+        uint64_t quiet_until;                   // Replies to retransmitted copies may arrive until then
+        Timer timer;                            // Ends the quiet period
+
+        void onEvent(uint32_t events) override { mux->onReadable(*this, events); }
+        void onTimer() override { mux->nextTurn(*this); }
+    };
+
+    UdpMux(const UdpMux&);
+    UdpMux& operator=(const UdpMux&);
+
+    size_t pickSocket(bool exclusive);
+    void onReadable(Socket& sock, uint32_t events);
+    void route(Socket& sock, const char* data, size_t len);
+    void deliver(MuxSession* s, const char* data, size_t len);
+    void nextTurn(Socket& sock);
+    void update(MuxSession* s);
+    void finish(MuxSession* s);
+    void unqueue(MuxSession* s);
+    void flush(Socket& sock);
+
+    EventLoop& loop_;
+    struct sockaddr_storage server_;
+    socklen_t server_len_;
+    unsigned per_socket_;
+    std::vector<Socket*> sockets_;
+    std::vector<size_t> free_sockets_;          // Sockets with no session bound
+    size_t filling_;                            // Shared socket taking new binary sessions
+    std::vector<size_t> dirty_;                 // Sockets with queued datagrams
+    std::map<uint32_t, MuxSession*> by_id_;
+    RttEstimator& rtt_;
+    std::vector<MuxSession*> graveyard_;
+    std::vector<char> rx_buffers_;
+};
+
+#endif // UDPMUX_H
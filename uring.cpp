@@ -0,0 +1,639 @@
+#include <chrono>
+#include <cstring>
+
+#include "uring.h"
+#include "output.h"
+#include "stats.h"
+
+#ifndef HAVE_IO_URING
+
+bool uringCompiledIn() {
+    return false;
+}
+
+#else
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_LIBURING
+    #include <liburing.h>
+#else
+    #include <linux/io_uring.h>
+#endif
+
+bool uringCompiledIn() {
+    return true;
+}
+
+// Operation tags stored in the low bits of the SQE user_data (sessions are 8-byte aligned)
+#define OP_CONNECT 1
+#define OP_SEND    2
+#define OP_RECV    3
+#define OP_CANCEL  4
+#define OP_MASK    7
+
+// Timeout for establishing a TCP connection
+#define CONNECT_TIMEOUT_MS 5000
+
+// ---------------------------------------------------------------------------
+// IoRing: the few ring operations the loop needs, over liburing or raw syscalls
+
+#ifdef HAVE_LIBURING
+
+class IoRing {
+public:
+    IoRing() : ok_(false) {}
+    ~IoRing() {
+        if (ok_) {
+            io_uring_queue_exit(&ring_);
+        }
+    }
+
+    bool init(unsigned entries) {
+        ok_ = io_uring_queue_init(entries, &ring_, 0) == 0;
+        return ok_;
+    }
+
+    bool registerBuffers(const struct iovec* iov, unsigned count) {
+        return io_uring_register_buffers(&ring_, iov, count) == 0;
+    }
+
+    struct io_uring_sqe* getSqe() { return io_uring_get_sqe(&ring_); }
+
+    void submit() { io_uring_submit(&ring_); }
+
+    void submitAndWait(int timeout_ms) {
+        struct io_uring_cqe* cqe;
+        if (timeout_ms < 0) {
+            io_uring_submit_and_wait(&ring_, 1);
+            return;
+        }
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        io_uring_submit_and_wait_timeout(&ring_, &cqe, 1, &ts, nullptr);
+    }
+
+    bool nextCompletion(uint64_t& user_data, int& res) {
+        struct io_uring_cqe* cqe;
+        if (io_uring_peek_cqe(&ring_, &cqe) != 0) {
+            return false;
+        }
+        user_data = cqe->user_data;
+        res = cqe->res;
+        io_uring_cqe_seen(&ring_, cqe);
+        return true;
+    }
+
+private:
+    struct io_uring ring_;
+    bool ok_;
+};
+
+#else // raw syscalls
+
+class IoRing {
+public:
+    IoRing() : fd_(-1), sq_ptr_(MAP_FAILED), cq_ptr_(MAP_FAILED), sqes_(nullptr),
+               sq_size_(0), cq_size_(0), sqes_size_(0), sq_local_tail_(0), sq_submitted_(0) {}
+
+    ~IoRing() {
+        if (sqes_ != nullptr) munmap(sqes_, sqes_size_);
+        if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_size_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool init(unsigned entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd_ = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd_ < 0) {
+            return false;
+        }
+
+        // Waiting with a timeout relies on IORING_ENTER_EXT_ARG (Linux 5.11+)
+        if (!(params.features & IORING_FEAT_EXT_ARG)) {
+            return false;
+        }
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            if (cq_size_ > sq_size_) sq_size_ = cq_size_;
+            cq_size_ = sq_size_;
+        }
+
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) {
+            return false;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ptr_ = sq_ptr_;
+        } else {
+            cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           fd_, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED) {
+                return false;
+            }
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        sqes_ = (struct io_uring_sqe*)sqes;
+
+        char* sq = (char*)sq_ptr_;
+        sq_head_ = (unsigned*)(sq + params.sq_off.head);
+        sq_tail_ = (unsigned*)(sq + params.sq_off.tail);
+        sq_mask_ = *(unsigned*)(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = (unsigned*)(sq + params.sq_off.array);
+        sq_local_tail_ = *sq_tail_;
+        sq_submitted_ = sq_local_tail_;
+
+        char* cq = (char*)cq_ptr_;
+        cq_head_ = (unsigned*)(cq + params.cq_off.head);
+        cq_tail_ = (unsigned*)(cq + params.cq_off.tail);
+        cq_mask_ = *(unsigned*)(cq + params.cq_off.ring_mask);
+        cqes_ = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    bool registerBuffers(const struct iovec* iov, unsigned count) {
+        return syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iov, count) == 0;
+    }
+
+    struct io_uring_sqe* getSqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sq_local_tail_ - head >= sq_entries_) {
+            return nullptr;
+        }
+        unsigned index = sq_local_tail_ & sq_mask_;
+        sq_array_[index] = index;
+        sq_local_tail_++;
+        return &sqes_[index];
+    }
+
+    void submit() {
+        enter(0, -1);
+    }
+
+    void submitAndWait(int timeout_ms) {
+        enter(1, timeout_ms);
+    }
+
+    bool nextCompletion(uint64_t& user_data, int& res) {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        const struct io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+        user_data = cqe->user_data;
+        res = cqe->res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    void enter(unsigned wait_nr, int timeout_ms) {
+        unsigned to_submit = sq_local_tail_ - sq_submitted_;
+        __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+        sq_submitted_ = sq_local_tail_;
+
+        unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (wait_nr > 0 && timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+        if (to_submit == 0 && wait_nr == 0) {
+            return;
+        }
+        syscall(__NR_io_uring_enter, fd_, to_submit, wait_nr, flags,
+                (flags & IORING_ENTER_EXT_ARG) ? (void*)&arg : nullptr,
+                (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+    }
+
+    int fd_;
+    void* sq_ptr_;
+    void* cq_ptr_;
+    struct io_uring_sqe* sqes_;
+    size_t sq_size_;
+    size_t cq_size_;
+    size_t sqes_size_;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_array_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned sq_local_tail_;
+    unsigned sq_submitted_;
+
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    struct io_uring_cqe* cqes_;
+};
+
+#endif // HAVE_LIBURING
+
+// ---------------------------------------------------------------------------
+// UringSession
+
+UringSession::UringSession(UringLoop& loop, Session* session, SessionObserver* observer)
+    : loop_(loop), session_(session), observer_(observer), fd_(-1), addr_len_(0),
+      slot_(-1), rx_buf_(nullptr), tx_buf_(nullptr), tx_len_(0), inflight_(0),
+      recv_pending_(false), send_pending_(false), connecting_(false),
+      connect_failed_(false), finished_(false), last_progress_(0), timer_(this) {
+    memset(&addr_, 0, sizeof(addr_));
+
+    slot_ = loop_.acquireSlot();
+    if (slot_ >= 0) {
+        rx_buf_ = loop_.slotBuffer(slot_);
+    } else {
+        rx_buf_ = new char[2 * UringLoop::SLOT_SIZE];
+    }
+    tx_buf_ = rx_buf_ + UringLoop::SLOT_SIZE;
+}
+
+UringSession::~UringSession() {
+    loop_.cancelTimer(&timer_);
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    if (slot_ >= 0) {
+        loop_.releaseSlot(slot_);
+    } else {
+        delete[] rx_buf_;
+    }
+    delete session_;
+}
+
+bool UringSession::start(const std::string& host, int port) {
+    bool tcp = !session_->isDatagram();
+    times_.begin();
+    statsCount(STAT_STARTED);
+    if (!resolveHost(host, port, addr_, addr_len_)) {
+        connect_failed_ = true;
+        return false;
+    }
+    times_.mark(PHASE_RESOLVE);
+
+    fd_ = socket(addr_.ss_family, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (fd_ < 0) {
+        connect_failed_ = true;
+        return false;
+    }
+
+    if (tcp) {
+        if (!loop_.queueConnect(this)) {
+            connect_failed_ = true;
+            return false;
+        }
+        connecting_ = true;
+        loop_.addTimer(&timer_, CONNECT_TIMEOUT_MS);
+        return true;
+    }
+
+    // A connected UDP socket lets datagrams use plain send/recv (and fixed buffers)
+    if (connect(fd_, (struct sockaddr*)&addr_, addr_len_) < 0) {
+        connect_failed_ = true;
+        return false;
+    }
+    retransmit_.start(&rttEstimatorFor((struct sockaddr*)&addr_, addr_len_), loop_.now());
+    session_->start();
+    loop_.addTimer(&timer_, stepTimeoutMs());
+    pump();
+    return true;
+}
+
+void UringSession::onCompletion(unsigned op, int res) {
+    inflight_--;
+    if (op == OP_CANCEL || finished_) {
+        return;
+    }
+
+    switch (op) {
+        case OP_CONNECT:
+            connecting_ = false;
+            if (res < 0) {
+                connect_failed_ = true;
+                finish();
+                return;
+            }
+            times_.mark(PHASE_CONNECT);
+            session_->start();
+            loop_.addTimer(&timer_, session_->timeoutMs());
+            break;
+
+        case OP_SEND:
+            send_pending_ = false;
+            if (res < 0) {
+                session_->abort("Failed to send message to server");
+                break;
+            }
+            session_->consumeOutput(session_->isDatagram() ? tx_len_ : (size_t)res);
+            break;
+
+        case OP_RECV:
+            recv_pending_ = false;
+            if (res > 0) {
+                unsigned progress = session_->progress();
+                session_->onReceive(rx_buf_, (size_t)res);
+                if (retransmit_.active() && (session_->progress() != progress || session_->done())) {
+                    retransmit_.onReply(loop_.now());
+                }
+            } else if (!session_->isDatagram()) {
+                session_->onClosed();
+            }
+            // UDP: ICMP errors and empty datagrams are ignored, the timeout decides
+            break;
+    }
+
+    pump();
+}
+
+void UringSession::pump() {
+    times_.track(*session_);
+    if (session_->done()) {
+        finish();
+        return;
+    }
+
+    // Every protocol step gets a fresh timeout, like a per-recv SO_RCVTIMEO
+    if (session_->progress() != last_progress_) {
+        last_progress_ = session_->progress();
+        loop_.addTimer(&timer_, stepTimeoutMs());
+    }
+
+    if (session_->hasOutput() && !send_pending_) {
+        const std::string& out = session_->output();
+        tx_len_ = out.size() < (size_t)UringLoop::SLOT_SIZE ? out.size() : (size_t)UringLoop::SLOT_SIZE;
+        memcpy(tx_buf_, out.data(), tx_len_);
+        if (!loop_.queueSend(this, tx_len_)) {
+            session_->abort("Failed to send message to server");
+            finish();
+            return;
+        }
+    }
+    if (!recv_pending_ && !loop_.queueRecv(this)) {
+        session_->abort("Failed to receive message from server");
+        finish();
+    }
+}
+
+void UringSession::onTimer() {
+    if (finished_) {
+        return;
+    }
+    if (connecting_) {
+        connect_failed_ = true;
+    } else if (retransmit_.active() && session_->retransmit()) {
+        retransmit_.onRetransmit();
+        loop_.addTimer(&timer_, stepTimeoutMs());
+        pump();
+        return;
+    } else {
+        session_->onTimeout();
+    }
+    finish();
+}
+
+uint64_t UringSession::stepTimeoutMs() const {
+    if (retransmit_.active()) {
+        return retransmit_.timeoutMs(session_->retransmits());
+    }
+    return (uint64_t)session_->timeoutMs();
+}
+
+void UringSession::finish() {
+    finished_ = true;
+    loop_.cancelTimer(&timer_);
+
+    // Operations still in flight must complete before the buffers can be reused
+    if (connecting_) loop_.queueCancel(this, OP_CONNECT);
+    if (send_pending_) loop_.queueCancel(this, OP_SEND);
+    if (recv_pending_) loop_.queueCancel(this, OP_RECV);
+
+    recordTimings(*session_, times_);
+    recordStats(*session_, times_, connect_failed_);
+    writeSessionRecord(*session_, times_, connect_failed_);
+    if (observer_) {
+        observer_->onSessionDone(this);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// UringLoop
+
+UringLoop::UringLoop(unsigned slots) : ring_(new IoRing()), fixed_buffers_(false), now_(0) {
+    // Each session has at most a connect/send/recv plus their cancellations outstanding
+    unsigned entries = 64;
+    while (entries < slots * 4 && entries < 4096) {
+        entries *= 2;
+    }
+    if (!ring_->init(entries)) {
+        delete ring_;
+        ring_ = nullptr;
+        return;
+    }
+
+    buffers_.resize((size_t)slots * 2 * SLOT_SIZE);
+    for (unsigned i = slots; i > 0; i--) {
+        free_slots_.push_back((int)i - 1);
+    }
+
+    // Registered buffers save the kernel from pinning pages on every operation.
+    // Fall back to plain send/recv if the memlock limit does not allow it.
+    if (!buffers_.empty()) {
+        struct iovec iov;
+        iov.iov_base = &buffers_[0];
+        iov.iov_len = buffers_.size();
+        fixed_buffers_ = ring_->registerBuffers(&iov, 1);
+    }
+
+    updateClock();
+    timers_.advance(now_);
+}
+
+UringLoop::~UringLoop() {
+    for (size_t i = 0; i < graveyard_.size(); i++) {
+        delete graveyard_[i];
+    }
+    delete ring_;
+}
+
+bool UringLoop::valid() const {
+    return ring_ != nullptr;
+}
+
+UringSession* UringLoop::start(Session* session, const std::string& host, int port,
+                               SessionObserver* observer) {
+    UringSession* s = new UringSession(*this, session, observer);
+    if (!s->start(host, port)) {
+        statsStartFailed();
+        s->finished_ = true;
+        if (s->inflight_ == 0) {
+            delete s;
+        } else {
+            graveyard_.push_back(s);
+        }
+        return nullptr;
+    }
+    return s;
+}
+
+void UringLoop::release(UringSession* session) {
+    graveyard_.push_back(session);
+}
+
+int UringLoop::acquireSlot() {
+    if (free_slots_.empty()) {
+        return -1;
+    }
+    int slot = free_slots_.back();
+    free_slots_.pop_back();
+    return slot;
+}
+
+void UringLoop::releaseSlot(int slot) {
+    free_slots_.push_back(slot);
+}
+
+// nullptr if the queue is still full after a submit (which fails with
+// EAGAIN or EBUSY while the kernel is short of completion queue space)
+struct io_uring_sqe* UringLoop::nextSqe() {
+    struct io_uring_sqe* sqe = ring_->getSqe();
+    if (sqe == nullptr) {
+        // Submission queue full: hand what we have to the kernel and retry
+        ring_->submit();
+        sqe = ring_->getSqe();
+        if (sqe == nullptr) {
+            return nullptr;
+        }
+    }
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool UringLoop::queueConnect(UringSession* s) {
+    struct io_uring_sqe* sqe = nextSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = s->fd_;
+    sqe->addr = (uint64_t)(uintptr_t)&s->addr_;
+    sqe->off = s->addr_len_;
+    sqe->user_data = (uint64_t)(uintptr_t)s | OP_CONNECT;
+    s->inflight_++;
+    return true;
+}
+
+bool UringLoop::queueSend(UringSession* s, size_t len) {
+    struct io_uring_sqe* sqe = nextSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    if (fixed_buffers_ && s->slot_ >= 0) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->buf_index = 0;
+    } else {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->msg_flags = MSG_NOSIGNAL;
+    }
+    sqe->fd = s->fd_;
+    sqe->addr = (uint64_t)(uintptr_t)s->tx_buf_;
+    sqe->len = (uint32_t)len;
+    sqe->user_data = (uint64_t)(uintptr_t)s | OP_SEND;
+    s->send_pending_ = true;
+    s->inflight_++;
+    return true;
+}
+
+bool UringLoop::queueRecv(UringSession* s) {
+    struct io_uring_sqe* sqe = nextSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    if (fixed_buffers_ && s->slot_ >= 0) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = 0;
+    } else {
+        sqe->opcode = IORING_OP_RECV;
+    }
+    sqe->fd = s->fd_;
+    sqe->addr = (uint64_t)(uintptr_t)s->rx_buf_;
+    sqe->len = SLOT_SIZE;
+    sqe->user_data = (uint64_t)(uintptr_t)s | OP_RECV;
+    s->recv_pending_ = true;
+    s->inflight_++;
+    return true;
+}
+
+void UringLoop::queueCancel(UringSession* s, unsigned op) {
+    struct io_uring_sqe* sqe = nextSqe();
+    if (sqe == nullptr) {
+        // Shutting the socket down completes its pending operations instead
+        shutdown(s->fd_, SHUT_RDWR);
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)s | op;
+    sqe->user_data = (uint64_t)(uintptr_t)s | OP_CANCEL;
+    s->inflight_++;
+}
+
+void UringLoop::updateClock() {
+    now_ = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void UringLoop::runOnce(int max_wait_ms) {
+    updateClock();
+    int timeout = timers_.nextTimeout(now_);
+    if (max_wait_ms >= 0 && (timeout < 0 || timeout > max_wait_ms)) {
+        timeout = max_wait_ms;
+    }
+
+    // One syscall submits everything queued since the last round and waits
+    ring_->submitAndWait(timeout);
+    updateClock();
+
+    uint64_t user_data;
+    int res;
+    while (ring_->nextCompletion(user_data, res)) {
+        UringSession* s = (UringSession*)(uintptr_t)(user_data & ~(uint64_t)OP_MASK);
+        s->onCompletion((unsigned)(user_data & OP_MASK), res);
+    }
+
+    timers_.advance(now_);
+
+    // Released sessions are freed once the kernel no longer references their buffers
+    size_t kept = 0;
+    for (size_t i = 0; i < graveyard_.size(); i++) {
+        if (graveyard_[i]->inflight_ == 0) {
+            delete graveyard_[i];
+        } else {
+            graveyard_[kept++] = graveyard_[i];
+        }
+    }
+    graveyard_.resize(kept);
+}
+
+#endif // HAVE_IO_URING
@@ -0,0 +1,127 @@
+#ifndef URING_H
+#define URING_H
+
+#include <string>
+#include <vector>
+
+#include "client.h"
+#include "eventloop.h"
+#include "session.h"
+#include "rtt.h"
+#include "timing.h"
+
+// Optional io_uring transport, enabled at build time with IO_URING=raw (plain
+// syscalls) or IO_URING=liburing. Sessions are the same state machines that the
+// epoll loop drives; only the I/O underneath differs.
+
+// True if this binary was built with io_uring support
+bool uringCompiledIn();
+
+#ifdef HAVE_IO_URING
+
+class IoRing;
+class UringLoop;
+
+// Drives one Session with io_uring connect/send/recv operations. Frames are
+// received into and sent from a slot of the loop's registered buffer area.
+class UringSession : public SessionDriver, public TimerHandler {
+public:
+    bool done() const override { return finished_; }
+    bool ok() const override { return finished_ && session_->status() == SESSION_OK; }
+    bool connectFailed() const override { return connect_failed_; }
+    bool isTCP() const override { return !session_->isDatagram(); }
+
+    void onTimer() override;
+
+private:
+    friend class UringLoop;
+
+    UringSession(UringLoop& loop, Session* session, SessionObserver* observer);
+    ~UringSession();
+    UringSession(const UringSession&);
+    UringSession& operator=(const UringSession&);
+
+    bool start(const std::string& host, int port);
+    void onCompletion(unsigned op, int res);
+    void pump();
+    void finish();
+    uint64_t stepTimeoutMs() const;
+
+    UringLoop& loop_;
+    Session* session_;
+    SessionObserver* observer_;
+    int fd_;
+    struct sockaddr_storage addr_;
+    socklen_t addr_len_;
+    int slot_;            // Registered buffer slot, -1 if using private buffers
+    char* rx_buf_;
+    char* tx_buf_;
+    size_t tx_len_;
+    unsigned inflight_;   // Submitted operations whose completion has not arrived yet
+    bool recv_pending_;
+    bool send_pending_;
+    bool connecting_;
+    bool connect_failed_;
+    bool finished_;
+    unsigned last_progress_;
+    RetransmitTracker retransmit_;
+    PhaseTimes times_;
+    Timer timer_;
+};
+
+// io_uring based loop: all operations queued while handling one batch of
+// completions go to the kernel in a single io_uring_enter() call.
+class UringLoop {
+public:
+    // slots: number of sessions that get a registered (fixed) buffer
+    explicit UringLoop(unsigned slots);
+    ~UringLoop();
+
+    bool valid() const;
+
+    // Start a session; returns nullptr (after deleting session) if no socket could be set up
+    UringSession* start(Session* session, const std::string& host, int port,
+                        SessionObserver* observer);
+
+    // Destroy a finished session once its in-flight operations have drained
+    void release(UringSession* session);
+
+    void runOnce(int max_wait_ms = -1);
+
+    uint64_t now() const { return now_; }
+    void addTimer(Timer* timer, uint64_t delay_ms) { timers_.schedule(timer, now_ + delay_ms); }
+    void cancelTimer(Timer* timer) { timers_.cancel(timer); }
+
+private:
+    friend class UringSession;
+
+    UringLoop(const UringLoop&);
+    UringLoop& operator=(const UringLoop&);
+
+    // false if the submission queue stayed full
+    bool queueConnect(UringSession* s);
+    bool queueSend(UringSession* s, size_t len);
+    bool queueRecv(UringSession* s);
+    void queueCancel(UringSession* s, unsigned op);
+    struct io_uring_sqe* nextSqe();
+
+    int acquireSlot();
+    void releaseSlot(int slot);
+    char* slotBuffer(int slot) { return &buffers_[(size_t)slot * 2 * SLOT_SIZE]; }
+
+    void updateClock();
+
+    enum { SLOT_SIZE = 512 };
+
+    IoRing* ring_;
+    std::vector<char> buffers_;
+    bool fixed_buffers_;
+    std::vector<int> free_slots_;
+    std::vector<UringSession*> graveyard_;
+    TimerWheel timers_;
+    uint64_t now_;
+};
+
+#endif // HAVE_IO_URING
+
+#endif // URING_H
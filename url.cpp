@@ -0,0 +1,110 @@
+#include <cstring>
+
+#include "url.h"
+
+// Does [begin, end) equal word (lower case), ignoring case?
+static bool equalsIgnoreCase(const char* begin, const char* end, const char* word) {
+    size_t len = strlen(word);
+    if ((size_t)(end - begin) != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if ((begin[i] | 0x20) != word[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isHexDigit(char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+bool parseURL(const std::string& url, URLInfo& info) {
+    const char* p = url.data();
+    const char* end = p + url.size();
+
+    // PROTOCOL://
+    const char* scheme = p;
+    while (p < end && *p != ':') {
+        p++;
+    }
+    const char* scheme_end = p;
+    URLTransport transport;
+    if (equalsIgnoreCase(scheme, scheme_end, "tcp")) {
+        transport = URL_TCP;
+    } else if (equalsIgnoreCase(scheme, scheme_end, "udp")) {
+        transport = URL_UDP;
+    } else if (equalsIgnoreCase(scheme, scheme_end, "any")) {
+        transport = URL_ANY;
+    } else {
+        return false;
+    }
+    if (end - p < 3 || memcmp(p, "://", 3) != 0) {
+        return false;
+    }
+    p += 3;
+
+    // host or [IPv6 literal]
+    const char* host;
+    const char* host_end;
+    if (p < end && *p == '[') {
+        host = ++p;
+        while (p < end && (isHexDigit(*p) || *p == ':' || *p == '.')) {
+            p++;
+        }
+        host_end = p;
+        if (p == end || *p != ']' || host_end - host < 2) {
+            return false;
+        }
+        p++;
+    } else {
+        host = p;
+        while (p < end && *p != ':' && *p != '/') {
+            p++;
+        }
+        host_end = p;
+        if (host_end == host) {
+            return false;
+        }
+    }
+
+    // :port
+    if (p == end || *p != ':') {
+        return false;
+    }
+    const char* digits = ++p;
+    int port = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        port = port * 10 + (*p - '0');
+        if (port > 65535) {
+            return false;
+        }
+        p++;
+    }
+    if (p == digits || port == 0) {
+        return false;
+    }
+
+    // /api
+    if (p == end || *p != '/') {
+        return false;
+    }
+    const char* api = ++p;
+    bool text;
+    if (equalsIgnoreCase(api, end, "text")) {
+        text = true;
+    } else if (equalsIgnoreCase(api, end, "binary")) {
+        text = false;
+    } else {
+        return false;
+    }
+
+    info.protocol.assign(scheme, scheme_end);
+    info.host.assign(host, host_end);
+    info.port = port;
+    info.api.assign(api, end);
+    info.transport = transport;
+    info.text = text;
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef URL_H
+#define URL_H
+
+#include <string>
+
+// Transport named by the URL
+enum URLTransport {
+    URL_TCP,
+    URL_UDP,
+    URL_ANY     // UDP first, TCP as the fallback
+};
+
+// Structure to hold parsed URL information. parseURL() decodes protocol and
+// api once into transport and text, which is what everything else looks at.
+struct URLInfo {
+    std::string protocol;  // TCP, UDP, or ANY
+    std::string host;
+    int port;
+    std::string api;       // text or binary
+    URLTransport transport;
+    bool text;             // api is TEXT (otherwise BINARY)
+};
+
+// Parse PROTOCOL://host:port/api in a single pass. PROTOCOL (tcp, udp, any)
+// and api (text, binary) are matched case-insensitively; host may be an IPv6
+// literal in brackets ("[::1]", stored without them); port must be 1-65535.
+// info is only written when the whole URL is valid.
+bool parseURL(const std::string& url, URLInfo& info);
+
+#endif // URL_H